@@ -5,5 +5,7 @@ pushd build
 set IncludePath="..\include"
 
 call cl -nologo -Zi -FC /FC /Zi -FC /I%IncludePath% ..\src\smint.cpp
+call cl -nologo -Zi -FC /c /I%IncludePath% ..\src\libsmint.cpp && call lib -nologo libsmint.obj
+call cl -nologo -O2 -Zi -FC /I%IncludePath% ..\src\smint_bench.cpp
 
 popd
\ No newline at end of file
@@ -2,4 +2,6 @@
 
 mkdir -p build
 
-g++ -g -o ./build/smint -I./include ./src/smint.cpp
+g++ -g -pthread -o ./build/smint -I./include ./src/smint.cpp
+g++ -g -pthread -c -o ./build/libsmint.o -I./include ./src/libsmint.cpp && ar rcs ./build/libsmint.a ./build/libsmint.o
+g++ -O2 -g -pthread -o ./build/smint_bench -I./include ./src/smint_bench.cpp
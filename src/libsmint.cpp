@@ -0,0 +1,430 @@
+// libsmint: the implementation of the API in libsmint.h. Like the command line tool, it's built as a single
+// translation unit from everything included below.
+
+#include "libsmint.h"
+#include "util.h"
+#include "smint.h"
+#include "smint_stats.cpp"
+
+#define RAPIDJSON_MALLOC(Size) TrackedMalloc(Size)
+#define RAPIDJSON_REALLOC(Ptr, NewSize) TrackedRealloc(Ptr, NewSize)
+#define RAPIDJSON_FREE(Ptr) TrackedFree(Ptr)
+#include "rapidjson/document.h"
+#include "rapidjson/writer.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/error/en.h"
+#include "rapidjson/filereadstream.h"
+#include "rapidjson/filewritestream.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#define STBI_ASSERT(X) Assert(X)
+#define STBI_MALLOC(Size) TrackedMalloc(Size)
+#define STBI_REALLOC(Ptr, NewSize) TrackedRealloc(Ptr, NewSize)
+#define STBI_FREE(Ptr) TrackedFree(Ptr)
+#define STB_IMAGE_STATIC // So programs embedding the library can have their own copy
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#define STBIW_ASSERT(X) Assert(X)
+#define STBIW_MALLOC(Size) TrackedMalloc(Size)
+#define STBIW_REALLOC(Ptr, NewSize) TrackedRealloc(Ptr, NewSize)
+#define STBIW_FREE(Ptr) TrackedFree(Ptr)
+#define STB_IMAGE_WRITE_STATIC
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include "smint_arena.cpp"
+#include "smint_io.cpp"
+#include "smint_simd.cpp"
+#include "smint_palette.cpp"
+#include "smint_order.cpp"
+#include "smint_png.cpp"
+#include "smint_tileset.cpp"
+#include "smint_encoding.cpp"
+#include "smint_cache.cpp"
+#include "smint_map.cpp"
+#include "smint_stream.cpp"
+#include "smint_watch.cpp"
+#include "smint_merge.cpp"
+#include "smint_batch.cpp"
+#include "smint_quantise.cpp"
+#include "smint_gba.cpp"
+
+
+struct smint_context
+{
+	smint_settings Settings;
+	char CacheDir[MAX_PATH];
+	char MergedTilesetPath[MAX_PATH];
+	log_sink Sink;
+
+	map_job** Maps;
+	u32 NumMaps;
+	tileset_job* Jobs;
+	u32 NumJobs;
+	b32 HasMinimised; // Even if it failed; the maps have to be cleared before trying again
+	b32 HasWrittenMaps;
+	f64 StartWallSeconds; // Of the current run
+
+	merged_tileset Merged; // Only with MergedTilesetPath
+
+	watch_state* Watch; // Only with KeepTilesetsResident
+};
+
+static std::atomic<b32> TileKernelsChosen;
+static std::once_flag DefaultTileKernelsOnce;
+
+// Messages logged on this thread during an API call go to the context's callback
+log_sink* BeginApiCall(smint_context* Context)
+{
+	log_sink* PreviousSink = ThreadLogSink;
+	ThreadLogSink = &Context->Sink;
+	return PreviousSink;
+}
+
+void EndApiCall(log_sink* PreviousSink)
+{
+	ThreadLogSink = PreviousSink;
+}
+
+void SmintSetSimdEnabled(int Enabled)
+{
+	InitTileKernels(Enabled);
+	TileKernelsChosen = true;
+}
+
+smint_context* SmintCreateContext(const smint_settings* Settings)
+{
+	std::call_once(DefaultTileKernelsOnce, []()
+	{
+		if (!TileKernelsChosen)
+		{
+			InitTileKernels(true);
+		}
+	});
+
+	smint_context* Context = (smint_context*)TrackedCalloc(1, sizeof(smint_context));
+	Context->Settings = *Settings;
+	Context->Sink.Callback = Settings->Log;
+	Context->Sink.UserData = Settings->LogUserData;
+
+	// Both are copied, so the caller doesn't have to keep them alive
+	b32 PathsFit = true;
+	log_sink* PreviousSink = BeginApiCall(Context);
+	if (Settings->CacheDir && strlen(Settings->CacheDir) >= sizeof(Context->CacheDir))
+	{
+		LogError("ERROR: Cache directory '%s' is too long.\n", Settings->CacheDir);
+		PathsFit = false;
+	}
+	if (Settings->MergedTilesetPath && strlen(Settings->MergedTilesetPath) >= sizeof(Context->MergedTilesetPath))
+	{
+		LogError("ERROR: Merged tileset path '%s' is too long.\n", Settings->MergedTilesetPath);
+		PathsFit = false;
+	}
+	EndApiCall(PreviousSink);
+	if (!PathsFit)
+	{
+		TrackedFree(Context);
+		return nullptr;
+	}
+
+	if (Settings->CacheDir)
+	{
+		strcpy(Context->CacheDir, Settings->CacheDir);
+		Context->Settings.CacheDir = Context->CacheDir;
+	}
+	if (Settings->MergedTilesetPath)
+	{
+		strcpy(Context->MergedTilesetPath, Settings->MergedTilesetPath);
+		Context->Settings.MergedTilesetPath = Context->MergedTilesetPath;
+	}
+	if (Settings->KeepTilesetsResident)
+	{
+		Context->Watch = CreateWatchState();
+	}
+	Context->StartWallSeconds = GetWallSeconds();
+	return Context;
+}
+
+void SmintClearMaps(smint_context* Context)
+{
+	for (u32 JobIndex = 0; JobIndex < Context->NumJobs; JobIndex++)
+	{
+		FreeTilesetJob(Context->Jobs + JobIndex);
+	}
+	delete[] Context->Jobs;
+	for (u32 MapIndex = 0; MapIndex < Context->NumMaps; MapIndex++)
+	{
+		FreeMapJob(Context->Maps[MapIndex]);
+		delete Context->Maps[MapIndex];
+	}
+	TrackedFree(Context->Maps);
+	ClearArena(&Context->Merged.Arena);
+
+	Context->Maps = nullptr;
+	Context->NumMaps = 0;
+	Context->Jobs = nullptr;
+	Context->NumJobs = 0;
+	Context->HasMinimised = false;
+	Context->HasWrittenMaps = false;
+	Context->StartWallSeconds = GetWallSeconds();
+}
+
+void SmintDestroyContext(smint_context* Context)
+{
+	SmintClearMaps(Context);
+	if (Context->Watch)
+	{
+		FreeWatchState(Context->Watch);
+	}
+	TrackedFree(Context);
+}
+
+int SmintAddMap(smint_context* Context, const char* BaseDir, const char* MapPath)
+{
+	log_sink* PreviousSink = BeginApiCall(Context);
+	b32 Result = false;
+	if (Context->HasMinimised)
+	{
+		LogError("ERROR: Maps can't be added after minimising; clear the context first.\n");
+	}
+	else
+	{
+		map_job* Map = new map_job();
+		char JoinedPath[MAX_PATH];
+		JoinPath(BaseDir ? BaseDir : "", MapPath, JoinedPath);
+		GetFullPath(JoinedPath, Map->FilePath);
+		if (Context->Watch)
+		{
+			Map->Watched = WatchMap(Context->Watch, Map->FilePath);
+		}
+
+		// Stages run on the calling thread are recorded against the map they're for
+		ThreadStageStats = Map->Stats;
+		stage_timer ParseMapTimer = BeginStage(Stage_ParseMap);
+		Result = LoadMap(Map, Context->Settings.UseStreaming, Context->Settings.RemoveUnusedTiles);
+		EndStage(&ParseMapTimer);
+		ThreadStageStats = nullptr;
+
+		if (Result)
+		{
+			Context->Maps = (map_job**)TrackedRealloc(Context->Maps, sizeof(map_job*) * (Context->NumMaps + 1));
+			Context->Maps[Context->NumMaps++] = Map;
+		}
+		else
+		{
+			FreeMapJob(Map);
+			delete Map;
+		}
+	}
+	EndApiCall(PreviousSink);
+	return Result;
+}
+
+int SmintAddMapDirectory(smint_context* Context, const char* BaseDir, const char* Dir)
+{
+	log_sink* PreviousSink = BeginApiCall(Context);
+	char FullDir[MAX_PATH];
+	JoinPath(BaseDir ? BaseDir : "", Dir, FullDir);
+	char (*MapPaths)[MAX_PATH] = nullptr;
+	u32 NumMaps = 0;
+	b32 Result = ListMapFiles(FullDir, &MapPaths, &NumMaps);
+	for (u32 MapIndex = 0; MapIndex < NumMaps && Result; MapIndex++)
+	{
+		Result = SmintAddMap(Context, nullptr, MapPaths[MapIndex]);
+	}
+	TrackedFree(MapPaths);
+	EndApiCall(PreviousSink);
+	return Result;
+}
+
+int SmintMinimise(smint_context* Context)
+{
+	log_sink* PreviousSink = BeginApiCall(Context);
+	b32 Result = false;
+	if (Context->HasMinimised)
+	{
+		LogError("ERROR: These maps have already been minimised; clear the context first.\n");
+	}
+	else if (Context->NumMaps == 0)
+	{
+		LogError("ERROR: No map files to minimise.\n");
+	}
+	else if (Context->Settings.TileOrder != SMINT_TILE_ORDER_FIRST && Context->Settings.UseStreaming)
+	{
+		LogError("ERROR: Tiles can't be ordered by how they're used while maps are streamed.\n");
+	}
+	else if (Context->Settings.PngLevel > 9)
+	{
+		LogError("ERROR: PNG compression level %u is out of range (1-9, or 0 for stb_image_write).\n", Context->Settings.PngLevel);
+	}
+	else
+	{
+		Context->HasMinimised = true;
+		smint_settings* Settings = &Context->Settings;
+		Context->Jobs = CreateTilesetJobs(Context->Maps, Context->NumMaps, Settings->RemoveUnusedTiles, &Context->NumJobs);
+		// Tilesets sharing an image only minimise it differently if they use its tiles differently
+		b32 CanImagesDiffer = Settings->RemoveUnusedTiles || Settings->TileOrder != SMINT_TILE_ORDER_FIRST;
+		if (!CanImagesDiffer || CheckMinimisedImagesAreDistinct(Context->Jobs, Context->NumJobs))
+		{
+			if (Settings->TileOrder != SMINT_TILE_ORDER_FIRST)
+			{
+				CountTileUsage(Context->Maps, Context->NumMaps, Context->Jobs);
+			}
+			if (Context->Watch)
+			{
+				AttachResidentTilesets(Context->Watch, Context->Jobs, Context->NumJobs);
+			}
+
+			tileset_job_queue JobQueue;
+			JobQueue.Jobs = Context->Jobs;
+			JobQueue.NumJobs = Context->NumJobs;
+			JobQueue.NextJobIndex = 0;
+			JobQueue.RemoveUnusedTiles = Settings->RemoveUnusedTiles;
+			JobQueue.UseLinearDedup = Settings->UseLinearDedup;
+			JobQueue.UseIndexedTiles = Settings->UseIndexedTiles;
+			JobQueue.CacheDir = Settings->CacheDir;
+			JobQueue.TileOrder = Settings->TileOrder;
+			JobQueue.PngLevel = Settings->PngLevel;
+			JobQueue.PngFilter = Settings->PngFilter;
+			RunTilesetJobsInParallel(&JobQueue, Settings->NumThreads);
+
+			if (Context->Watch)
+			{
+				// Any map using a tileset that was minimised again needs rewriting, even if this run goes on to fail
+				for (u32 MapIndex = 0; MapIndex < Context->NumMaps; MapIndex++)
+				{
+					map_job* Map = Context->Maps[MapIndex];
+					for (u32 TilesetIndex = 0; TilesetIndex < Map->NumTilesets; TilesetIndex++)
+					{
+						if (!Context->Jobs[Map->Tilesets[TilesetIndex].JobIndex].IsReused)
+						{
+							Map->Watched->NeedsWrite = true;
+						}
+					}
+				}
+			}
+
+			// Report results strictly in tileset order so output is identical regardless of how many threads ran
+			Result = true;
+			for (u32 JobIndex = 0; JobIndex < Context->NumJobs && Result; JobIndex++)
+			{
+				tileset_job* Job = Context->Jobs + JobIndex;
+				FlushMessageLog(&Job->Log);
+				Result = !Job->Error;
+			}
+		}
+	}
+	EndApiCall(PreviousSink);
+	return Result;
+}
+
+unsigned SmintGetNumTilesets(smint_context* Context)
+{
+	return Context->NumJobs;
+}
+
+int SmintGetTilesetResult(smint_context* Context, unsigned TilesetIndex, smint_tileset_result* OutResult)
+{
+	if (TilesetIndex >= Context->NumJobs || Context->Jobs[TilesetIndex].Error)
+	{
+		return false;
+	}
+
+	tileset_job* Job = Context->Jobs + TilesetIndex;
+	OutResult->TilesetPath = Job->TilesetPath;
+	OutResult->BaseDir = Job->BaseDir;
+	OutResult->NewTilesetPath = Job->MinTiles.IsUnchanged ? "" : Job->NewTilesetPath;
+	OutResult->NumTiles = Job->NumTiles;
+	OutResult->NumUniqueTiles = Job->MinTiles.NumUniqueTiles;
+	OutResult->IsUnchanged = Job->MinTiles.IsUnchanged;
+	return true;
+}
+
+int SmintWriteMaps(smint_context* Context)
+{
+	log_sink* PreviousSink = BeginApiCall(Context);
+	b32 Result = false;
+	if (!Context->HasMinimised || Context->HasWrittenMaps)
+	{
+		LogError("ERROR: Maps can only be written once, after minimising their tilesets.\n");
+	}
+	else
+	{
+		Context->HasWrittenMaps = true;
+		Result = true;
+		for (u32 JobIndex = 0; JobIndex < Context->NumJobs && Result; JobIndex++)
+		{
+			Result = !Context->Jobs[JobIndex].Error;
+		}
+
+		smint_settings* Settings = &Context->Settings;
+		merged_tileset* Merged = nullptr;
+		if (Result && Settings->MergedTilesetPath)
+		{
+			if (Settings->UseStreaming)
+			{
+				LogError("ERROR: Tilesets can't be merged while maps are streamed.\n");
+				Result = false;
+			}
+			else
+			{
+				png_options Png = {Settings->PngLevel, Settings->PngFilter, Settings->NumThreads};
+				Result = MergeTilesets(Context->Jobs, Context->NumJobs, Settings->MergedTilesetPath, &Context->Merged,
+				                       Settings->PngLevel ? &Png : nullptr);
+				Merged = &Context->Merged;
+			}
+		}
+
+		for (u32 MapIndex = 0; MapIndex < Context->NumMaps && Result; MapIndex++)
+		{
+			map_job* Map = Context->Maps[MapIndex];
+			if (Map->Watched && !Map->Watched->NeedsWrite && !Merged)
+			{
+				continue; // Merged tile indices can move whenever any tileset changes, so then every map is written again
+			}
+			ThreadStageStats = Map->Stats;
+			if (Settings->GbaBitsPerPixel)
+			{
+				// Has to come first, since writing the map remaps its layers in place
+				Result = ExportGbaMap(Map, Context->Jobs, Settings);
+			}
+			Result = Result && WriteMinimisedMap(Map, Context->Jobs, Settings->UseStreaming, Merged);
+			if (Map->Watched && Result)
+			{
+				Map->Watched->NeedsWrite = false;
+			}
+		}
+		ThreadStageStats = nullptr;
+	}
+	EndApiCall(PreviousSink);
+	return Result;
+}
+
+int SmintReportStats(smint_context* Context, int PrintTable, const char* JsonPath)
+{
+	log_sink* PreviousSink = BeginApiCall(Context);
+	b32 Result = ReportStats(Context->Maps, Context->NumMaps, Context->Jobs, Context->NumJobs, Context->StartWallSeconds,
+	                        PrintTable, JsonPath);
+	EndApiCall(PreviousSink);
+	return Result;
+}
+
+int SmintWaitForChanges(smint_context* Context)
+{
+	watch_state* Watch = Context->Watch;
+	if (!Watch || (Watch->NumMaps == 0 && Watch->NumTilesets == 0))
+	{
+		return false;
+	}
+
+	WatchInputs(Watch);
+	do
+	{
+		WaitForFileChanges(&Watch->Watcher);
+	} while (!HaveInputsChanged(Watch));
+	return true;
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+// libsmint: smint as a library, for embedding in tools that minimise maps without shelling out to the command line
+// tool (which is itself a thin wrapper over this API). Everything a run needs is owned by an smint_context; separate
+// contexts share no state (other than the memory totals of SmintReportStats), so they can be used from different threads
+// at the same time. A single context must only be used by one thread at a time.
+//
+// Typical use:
+//     smint_context* Context = SmintCreateContext(&Settings);
+//     SmintAddMap(Context, "assets/levels", "castle.tmj");
+//     if (SmintMinimise(Context)) SmintWriteMaps(Context);
+//     SmintDestroyContext(Context);
+//
+// Functions returning int return nonzero on success. Anything that goes wrong is reported through the log callback.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct smint_context smint_context;
+
+// Message is a complete line (or lines) of output, including the newline; IsError is set for errors and warnings that
+// the command line tool prints to stderr
+typedef void smint_log_func(void* UserData, int IsError, const char* Message);
+
+// Output formats of the GBA export (see smint_settings)
+#define SMINT_GBA_BIN 1 // Raw little-endian .bin files
+#define SMINT_GBA_C 2 // C arrays (.c/.h)
+#define SMINT_GBA_ASM 4 // GNU assembler (.s/.h)
+
+// Orders of the unique tiles in a minimised tileset (see smint_settings)
+#define SMINT_TILE_ORDER_FIRST 0 // Where each was first found in the original tileset
+#define SMINT_TILE_ORDER_USAGE 1 // Most used in the map(s) first
+#define SMINT_TILE_ORDER_ADJACENT 2 // Tiles most often next to each other in the map(s) next to each other
+
+// Row filters of the built-in PNG writer (see smint_settings)
+#define SMINT_PNG_FILTER_AUTO 0 // None for indexed images, adaptive otherwise
+#define SMINT_PNG_FILTER_NONE 1
+#define SMINT_PNG_FILTER_SUB 2
+#define SMINT_PNG_FILTER_UP 3
+#define SMINT_PNG_FILTER_AVERAGE 4
+#define SMINT_PNG_FILTER_PAETH 5
+#define SMINT_PNG_FILTER_ADAPTIVE 6 // Whichever of the above suits each row best
+
+typedef struct smint_settings
+{
+	int RemoveUnusedTiles; // Same as -rut
+	int UseLinearDedup;
+	int UseIndexedTiles; // Compare and hash tiles as indices into a per-tileset palette, where it has 256 colours or fewer
+	int UseStreaming; // Rewrite maps as they're read, rather than loading them into memory first
+	unsigned NumThreads; // For minimising tilesets; 0 means one per core
+	const char* CacheDir; // Optional on-disk cache of minimised tilesets; must already exist
+
+	// One of SMINT_TILE_ORDER_*. Anything but the default counts how every map uses each tileset's tiles before they're
+	// minimised, so can't be used with UseStreaming.
+	unsigned TileOrder;
+
+	// Compression level (1-9) of the built-in PNG writer for minimised and merged tileset images, or 0 to write them with
+	// stb_image_write as before. The built-in writer uses spare threads (see NumThreads) to deflate big images, and writes
+	// indexed colour when an image has 256 colours or fewer. PngFilter is one of SMINT_PNG_FILTER_*.
+	unsigned PngLevel;
+	unsigned PngFilter;
+
+	// Optional path (relative to the working directory) of a .tsj to merge every tileset's unique tiles into, with its
+	// image next to it; every map then refers to that tileset alone. Can't be used with UseStreaming.
+	const char* MergedTilesetPath;
+
+	// Keep tilesets in memory after SmintClearMaps, so that when the same maps are run again only what has changed on
+	// disk since is redone, and only maps that need it are rewritten. See SmintWaitForChanges.
+	int KeepTilesetsResident;
+
+	// Also export every map as GBA background data when it's written, next to the map: the unique tiles of all its
+	// tilesets at GbaBitsPerPixel (4 or 8; 0 for no export), one palette, and a screen entry array per layer. GbaFormats
+	// is any combination of SMINT_GBA_* (0 means SMINT_GBA_BIN). Can't be used with UseStreaming.
+	unsigned GbaBitsPerPixel;
+	unsigned GbaFormats;
+
+	// With GBA export, the number of 16KB charblocks (1-4) each map's tiles have to fit in, or 0 for no budget. A map that
+	// doesn't fit fails to export, unless GbaFitVramBudget is set, in which case its least-used tiles are merged into the
+	// ones that look most like them until it does.
+	unsigned GbaVramBudget;
+	int GbaFitVramBudget;
+
+	// With GBA export, also group each GbaMetatileSize x GbaMetatileSize block of cells (e.g. 2 for 16x16 pixels) into a
+	// metatile, and export a table of the unique metatiles plus one array of metatile entries per layer in place of the
+	// layers' screen entries. 0 for no metatiles.
+	unsigned GbaMetatileSize;
+
+	smint_log_func* Log; // Optional; messages go to stdout/stderr if not set
+	void* LogUserData;
+} smint_settings;
+
+typedef struct smint_tileset_result
+{
+	const char* TilesetPath; // Relative to BaseDir
+	const char* BaseDir; // Directory of the first map that referenced the tileset
+	const char* NewTilesetPath; // Relative to BaseDir; empty if the tileset was already minimal
+	unsigned NumTiles;
+	unsigned NumUniqueTiles; // Counting only the tiles that are kept
+	int IsUnchanged; // Already minimal, so no output files were written for it
+} smint_tileset_result;
+
+// Whether tile comparisons may use SSE2/AVX2 (on by default). Applies to the whole process, so only call this before
+// creating any contexts.
+void SmintSetSimdEnabled(int Enabled);
+
+// Returns null (having logged why) if the settings can't be used
+smint_context* SmintCreateContext(const smint_settings* Settings);
+void SmintDestroyContext(smint_context* Context);
+
+// Loads and validates a map (.tmj/.json); MapPath is relative to BaseDir, which may be null for the working directory
+int SmintAddMap(smint_context* Context, const char* BaseDir, const char* MapPath);
+
+// Adds every map directly inside a directory, in name order (skipping any _min output files)
+int SmintAddMapDirectory(smint_context* Context, const char* BaseDir, const char* Dir);
+
+// Minimises every tileset used by the maps added so far, writing out the minimised tileset (.tsj) and image (.png) of
+// each one that wasn't already minimal. Tilesets shared by several maps are only minimised once.
+int SmintMinimise(smint_context* Context);
+
+unsigned SmintGetNumTilesets(smint_context* Context);
+int SmintGetTilesetResult(smint_context* Context, unsigned TilesetIndex, smint_tileset_result* OutResult);
+
+// Writes out every map (as <name>_min.tmj) pointing at the minimised tilesets; maps whose tilesets were all already
+// minimal aren't written
+int SmintWriteMaps(smint_context* Context);
+
+// Per-stage timings and memory use of the last run: printed as a table through the log callback if PrintTable is set,
+// and/or written to JsonPath as JSON if it's not null. The per-stage figures are the context's own, but the overall peak
+// memory figures are for the whole process since it started, so include any other contexts running alongside this one.
+int SmintReportStats(smint_context* Context, int PrintTable, const char* JsonPath);
+
+// Forgets the maps and results of the last run, so the context can be used again
+void SmintClearMaps(smint_context* Context);
+
+// Only with KeepTilesetsResident, after a run: blocks until any map, tileset or tileset image used by it changes on
+// disk. Returns zero if there's nothing to watch.
+int SmintWaitForChanges(smint_context* Context);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,273 +1,278 @@
-#include "util.h"
-#include "smint.h"
+#include "libsmint.cpp"
 
-#include "rapidjson/document.h"
-#include "rapidjson/writer.h"
-#include "rapidjson/stringbuffer.h"
-#include "rapidjson/error/en.h"
-
-#define STBI_ASSERT(X) Assert(X)
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
-
-#define STBIW_ASSERT(X) Assert(X)
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
-
-#include "smint_io.cpp"
-#include "smint_tileset.cpp"
-
-enum tiled_flip_flags : u32
-{
-	TiledFlag_HFlip 	   = 0x80000000,
-	TiledFlag_VFlip 	   = 0x40000000,
-	TiledFlag_DiagonalFlip = 0x20000000,
-	TiledFlag_Rotated      = 0x10000000
-};
-
-int main(int ArgC, char** ArgV)
+// The whole command line tool, as a thin wrapper over libsmint; kept separate from main() so the benchmark can run the
+// full pipeline in-process
+int RunSmint(int ArgC, char** ArgV)
 {
-	if (ArgC != 2 && ArgC != 3)
+	if (ArgC < 2)
 	{
-		printf("Usage: smint tiled_map.tmj [-rut]\n");
+		printf("Usage: smint tiled_map.tmj|maps_dir [more maps...] [-rut] [--jobs N] [--stream] [--linear-dedup] [--indexed] "
+		       "[--no-simd] [--stats] [--stats-json path] [--cache dir] [--watch] [--gba 4|8] [--gba-format bin|c|s[,...]] "
+		       "[--vram-budget 1-4] [--vram-fit] [--metatiles N] [--merge-tilesets out.tsj] "
+		       "[--tile-order first|usage|adjacent] [--png-level 1-9] [--png-filter name]\n");
 		return 1;
 	}
 
-	b32 ShouldRemoveUnusedTiles = ArgC == 3 && (strcmp(ArgV[2], "-rut") == 0 || strcmp(ArgV[2], "--remove-unused-tiles"));
+	smint_settings Settings = {};
+	Settings.NumThreads = 1;
+	b32 AllowSimd = true;
+	b32 PrintStats = false;
+	const char* StatsJsonPath = nullptr;
+	b32 WatchForChanges = false;
+	const char** MapArgs = (const char**)TrackedMalloc(sizeof(const char*) * ArgC);
+	u32 NumMapArgs = 0;
+	for (s32 ArgIndex = 1; ArgIndex < ArgC; ArgIndex++)
+	{
+		char* Arg = ArgV[ArgIndex];
+		if (strcmp(Arg, "-rut") == 0 || strcmp(Arg, "--remove-unused-tiles") == 0)
+		{
+			Settings.RemoveUnusedTiles = true;
+		}
+		else if ((strcmp(Arg, "--jobs") == 0 || strcmp(Arg, "-j") == 0) && ArgIndex + 1 < ArgC)
+		{
+			// 0 means one thread per core
+			Settings.NumThreads = (u32)atoi(ArgV[++ArgIndex]);
+		}
+		else if (strcmp(Arg, "--stream") == 0)
+		{
+			Settings.UseStreaming = true;
+		}
+		else if (strcmp(Arg, "--linear-dedup") == 0)
+		{
+			Settings.UseLinearDedup = true;
+		}
+		else if (strcmp(Arg, "--indexed") == 0)
+		{
+			Settings.UseIndexedTiles = true;
+		}
+		else if (strcmp(Arg, "--no-simd") == 0)
+		{
+			AllowSimd = false;
+		}
+		else if (strcmp(Arg, "--stats") == 0)
+		{
+			PrintStats = true;
+		}
+		else if (strcmp(Arg, "--stats-json") == 0 && ArgIndex + 1 < ArgC)
+		{
+			StatsJsonPath = ArgV[++ArgIndex];
+		}
+		else if (strcmp(Arg, "--cache") == 0 && ArgIndex + 1 < ArgC)
+		{
+			Settings.CacheDir = ArgV[++ArgIndex];
+		}
+		else if (strcmp(Arg, "--watch") == 0)
+		{
+			WatchForChanges = true;
+		}
+		else if (strcmp(Arg, "--gba") == 0 && ArgIndex + 1 < ArgC)
+		{
+			Settings.GbaBitsPerPixel = (u32)atoi(ArgV[++ArgIndex]);
+			if (Settings.GbaBitsPerPixel != 4 && Settings.GbaBitsPerPixel != 8)
+			{
+				fprintf(stderr, "ERROR: --gba takes the bits per pixel of the tiles, either 4 or 8.\n");
+				return 1;
+			}
+		}
+		else if (strcmp(Arg, "--gba-format") == 0 && ArgIndex + 1 < ArgC)
+		{
+			// Comma-separated, e.g. "bin,c"
+			char Formats[64];
+			snprintf(Formats, sizeof(Formats), "%s", ArgV[++ArgIndex]);
+			for (char* Format = strtok(Formats, ","); Format; Format = strtok(nullptr, ","))
+			{
+				if (strcmp(Format, "bin") == 0)
+				{
+					Settings.GbaFormats |= SMINT_GBA_BIN;
+				}
+				else if (strcmp(Format, "c") == 0)
+				{
+					Settings.GbaFormats |= SMINT_GBA_C;
+				}
+				else if (strcmp(Format, "s") == 0)
+				{
+					Settings.GbaFormats |= SMINT_GBA_ASM;
+				}
+				else
+				{
+					fprintf(stderr, "ERROR: Unrecognised GBA output format '%s'; expected bin, c or s.\n", Format);
+					return 1;
+				}
+			}
+		}
+		else if (strcmp(Arg, "--merge-tilesets") == 0 && ArgIndex + 1 < ArgC)
+		{
+			Settings.MergedTilesetPath = ArgV[++ArgIndex];
+		}
+		else if (strcmp(Arg, "--tile-order") == 0 && ArgIndex + 1 < ArgC)
+		{
+			const char* Order = ArgV[++ArgIndex];
+			if (strcmp(Order, "first") == 0)
+			{
+				Settings.TileOrder = SMINT_TILE_ORDER_FIRST;
+			}
+			else if (strcmp(Order, "usage") == 0)
+			{
+				Settings.TileOrder = SMINT_TILE_ORDER_USAGE;
+			}
+			else if (strcmp(Order, "adjacent") == 0)
+			{
+				Settings.TileOrder = SMINT_TILE_ORDER_ADJACENT;
+			}
+			else
+			{
+				fprintf(stderr, "ERROR: Unrecognised tile order '%s'; expected first, usage or adjacent.\n", Order);
+				return 1;
+			}
+		}
+		else if (strcmp(Arg, "--png-level") == 0 && ArgIndex + 1 < ArgC)
+		{
+			Settings.PngLevel = (u32)atoi(ArgV[++ArgIndex]);
+			if (Settings.PngLevel < 1 || Settings.PngLevel > 9)
+			{
+				fprintf(stderr, "ERROR: --png-level takes a compression level from 1 (fastest) to 9 (smallest).\n");
+				return 1;
+			}
+		}
+		else if (strcmp(Arg, "--png-filter") == 0 && ArgIndex + 1 < ArgC)
+		{
+			const char* FilterNames[] = {"auto", "none", "sub", "up", "average", "paeth", "adaptive"};
+			const char* Filter = ArgV[++ArgIndex];
+			u32 FilterIndex = 0;
+			while (FilterIndex < ArrayCount(FilterNames) && strcmp(Filter, FilterNames[FilterIndex]) != 0)
+			{
+				FilterIndex++;
+			}
+			if (FilterIndex == ArrayCount(FilterNames))
+			{
+				fprintf(stderr, "ERROR: Unrecognised PNG filter '%s'; expected auto, none, sub, up, average, paeth or adaptive.\n",
+				        Filter);
+				return 1;
+			}
+			Settings.PngFilter = SMINT_PNG_FILTER_AUTO + FilterIndex;
+		}
+		else if (strcmp(Arg, "--metatiles") == 0 && ArgIndex + 1 < ArgC)
+		{
+			Settings.GbaMetatileSize = (u32)atoi(ArgV[++ArgIndex]);
+			if (Settings.GbaMetatileSize < 2 || Settings.GbaMetatileSize > 8)
+			{
+				fprintf(stderr, "ERROR: --metatiles takes the number of cells across each metatile, from 2 to 8.\n");
+				return 1;
+			}
+		}
+		else if (strcmp(Arg, "--vram-budget") == 0 && ArgIndex + 1 < ArgC)
+		{
+			Settings.GbaVramBudget = (u32)atoi(ArgV[++ArgIndex]);
+			if (Settings.GbaVramBudget < 1 || Settings.GbaVramBudget > 4)
+			{
+				fprintf(stderr, "ERROR: --vram-budget takes the number of charblocks the tiles can use, from 1 to 4.\n");
+				return 1;
+			}
+		}
+		else if (strcmp(Arg, "--vram-fit") == 0)
+		{
+			Settings.GbaFitVramBudget = true;
+		}
+		else if (Arg[0] == '-')
+		{
+			fprintf(stderr, "ERROR: Unrecognised argument '%s'.\n", Arg);
+			return 1;
+		}
+		else
+		{
+			MapArgs[NumMapArgs++] = Arg;
+		}
+	}
 
-	char MapFilePath[MAX_PATH];
-	char* MapRelPath = ArgV[1];
-	GetFullPath(MapRelPath, MapFilePath);
-	
-	char MapFileExtension[16];
-	GetFileExtension(MapFilePath, MapFileExtension);
-	if (strcmp(MapFileExtension, ".tmj") != 0 && strcmp(MapFileExtension, ".json") != 0)
+	if (Settings.GbaBitsPerPixel && Settings.UseStreaming)
 	{
-		fprintf(stderr, "ERROR: Unsupported map file format '%s'; please supply a .tmj/.json file.\n", MapFileExtension);
+		fprintf(stderr, "ERROR: --gba needs whole maps in memory, so it can't be combined with --stream.\n");
 		return 1;
 	}
 
-	str_buffer MapFileContents = ReadTextFile(MapFilePath);
-	if (!MapFileContents.Data)
+	if (Settings.MergedTilesetPath && Settings.UseStreaming)
 	{
+		fprintf(stderr, "ERROR: --merge-tilesets rewrites the tilesets list of every map, so it can't be combined with --stream.\n");
 		return 1;
 	}
-
-	rapidjson::Document JsonDoc;
-	if (JsonDoc.ParseInsitu(MapFileContents.Data).HasParseError())
+	if (Settings.TileOrder != SMINT_TILE_ORDER_FIRST && Settings.UseStreaming)
 	{
-		fprintf(stderr, "ERROR: Failed to parse map '%s': %s\n", MapFilePath, rapidjson::GetParseError_En(JsonDoc.GetParseError()));
+		fprintf(stderr, "ERROR: --tile-order counts how the maps use their tiles up front, so it can't be combined with --stream.\n");
 		return 1;
 	}
-
-	if (!JsonDoc.HasMember("layers") || !JsonDoc["layers"].IsArray())
+	if (Settings.PngFilter != SMINT_PNG_FILTER_AUTO && !Settings.PngLevel)
 	{
-		fprintf(stderr, "ERROR: Invalid map format - 'layers' element not found or invalid format.\n");
+		fprintf(stderr, "ERROR: --png-filter only applies to the built-in PNG writer, so it needs --png-level.\n");
 		return 1;
 	}
-	rapidjson::Value& Layers = JsonDoc["layers"];
-
-	if (!JsonDoc.HasMember("tilesets") || !JsonDoc["tilesets"].IsArray())
+	if ((Settings.GbaVramBudget || Settings.GbaFitVramBudget || Settings.GbaMetatileSize) && !Settings.GbaBitsPerPixel)
 	{
-		fprintf(stderr, "ERROR: Invalid map format - 'tilesets' not found or invalid format.\n");
+		fprintf(stderr, "ERROR: --vram-budget, --vram-fit and --metatiles only apply to GBA export, so they need --gba.\n");
 		return 1;
 	}
-	rapidjson::Value& TilesetsArray = JsonDoc["tilesets"];
-	
-	if (TilesetsArray.Size() == 0)
+	if (Settings.GbaFitVramBudget && !Settings.GbaVramBudget)
 	{
-		fprintf(stderr, "ERROR: 'tilesets' array in map file is empty.\n");
+		fprintf(stderr, "ERROR: --vram-fit needs a --vram-budget to fit the tiles into.\n");
 		return 1;
 	}
-	
-	char MapRelDir[MAX_PATH];
-	char MapWorkingDir[MAX_PATH];
-
-	StripFileName(MapFilePath, MapRelDir);
-	GetFullPath(MapRelDir, MapWorkingDir);
 
-	if (*MapRelDir)
+	if (Settings.CacheDir && !IsDirectory(Settings.CacheDir))
 	{
-		// Map is in a different directory to where we are
-		if (!ChangeWorkingDir(MapWorkingDir))
+		MakeDirectory(Settings.CacheDir);
+		if (!IsDirectory(Settings.CacheDir))
 		{
+			fprintf(stderr, "ERROR: Failed to create cache directory '%s'.\n", Settings.CacheDir);
 			return 1;
 		}
 	}
 
-	b32 EverythingAlreadyMinimised = true;
-	for (u32 TilesetIndex = 0; TilesetIndex < TilesetsArray.Size(); TilesetIndex++)
+	SmintSetSimdEnabled(AllowSimd);
+	Settings.KeepTilesetsResident = WatchForChanges;
+	smint_context* Context = SmintCreateContext(&Settings);
+	if (!Context)
 	{
-		rapidjson::Value& TilesetObj = TilesetsArray[TilesetIndex];
-		if (!TilesetObj.IsObject() || !TilesetObj.HasMember("firstgid") || !TilesetObj["firstgid"].IsUint() || 
-			!TilesetObj.HasMember("source") || !TilesetObj["source"].IsString())
-		{
-			fprintf(stderr, "ERROR: Invalid format of tileset %u in map file.\n", TilesetIndex);
-			return 1;
-		}
-		u32 FirstTileId = TilesetObj["firstgid"].GetUint();
-		const char* TilesetPath = TilesetObj["source"].GetString();
+		return 1;
+	}
+	b32 Result;
+	for (;;)
+	{
+		f64 StartSeconds = GetWallSeconds();
 
-		u64 TilesetStringSize = 0;
-		rapidjson::Document TilesetJson;
-		if (!ParseTilesetJson(TilesetPath, TilesetStringSize, TilesetJson))
+		// Directories are listed again every run, so with --watch new maps are picked up on the next change
+		Result = true;
+		for (u32 ArgIndex = 0; ArgIndex < NumMapArgs && Result; ArgIndex++)
 		{
-			return 1;
+			Result = IsDirectory(MapArgs[ArgIndex]) ? SmintAddMapDirectory(Context, nullptr, MapArgs[ArgIndex])
+			                                        : SmintAddMap(Context, nullptr, MapArgs[ArgIndex]);
 		}
-		u32 NumTiles = TilesetJson["tilecount"].GetUint();
-
-		b8* TilesInUse = nullptr;
-		if (ShouldRemoveUnusedTiles)
+		Result = Result && SmintMinimise(Context) && SmintWriteMaps(Context);
+		if (Result && (PrintStats || StatsJsonPath))
 		{
-			// Build a list of all tiles that are in use *somewhere* in the map - if we later process a tile that's unused, we can safely drop it
-			TilesInUse = (b8*)calloc(NumTiles, sizeof(b8));
-			for (u32 LayerIndex = 0; LayerIndex < Layers.Size(); LayerIndex++)
-			{
-				rapidjson::Value& Layer = Layers[LayerIndex];
-				if (!Layer.IsObject() || !Layer.HasMember("data") || !Layer["data"].IsArray())
-				{
-					fprintf(stderr, "ERROR: Invalid map format - layer %u has unexpected format and/or is missing 'data' array.\n", LayerIndex);
-					return 1;
-				}
-
-				rapidjson::Value& LayerData = Layer["data"];
-				for (u32 DataIndex = 0; DataIndex < LayerData.Size(); DataIndex++)
-				{
-					u32 TileIndex = LayerData[DataIndex].GetUint();
-					if (TileIndex == 0)
-					{
-						continue; // Blank tile
-					}
-					TileIndex -= FirstTileId;
-					TileIndex &= ~(TiledFlag_HFlip | TiledFlag_VFlip | TiledFlag_DiagonalFlip | TiledFlag_Rotated);
-					if (TileIndex <= NumTiles)
-					{
-						TilesInUse[TileIndex] = true;
-					}
-				}
-			}
+			Result = SmintReportStats(Context, PrintStats, StatsJsonPath);
 		}
+		SmintClearMaps(Context);
 
-		char NewTilesetPath[MAX_PATH];
-		minimised_tileset MinTiles = MinimiseTileset(TilesetPath, TilesetJson, TilesetStringSize, NewTilesetPath, MapWorkingDir, TilesInUse);
-		if (MinTiles.Error)
+		// With --watch, failures are reported but don't stop it, since the next save will probably fix them
+		if (!WatchForChanges)
 		{
-			return 1;
+			break;
 		}
-		else if (MinTiles.IsUnchanged)
+		printf("Finished in %.0f ms; watching for changes (Ctrl+C to stop)...\n\n", (GetWallSeconds() - StartSeconds) * 1000.0);
+		fflush(stdout);
+		if (!SmintWaitForChanges(Context))
 		{
-			continue;
-		}
-		EverythingAlreadyMinimised = false;
-
-		TilesetObj["source"].SetString(NewTilesetPath, strlen(NewTilesetPath), JsonDoc.GetAllocator());
-
-		for (u32 LayerIndex = 0; LayerIndex < Layers.Size(); LayerIndex++)
-		{
-			rapidjson::Value& Layer = Layers[LayerIndex];
-			if (!Layer.IsObject() || !Layer.HasMember("data") || !Layer["data"].IsArray())
-			{
-				fprintf(stderr, "ERROR: Invalid map format - layer %u has unexpected format and/or is missing 'data' array.\n", LayerIndex);
-				return 1;
-			}
-
-			rapidjson::Value& LayerData = Layer["data"];
-			for (u32 DataIndex = 0; DataIndex < LayerData.Size(); DataIndex++)
-			{
-				u32 TileIndex = LayerData[DataIndex].GetUint();
-				if (TileIndex == 0)
-				{
-					continue; // Blank tile
-				}
-
-				u32 FlipFlags = 0;
-				if (TileIndex & TiledFlag_HFlip)
-				{
-					FlipFlags |= TiledFlag_HFlip;
-					TileIndex &= ~TiledFlag_HFlip;
-				}
-				if (TileIndex & TiledFlag_VFlip)
-				{
-					FlipFlags |= TiledFlag_VFlip;
-					TileIndex &= ~TiledFlag_VFlip;
-				}
-				if (TileIndex & TiledFlag_DiagonalFlip)
-				{
-					// tbh I don't actually know how to diagonally flip a tile in Tiled, but if we ever encounter one, let's treat it like HFLIP+VFLIP
-					FlipFlags |= (TiledFlag_HFlip | TiledFlag_VFlip);
-					TileIndex &= ~TiledFlag_DiagonalFlip;
-				}
-				if (TileIndex & TiledFlag_Rotated)
-				{
-					printf("WARNING: (Layer %u, entry %u) Tile rotation is not supported for GBA - this entry will be unchanged in the output map.\n",
-					       LayerIndex, DataIndex);
-					TileIndex &= ~TiledFlag_Rotated;
-				}
-				TileIndex -= FirstTileId;
-				if (TileIndex >= NumTiles)
-				{
-					// This tile belongs to another tileset; we'll get it later
-					continue;
-				}
-
-				if (ShouldRemoveUnusedTiles)
-				{
-					Assert(TilesInUse[TileIndex]);
-				}
-
-				tile* SourceTile = MinTiles.OriginalImage.Tiles + TileIndex;
-				unique_tile* UniqueTile = SourceTile->EquivalentUniqueTile;
-				Assert(UniqueTile);
-
-				u32 NewTileIndex = UniqueTile - MinTiles.MinimisedTiles;
-				Assert(NewTileIndex < MinTiles.NumUniqueTiles);
-
-				NewTileIndex += FirstTileId;
-
-				// The output entry's flip is `OldFlip` XOR `NewFlip`
-				switch (SourceTile->EqualAfterTransform)
-				{
-					case TileTransform_HFlip:
-					{
-						FlipFlags ^= TiledFlag_HFlip;
-					} break;
-					case TileTransform_VFlip:
-					{
-						FlipFlags ^= TiledFlag_VFlip;
-					} break;
-					case TileTransform_DiagonalFlip:
-					{
-						FlipFlags ^= (TiledFlag_HFlip | TiledFlag_VFlip);
-					} break;
-				}
-				NewTileIndex |= FlipFlags;
-
-				LayerData[DataIndex].SetUint(NewTileIndex);
-			}
+			break;
 		}
 	}
 
-	char MapOutPath[MAX_PATH];
-	AppendToFilePath(MapFilePath, "_min", MapOutPath);
-
-	char MapInBaseName[MAX_PATH];
-	ExtractBaseFileName(MapFilePath, MapInBaseName);
+	SmintDestroyContext(Context);
+	TrackedFree(MapArgs);
+	return Result ? 0 : 1;
+}
 
-	char MapOutBaseName[MAX_PATH];
-	ExtractBaseFileName(MapOutPath, MapOutBaseName);
-
-	if (EverythingAlreadyMinimised)
-	{
-		printf("Every tileset in map file '%s' is already minimal; no changes have been made.\n", MapInBaseName);
-	}
-	else if (!WriteJsonToFile(&JsonDoc, MapOutPath, MapFileContents.Size))
-	{
-		return 1;
-	}
-	else
-	{
-		printf("Map '%s' successfully minimised to '%s'.\n", MapInBaseName, MapOutBaseName);
-	}
-
-	return 0;
-}
\ No newline at end of file
+#ifndef SMINT_NO_MAIN
+int main(int ArgC, char** ArgV)
+{
+	return RunSmint(ArgC, ArgV);
+}
+#endif
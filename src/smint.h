@@ -42,6 +42,11 @@ struct unique_tile;
 struct tile
 {
 	pixel Pixels[8 * 8];
+};
+
+// Where a tile of the source image ended up in the minimised tileset
+struct tile_mapping
+{
 	unique_tile* EquivalentUniqueTile;
 	tile_transform_type EqualAfterTransform; // which transform you need to apply to make this tile equal to the above
 };
@@ -53,16 +58,42 @@ pixel* PixelAt(tile* Tile, u32 X, u32 Y)
 	return Result;
 }
 
+// Only the canonical (lexicographically smallest) flip of each unique tile is stored, so duplicates under any flip
+// canonicalise to the same thing and can be found with a single compare
 struct unique_tile
 {
-	tile Variants[TileTransform_Count];
+	tile Canonical;
+	tile_transform_type CanonicalTransform; // Transform taking the first tile seen to Canonical (and, being a flip, back again)
+	u32 SymmetryMask; // Bit N is set if transform N leaves the tile unchanged
+};
+
+// Result of canonicalising a source tile, worked out for every tile (possibly on several threads) before dedup
+struct tile_key
+{
+	u32 Hash; // Hash of the canonical form
+	tile_transform_type CanonicalTransform;
+	u32 SymmetryMask;
+};
+
+struct tile_hash_entry
+{
+	u32 Hash;
+	u32 UniqueTileIndex; // 0 means empty slot, otherwise index + 1
+};
+
+// Open-addressing (linear probing) table of the canonical form of every unique tile found so far
+struct tile_hash_table
+{
+	tile_hash_entry* Entries;
+	u32 Capacity; // Always a power of 2
+	u32 NumEntries;
 };
 
 struct tileset_image
 {
 	u32 TileWidth;
 	u32 TileHeight;
-	tile* Tiles;
+	tile* Tiles; // Tile-major, i.e. each tile's 64 pixels are contiguous
 };
 
 tile* TileAt(tileset_image* Image, u32 X, u32 Y)
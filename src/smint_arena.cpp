@@ -0,0 +1,192 @@
+// Linear arenas for everything whose lifetime is one tileset, one map or one run. Pushing is just bumping an offset, and
+// nothing is freed individually: a temporary memory scope gives back everything pushed since it began, and clearing an
+// arena gives back the lot, in both cases by dropping whole blocks. Each worker thread has a scratch arena that every
+// tileset it processes is run in, so whatever a tileset needed along the way is gone the moment it's done with.
+//
+// Blocks come from TrackedMalloc, so arenas show up in the stats like everything else. An arena must only be used by
+// one thread at a time.
+
+#define ARENA_MIN_BLOCK_SIZE (64 * 1024)
+
+// Keeps the pushes that follow it 16-byte aligned
+struct arena_block
+{
+	arena_block* Previous;
+	u64 Size; // Not counting this header
+	u64 Used;
+	u64 Padding;
+};
+
+struct memory_arena
+{
+	arena_block* CurrentBlock;
+	u32 TempCount;
+};
+
+struct temp_memory
+{
+	memory_arena* Arena;
+	arena_block* Block;
+	u64 Used;
+};
+
+u8* GetBlockBase(arena_block* Block)
+{
+	u8* Result = (u8*)(Block + 1);
+	return Result;
+}
+
+void FreeLastBlock(memory_arena* Arena)
+{
+	arena_block* Block = Arena->CurrentBlock;
+	Arena->CurrentBlock = Block->Previous;
+	TrackArenaBytes(-(s64)Block->Size);
+	TrackedFree(Block);
+}
+
+// Every push is 16-byte aligned; anything too big for the current block gets a block of its own
+void* PushSize(memory_arena* Arena, u64 Size)
+{
+	arena_block* Block = Arena->CurrentBlock;
+	u64 Offset = Block ? (Block->Used + 15) & ~(u64)15 : 0;
+	if (!Block || Offset + Size > Block->Size)
+	{
+		u64 BlockSize = Size > ARENA_MIN_BLOCK_SIZE ? Size : ARENA_MIN_BLOCK_SIZE;
+		Block = (arena_block*)TrackedMalloc(sizeof(arena_block) + BlockSize);
+		Assert(Block);
+		Block->Previous = Arena->CurrentBlock;
+		Block->Size = BlockSize;
+		Block->Used = 0;
+		Arena->CurrentBlock = Block;
+		TrackArenaBytes((s64)BlockSize);
+		Offset = 0;
+	}
+
+	void* Result = GetBlockBase(Block) + Offset;
+	Block->Used = Offset + Size;
+	return Result;
+}
+
+void* PushSizeZero(memory_arena* Arena, u64 Size)
+{
+	void* Result = PushSize(Arena, Size);
+	memset(Result, 0, Size);
+	return Result;
+}
+
+#define PushStruct(Arena, type) (type*)PushSize(Arena, sizeof(type))
+#define PushArray(Arena, Count, type) (type*)PushSize(Arena, sizeof(type) * (u64)(Count))
+#define PushArrayZero(Arena, Count, type) (type*)PushSizeZero(Arena, sizeof(type) * (u64)(Count))
+
+void* PushCopy(memory_arena* Arena, const void* Source, u64 Size)
+{
+	void* Result = PushSize(Arena, Size);
+	memcpy(Result, Source, Size);
+	return Result;
+}
+
+// Grows the most recent push in place if there's room for it in its block
+b32 TryExtendLastPush(memory_arena* Arena, void* Base, u64 OldSize, u64 NewSize)
+{
+	arena_block* Block = Arena->CurrentBlock;
+	b32 Result = Block && (u8*)Base + OldSize == GetBlockBase(Block) + Block->Used &&
+	             (u64)((u8*)Base - GetBlockBase(Block)) + NewSize <= Block->Size;
+	if (Result)
+	{
+		Block->Used = (u64)((u8*)Base - GetBlockBase(Block)) + NewSize;
+	}
+	return Result;
+}
+
+temp_memory BeginTemporaryMemory(memory_arena* Arena)
+{
+	temp_memory Result;
+	Result.Arena = Arena;
+	Result.Block = Arena->CurrentBlock;
+	Result.Used = Arena->CurrentBlock ? Arena->CurrentBlock->Used : 0;
+	Arena->TempCount++;
+	return Result;
+}
+
+// Gives back everything pushed since the matching BeginTemporaryMemory; scopes must be ended in reverse order
+void EndTemporaryMemory(temp_memory Temp)
+{
+	memory_arena* Arena = Temp.Arena;
+	while (Arena->CurrentBlock != Temp.Block)
+	{
+		FreeLastBlock(Arena);
+	}
+	if (Arena->CurrentBlock)
+	{
+		Assert(Arena->CurrentBlock->Used >= Temp.Used);
+		Arena->CurrentBlock->Used = Temp.Used;
+	}
+	Assert(Arena->TempCount > 0);
+	Arena->TempCount--;
+}
+
+// Ends the scope but keeps what was pushed in it
+void KeepTemporaryMemory(temp_memory Temp)
+{
+	Assert(Temp.Arena->TempCount > 0);
+	Temp.Arena->TempCount--;
+}
+
+void ClearArena(memory_arena* Arena)
+{
+	Assert(Arena->TempCount == 0);
+	while (Arena->CurrentBlock)
+	{
+		FreeLastBlock(Arena);
+	}
+}
+
+// Lets rapidjson documents allocate from an arena. Nothing is freed on its own, and growing the last thing allocated
+// (e.g. an object being added to) happens in place where possible.
+struct arena_json_allocator
+{
+	static const bool kNeedFree = false;
+	memory_arena* Arena;
+
+	arena_json_allocator(memory_arena* Arena = nullptr) : Arena(Arena) {}
+
+	void* Malloc(size_t Size)
+	{
+		Assert(Arena);
+		void* Result = Size ? PushSize(Arena, Size) : nullptr;
+		return Result;
+	}
+
+	void* Realloc(void* OriginalPtr, size_t OriginalSize, size_t NewSize)
+	{
+		if (!OriginalPtr)
+		{
+			return Malloc(NewSize);
+		}
+		if (NewSize <= OriginalSize || TryExtendLastPush(Arena, OriginalPtr, OriginalSize, NewSize))
+		{
+			return NewSize ? OriginalPtr : nullptr;
+		}
+		void* Result = PushSize(Arena, NewSize);
+		memcpy(Result, OriginalPtr, OriginalSize);
+		return Result;
+	}
+
+	static void Free(void*) {}
+};
+
+typedef rapidjson::GenericDocument<rapidjson::UTF8<>, arena_json_allocator> json_document;
+typedef json_document::ValueType json_value;
+
+// rapidjson's parse stack lives on the heap while parsing and is always freed once it's done, so documents made by
+// PushJsonDocument never need destroying; they go with the arena (or temporary memory) they were pushed in
+static rapidjson::CrtAllocator JsonStackAllocator;
+#define JSON_STACK_CAPACITY 1024 // Same as rapidjson's default
+
+json_document* PushJsonDocument(memory_arena* Arena)
+{
+	arena_json_allocator* Allocator = new (PushStruct(Arena, arena_json_allocator)) arena_json_allocator(Arena);
+	json_document* Result = new (PushStruct(Arena, json_document))
+		json_document(Allocator, JSON_STACK_CAPACITY, &JsonStackAllocator);
+	return Result;
+}
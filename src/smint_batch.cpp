@@ -0,0 +1,492 @@
+// Everything smint does to a single map, split into the parts before and after its tilesets are minimised. Any number
+// of maps can be run together: each distinct tileset is loaded and minimised once, against the union of the tiles all
+// the maps use, and then every map is rewritten against the shared result. A single map is just a batch of one.
+
+struct map_job
+{
+	char FilePath[MAX_PATH];
+	char Dir[MAX_PATH];
+	char BaseName[MAX_PATH];
+
+	// Only for the DOM path; kept (on Arena) until the map is written back out
+	memory_arena Arena;
+	str_buffer FileContents;
+	json_document* JsonDoc;
+	json_value* Layers;
+	json_value* TilesetsArray;
+
+	layer_compression* LayerCompressions; // Only for --stream
+	watched_map* Watched; // Only if tilesets are kept resident
+
+	map_tileset_ref* Tilesets;
+	u32 NumTilesets;
+	tile_index_set GidsInUse; // Only with -rut
+
+	stage_stats Stats[Stage_Count];
+};
+
+void FreeMapJob(map_job* Map)
+{
+	if (!Map->TilesetsArray)
+	{
+		// Streamed maps own copies of their tileset sources, rather than pointing into the DOM
+		for (u32 TilesetIndex = 0; TilesetIndex < Map->NumTilesets; TilesetIndex++)
+		{
+			TrackedFree((void*)Map->Tilesets[TilesetIndex].Source);
+		}
+	}
+	TrackedFree(Map->Tilesets);
+	FreeTileIndexSet(&Map->GidsInUse);
+	TrackedFree(Map->LayerCompressions);
+	ClearArena(&Map->Arena);
+}
+
+void FreeTilesetJob(tileset_job* Job)
+{
+	// A failed resident tileset's partial result is left on its arena until it's next minimised
+	ClearArena(&Job->Arena);
+	FreeTileIndexSet(&Job->UsedTiles);
+	FreeTileUsage(&Job->Usage);
+	TrackedFree(Job->Log.Data);
+}
+
+// Parses and validates the map, finding its tilesets and (if requested) which GIDs it uses
+b32 LoadMap(map_job* Map, b32 UseStreaming, b32 CollectGidsInUse)
+{
+	char MapFileExtension[16];
+	GetFileExtension(Map->FilePath, MapFileExtension);
+	if (strcmp(MapFileExtension, ".tmj") != 0 && strcmp(MapFileExtension, ".json") != 0)
+	{
+		LogError("ERROR: Unsupported map file format '%s'; please supply a .tmj/.json file.\n", MapFileExtension);
+		return false;
+	}
+	StripFileName(Map->FilePath, Map->Dir);
+	ExtractBaseFileName(Map->FilePath, Map->BaseName);
+
+	if (UseStreaming)
+	{
+		return ScanMapStreaming(Map->FilePath, CollectGidsInUse, &Map->Tilesets, &Map->NumTilesets, &Map->GidsInUse,
+		                        &Map->LayerCompressions);
+	}
+
+	Map->FileContents = ReadTextFile(Map->FilePath, &Map->Arena);
+	if (!Map->FileContents.Data)
+	{
+		return false;
+	}
+
+	Map->JsonDoc = PushJsonDocument(&Map->Arena);
+	json_document& JsonDoc = *Map->JsonDoc;
+	if (JsonDoc.ParseInsitu(Map->FileContents.Data).HasParseError())
+	{
+		LogError("ERROR: Failed to parse map '%s': %s\n", Map->FilePath, rapidjson::GetParseError_En(JsonDoc.GetParseError()));
+		return false;
+	}
+
+	if (!JsonDoc.HasMember("layers") || !JsonDoc["layers"].IsArray())
+	{
+		LogError("ERROR: Invalid map format - 'layers' element not found or invalid format.\n");
+		return false;
+	}
+	Map->Layers = &JsonDoc["layers"];
+
+	if (!JsonDoc.HasMember("tilesets") || !JsonDoc["tilesets"].IsArray())
+	{
+		LogError("ERROR: Invalid map format - 'tilesets' not found or invalid format.\n");
+		return false;
+	}
+	Map->TilesetsArray = &JsonDoc["tilesets"];
+
+	if (Map->TilesetsArray->Size() == 0)
+	{
+		LogError("ERROR: 'tilesets' array in map file is empty.\n");
+		return false;
+	}
+
+	for (u32 LayerIndex = 0; LayerIndex < Map->Layers->Size(); LayerIndex++)
+	{
+		if (!ValidateLayer((*Map->Layers)[LayerIndex], LayerIndex))
+		{
+			return false;
+		}
+	}
+
+	Map->NumTilesets = Map->TilesetsArray->Size();
+	Map->Tilesets = (map_tileset_ref*)TrackedCalloc(Map->NumTilesets, sizeof(map_tileset_ref));
+	for (u32 TilesetIndex = 0; TilesetIndex < Map->NumTilesets; TilesetIndex++)
+	{
+		json_value& TilesetObj = (*Map->TilesetsArray)[TilesetIndex];
+		if (!TilesetObj.IsObject() || !TilesetObj.HasMember("firstgid") || !TilesetObj["firstgid"].IsUint() ||
+			!TilesetObj.HasMember("source") || !TilesetObj["source"].IsString())
+		{
+			LogError("ERROR: Invalid format of tileset %u in map file.\n", TilesetIndex);
+			return false;
+		}
+		Map->Tilesets[TilesetIndex].FirstTileId = TilesetObj["firstgid"].GetUint();
+		Map->Tilesets[TilesetIndex].Source = TilesetObj["source"].GetString();
+	}
+
+	if (CollectGidsInUse && !MarkGidsInUse(*Map->Layers, &Map->GidsInUse))
+	{
+		return false;
+	}
+	return true;
+}
+
+// Gives every distinct tileset across all the maps one job (in order of first appearance), and points each map's
+// tileset refs at them. With -rut, each job also gets the union of the tiles used by every map that references it.
+tileset_job* CreateTilesetJobs(map_job** Maps, u32 NumMaps, b32 RemoveUnusedTiles, u32* OutNumJobs)
+{
+	u32 MaxJobs = 0;
+	for (u32 MapIndex = 0; MapIndex < NumMaps; MapIndex++)
+	{
+		MaxJobs += Maps[MapIndex]->NumTilesets;
+	}
+
+	// Tilesets are identified by their resolved path, since each map can refer to the same one differently
+	char (*FullPaths)[MAX_PATH] = (char (*)[MAX_PATH])TrackedMalloc(sizeof(*FullPaths) * MaxJobs);
+	tileset_job* Jobs = new tileset_job[MaxJobs]();
+	u32 NumJobs = 0;
+	for (u32 MapIndex = 0; MapIndex < NumMaps; MapIndex++)
+	{
+		map_job* Map = Maps[MapIndex];
+		for (u32 TilesetIndex = 0; TilesetIndex < Map->NumTilesets; TilesetIndex++)
+		{
+			map_tileset_ref* Tileset = Map->Tilesets + TilesetIndex;
+			char JoinedPath[MAX_PATH];
+			char FullPath[MAX_PATH];
+			JoinPath(Map->Dir, Tileset->Source, JoinedPath);
+			TryGetFullPath(JoinedPath, FullPath);
+
+			u32 JobIndex = 0;
+			while (JobIndex < NumJobs && strcmp(FullPaths[JobIndex], FullPath) != 0)
+			{
+				JobIndex++;
+			}
+			if (JobIndex == NumJobs)
+			{
+				strcpy(FullPaths[NumJobs], FullPath);
+				Jobs[NumJobs].TilesetPath = Tileset->Source;
+				Jobs[NumJobs].BaseDir = Map->Dir;
+				NumJobs++;
+			}
+			Tileset->JobIndex = JobIndex;
+
+			if (!RemoveUnusedTiles)
+			{
+				continue;
+			}
+
+			// This tileset's GIDs run up to wherever the next one (by firstgid) starts
+			u32 EndGid = 0xFFFFFFFF;
+			for (u32 OtherIndex = 0; OtherIndex < Map->NumTilesets; OtherIndex++)
+			{
+				u32 OtherFirstGid = Map->Tilesets[OtherIndex].FirstTileId;
+				if (OtherFirstGid > Tileset->FirstTileId && OtherFirstGid < EndGid)
+				{
+					EndGid = OtherFirstGid;
+				}
+			}
+
+			tileset_job* Job = Jobs + JobIndex;
+			tile_index_set* GidsInUse = &Map->GidsInUse;
+			for (u32 Slot = 0; Slot < GidsInUse->Capacity; Slot++)
+			{
+				u32 Gid = GidsInUse->Keys[Slot] - 1;
+				if (GidsInUse->Keys[Slot] && Gid >= Tileset->FirstTileId && Gid < EndGid)
+				{
+					AddToTileIndexSet(&Job->UsedTiles, Gid - Tileset->FirstTileId);
+				}
+			}
+		}
+	}
+	TrackedFree(FullPaths);
+
+	*OutNumJobs = NumJobs;
+	return Jobs;
+}
+
+// With -rut or --tile-order, tilesets that share an image can each minimise it differently, but they'd all write the
+// result to the same '_min' image next to it (at the same time, with --jobs). Returns false, having said which tilesets
+// clash, if any would. Tilesets that can't be read are left for their jobs to report.
+b32 CheckMinimisedImagesAreDistinct(tileset_job* Jobs, u32 NumJobs)
+{
+	memory_arena Arena = {};
+	char (*ImageOutPaths)[MAX_PATH] = (char (*)[MAX_PATH])PushSizeZero(&Arena, sizeof(*ImageOutPaths) * NumJobs);
+	b32 Result = true;
+	for (u32 JobIndex = 0; JobIndex < NumJobs && Result; JobIndex++)
+	{
+		tileset_job* Job = Jobs + JobIndex;
+		char TilesetFullPath[MAX_PATH];
+		JoinPath(Job->BaseDir, Job->TilesetPath, TilesetFullPath);
+		str_buffer TilesetText = ReadBinaryFile(TilesetFullPath);
+		if (!TilesetText.Data)
+		{
+			continue;
+		}
+
+		json_document* JsonDoc = PushJsonDocument(&Arena);
+		JsonDoc->Parse(TilesetText.Data, TilesetText.Size);
+		if (!JsonDoc->HasParseError() && JsonDoc->IsObject() && JsonDoc->HasMember("image") && (*JsonDoc)["image"].IsString())
+		{
+			// The output's directory is resolved, since each tileset can refer to the same image differently
+			tileset_paths Paths;
+			GetTilesetPaths(Job->BaseDir, Job->TilesetPath, (*JsonDoc)["image"].GetString(), &Paths);
+			char Dir[MAX_PATH];
+			char FullDir[MAX_PATH];
+			char FileName[MAX_PATH];
+			StripFileName(Paths.ImageOutFullPath, Dir);
+			TryGetFullPath(*Dir ? Dir : ".", FullDir);
+			ExtractBaseFileName(Paths.ImageOutFullPath, FileName);
+			JoinPath(FullDir, FileName, ImageOutPaths[JobIndex]);
+
+			for (u32 OtherIndex = 0; OtherIndex < JobIndex && Result; OtherIndex++)
+			{
+				if (strcmp(ImageOutPaths[OtherIndex], ImageOutPaths[JobIndex]) == 0)
+				{
+					LogError("ERROR: Tilesets '%s' and '%s' would both write their minimised image to '%s'; with -rut or "
+					         "--tile-order, each needs an image of its own.\n", Jobs[OtherIndex].TilesetPath, Job->TilesetPath,
+					         Paths.ImageOutPath);
+					Result = false;
+				}
+			}
+		}
+		TrackedFree(TilesetText.Data);
+	}
+	ClearArena(&Arena);
+	return Result;
+}
+
+// The tileset ref a GID belongs to (the one with the highest firstgid not above it), or nullptr for the blank tile
+map_tileset_ref* FindGidTileset(map_job* Map, u32 Gid)
+{
+	map_tileset_ref* Result = nullptr;
+	for (u32 TilesetIndex = 0; TilesetIndex < Map->NumTilesets && Gid; TilesetIndex++)
+	{
+		map_tileset_ref* Tileset = Map->Tilesets + TilesetIndex;
+		if (Tileset->FirstTileId <= Gid && (!Result || Tileset->FirstTileId > Result->FirstTileId))
+		{
+			Result = Tileset;
+		}
+	}
+	return Result;
+}
+
+// For a tile order other than the default: counts, for every job, how often each of its tiles is used across all the
+// maps and how often each pair of them are next to each other (horizontally or vertically, in the same layer)
+void CountTileUsage(map_job** Maps, u32 NumMaps, tileset_job* Jobs)
+{
+	for (u32 MapIndex = 0; MapIndex < NumMaps; MapIndex++)
+	{
+		map_job* Map = Maps[MapIndex];
+		json_document& JsonDoc = *Map->JsonDoc;
+		u32 MapWidth = (JsonDoc.HasMember("width") && JsonDoc["width"].IsUint()) ? JsonDoc["width"].GetUint() : 0;
+		for (u32 LayerIndex = 0; LayerIndex < Map->Layers->Size(); LayerIndex++)
+		{
+			json_value& Layer = (*Map->Layers)[LayerIndex];
+			json_value& LayerData = Layer["data"];
+			u32 Count;
+			u32* Entries;
+			if (LayerData.IsString())
+			{
+				// Already validated when the map was loaded
+				Entries = DecodeLayer(Layer, &Count);
+			}
+			else
+			{
+				Count = LayerData.Size();
+				Entries = (u32*)TrackedMalloc(sizeof(u32) * (Count ? Count : 1));
+				for (u32 DataIndex = 0; DataIndex < Count; DataIndex++)
+				{
+					Entries[DataIndex] = LayerData[DataIndex].IsUint() ? LayerData[DataIndex].GetUint() : 0;
+				}
+			}
+			if (!Entries)
+			{
+				continue;
+			}
+
+			// Without a width, tiles can still be counted, just not paired up
+			u32 Width = (Layer.HasMember("width") && Layer["width"].IsUint()) ? Layer["width"].GetUint() : MapWidth;
+			for (u32 DataIndex = 0; DataIndex < Count; DataIndex++)
+			{
+				u32 Gid = Entries[DataIndex] & ~TILED_FLAGS_MASK;
+				map_tileset_ref* Tileset = FindGidTileset(Map, Gid);
+				if (!Tileset)
+				{
+					continue;
+				}
+				tile_usage* Usage = &Jobs[Tileset->JobIndex].Usage;
+				u32 TileIndex = Gid - Tileset->FirstTileId;
+				AddTileUse(Usage, TileIndex);
+
+				// Each pair is counted from its left/top tile
+				u32 NeighbourIndices[2] = {DataIndex + 1, DataIndex + Width};
+				b32 HasNeighbours[2] = {Width && (DataIndex + 1) % Width != 0, Width && DataIndex + Width < Count};
+				for (u32 Neighbour = 0; Neighbour < 2; Neighbour++)
+				{
+					if (!HasNeighbours[Neighbour])
+					{
+						continue;
+					}
+					u32 NeighbourGid = Entries[NeighbourIndices[Neighbour]] & ~TILED_FLAGS_MASK;
+					if (NeighbourGid != Gid && FindGidTileset(Map, NeighbourGid) == Tileset)
+					{
+						AddTilePair(Usage, GetTilePairKey(TileIndex, NeighbourGid - Tileset->FirstTileId), 1);
+					}
+				}
+			}
+			TrackedFree(Entries);
+		}
+	}
+}
+
+// Points the map at its minimised tilesets (or just the merged tileset, if there is one) and remaps its layers. Returns
+// false on error; a map whose tilesets were all already minimal isn't written at all, unless they've been merged.
+b32 WriteMinimisedMap(map_job* Map, tileset_job* Jobs, b32 UseStreaming, merged_tileset* Merged = nullptr)
+{
+	b32 EverythingAlreadyMinimised = true;
+	char (*NewSources)[MAX_PATH] = (char (*)[MAX_PATH])TrackedMalloc(sizeof(*NewSources) * Map->NumTilesets);
+	const char** NewTilesetSources = (const char**)TrackedCalloc(Map->NumTilesets, sizeof(const char*));
+	if (Merged && Map->TilesetsArray && Map->NumTilesets)
+	{
+		// The merged tileset takes the place of the first tileset, and the rest go
+		EverythingAlreadyMinimised = false;
+		GetRelativePath(Map->Dir, Merged->FullPath, NewSources[0]);
+		json_value& Tilesets = *Map->TilesetsArray;
+		Tilesets[0]["source"].SetString(NewSources[0], strlen(NewSources[0]), Map->JsonDoc->GetAllocator());
+		Tilesets[0]["firstgid"].SetUint(1);
+		Tilesets.Erase(Tilesets.Begin() + 1, Tilesets.End());
+	}
+	for (u32 TilesetIndex = 0; TilesetIndex < Map->NumTilesets && !Merged; TilesetIndex++)
+	{
+		map_tileset_ref* Tileset = Map->Tilesets + TilesetIndex;
+		if (Jobs[Tileset->JobIndex].MinTiles.IsUnchanged)
+		{
+			continue;
+		}
+		EverythingAlreadyMinimised = false;
+
+		// Same file as the job's NewTilesetPath, but relative to this map
+		AppendToFilePath(Tileset->Source, "_min", NewSources[TilesetIndex]);
+		NewTilesetSources[TilesetIndex] = NewSources[TilesetIndex];
+
+		if (Map->TilesetsArray)
+		{
+			json_value& TilesetObj = (*Map->TilesetsArray)[TilesetIndex];
+			TilesetObj["source"].SetString(NewSources[TilesetIndex], strlen(NewSources[TilesetIndex]), Map->JsonDoc->GetAllocator());
+		}
+	}
+
+	char MapOutPath[MAX_PATH];
+	AppendToFilePath(Map->FilePath, "_min", MapOutPath);
+
+	char MapOutBaseName[MAX_PATH];
+	ExtractBaseFileName(MapOutPath, MapOutBaseName);
+
+	b32 Result = true;
+	if (EverythingAlreadyMinimised)
+	{
+		LogInfo("Every tileset in map file '%s' is already minimal; no changes have been made.\n", Map->BaseName);
+	}
+	else
+	{
+		// Every tileset's remapping is applied in a single pass over the layers
+		stage_timer RemapTimer = BeginStage(Stage_RemapLayers);
+		u32 NumRemapGids;
+		u32* GidRemapTable = Merged ? BuildMergedGidRemapTable(Jobs, Map->Tilesets, Map->NumTilesets, Merged, &NumRemapGids) :
+		                              BuildGidRemapTable(Jobs, Map->Tilesets, Map->NumTilesets, &NumRemapGids);
+		if (UseStreaming)
+		{
+			// Layers are remapped as they're copied to the output, so the whole rewrite counts as writing the map
+			EndStage(&RemapTimer);
+			stage_timer WriteMapTimer = BeginStage(Stage_WriteMap);
+			Result = RewriteMapStreaming(Map->FilePath, MapOutPath, NewTilesetSources, GidRemapTable, NumRemapGids,
+			                             Map->LayerCompressions);
+			EndStage(&WriteMapTimer);
+		}
+		else
+		{
+			Result = RemapLayers(*Map->Layers, GidRemapTable, NumRemapGids, Map->JsonDoc->GetAllocator());
+			EndStage(&RemapTimer);
+
+			stage_timer WriteMapTimer = BeginStage(Stage_WriteMap);
+			Result = Result && WriteJsonToFile(Map->JsonDoc, MapOutPath, Map->FileContents.Size);
+			EndStage(&WriteMapTimer);
+		}
+		TrackedFree(GidRemapTable);
+
+		if (Result)
+		{
+			LogInfo("Map '%s' successfully minimised to '%s'.\n", Map->BaseName, MapOutBaseName);
+		}
+	}
+
+	TrackedFree(NewTilesetSources);
+	TrackedFree(NewSources);
+	return Result;
+}
+
+// One row per map (for the stages run on the main thread), then one per tileset
+b32 ReportStats(map_job** Maps, u32 NumMaps, tileset_job* Jobs, u32 NumJobs, f64 StartWallSeconds, b32 PrintTable,
+                const char* JsonPath)
+{
+	f64 TotalWallSeconds = GetWallSeconds() - StartWallSeconds;
+
+	u32 NumRows = NumMaps + NumJobs;
+	stats_row* Rows = (stats_row*)TrackedMalloc(sizeof(stats_row) * NumRows);
+	for (u32 MapIndex = 0; MapIndex < NumMaps; MapIndex++)
+	{
+		Rows[MapIndex].Name = Maps[MapIndex]->BaseName;
+		Rows[MapIndex].Stages = Maps[MapIndex]->Stats;
+	}
+	for (u32 JobIndex = 0; JobIndex < NumJobs; JobIndex++)
+	{
+		Rows[NumMaps + JobIndex].Name = Jobs[JobIndex].TilesetPath;
+		Rows[NumMaps + JobIndex].Stages = Jobs[JobIndex].Stats;
+	}
+
+	b32 Result = true;
+	if (PrintTable)
+	{
+		PrintStatsTable(Rows, NumRows, TotalWallSeconds);
+	}
+	if (JsonPath)
+	{
+		Result = WriteStatsJson(JsonPath, Rows, NumRows, TotalWallSeconds);
+	}
+	TrackedFree(Rows);
+	return Result;
+}
+
+// Minimises every tileset, spreading them over NumThreads threads (the calling thread included)
+void RunTilesetJobsInParallel(tileset_job_queue* Queue, u32 NumThreads)
+{
+	if (Queue->NumJobs == 0)
+	{
+		return;
+	}
+	if (NumThreads == 0)
+	{
+		NumThreads = std::thread::hardware_concurrency();
+	}
+	Queue->ThreadsPerTileset = 1;
+	if (NumThreads > Queue->NumJobs)
+	{
+		Queue->ThreadsPerTileset = NumThreads / Queue->NumJobs;
+		NumThreads = Queue->NumJobs;
+	}
+
+	// Tilesets are independent of each other, so minimise them all up front; this thread works through the queue too
+	std::thread* Workers = new std::thread[NumThreads];
+	for (u32 ThreadIndex = 1; ThreadIndex < NumThreads; ThreadIndex++)
+	{
+		Workers[ThreadIndex] = std::thread(RunTilesetJobs, Queue);
+	}
+	RunTilesetJobs(Queue);
+	for (u32 ThreadIndex = 1; ThreadIndex < NumThreads; ThreadIndex++)
+	{
+		Workers[ThreadIndex].join();
+	}
+	delete[] Workers;
+}
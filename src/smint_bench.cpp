@@ -0,0 +1,481 @@
+// Benchmark: generates synthetic tilesets and maps, then times MinimiseTileset on its own and the full smint pipeline
+// across a matrix of sizes. Everything is seeded, so two builds run against exactly the same inputs, and the results
+// are written as JSON for comparing builds.
+//
+// Usage: smint_bench [--out dir] [--json path] [--repeat N] [--quick]
+
+#define SMINT_NO_MAIN
+#include "smint.cpp"
+
+#include <algorithm>
+
+#if _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+struct bench_rng
+{
+	u64 State;
+};
+
+u32 NextRandom(bench_rng* Rng)
+{
+	// xorshift64*
+	Rng->State ^= Rng->State >> 12;
+	Rng->State ^= Rng->State << 25;
+	Rng->State ^= Rng->State >> 27;
+	u32 Result = (u32)((Rng->State * 0x2545F4914F6CDD1DULL) >> 32);
+	return Result;
+}
+
+f32 NextRandomUnit(bench_rng* Rng)
+{
+	f32 Result = (f32)(NextRandom(Rng) >> 8) / (f32)(1 << 24);
+	return Result;
+}
+
+struct bench_tileset_params
+{
+	u32 TileWidth; // In tiles
+	u32 TileHeight;
+	f32 DuplicateRatio; // Fraction of tiles that are copies of an earlier tile
+	f32 FlipRatio; // Fraction of those copies that are also flipped
+	f32 AlphaNoise; // Fraction of pixels given a random alpha (which dedup should ignore)
+	u32 Seed;
+};
+
+struct bench_map_params
+{
+	u32 Width; // In tiles
+	u32 Height;
+	u32 NumLayers;
+	u32 NumTilesets;
+	f32 FlipRatio; // Fraction of layer entries with H/V flip flags
+	bench_tileset_params Tileset; // Each tileset gets its own seed on top of this
+	u32 Seed;
+};
+
+// Writes Dir/Name.png and Dir/Name.tsj; returns the number of tiles
+u32 GenerateTileset(const char* Dir, const char* Name, bench_tileset_params* Params)
+{
+	bench_rng Rng = {Params->Seed * 0x9E3779B97F4A7C15ULL + 1};
+	u32 NumTiles = Params->TileWidth * Params->TileHeight;
+	tile* Tiles = (tile*)TrackedMalloc(sizeof(tile) * NumTiles);
+
+	// A small palette keeps the images looking like tile art, while 64 random pixels still practically never collide
+	pixel Palette[16];
+	for (u32 ColourIndex = 0; ColourIndex < ArrayCount(Palette); ColourIndex++)
+	{
+		Palette[ColourIndex] = {(u8)NextRandom(&Rng), (u8)NextRandom(&Rng), (u8)NextRandom(&Rng), 255};
+	}
+
+	for (u32 TileIndex = 0; TileIndex < NumTiles; TileIndex++)
+	{
+		tile* Tile = Tiles + TileIndex;
+		if (TileIndex > 0 && NextRandomUnit(&Rng) < Params->DuplicateRatio)
+		{
+			tile* Original = Tiles + NextRandom(&Rng) % TileIndex;
+			tile_transform_type Transform = TileTransform_Unchanged;
+			if (NextRandomUnit(&Rng) < Params->FlipRatio)
+			{
+				Transform = (tile_transform_type)(1 + NextRandom(&Rng) % 3);
+			}
+			CopyTransformedTile(Original, Tile, Transform);
+		}
+		else
+		{
+			for (u32 PixelIndex = 0; PixelIndex < ArrayCount(Tile->Pixels); PixelIndex++)
+			{
+				Tile->Pixels[PixelIndex] = Palette[NextRandom(&Rng) % ArrayCount(Palette)];
+			}
+		}
+	}
+
+	for (u32 TileIndex = 0; TileIndex < NumTiles; TileIndex++)
+	{
+		for (u32 PixelIndex = 0; PixelIndex < 64; PixelIndex++)
+		{
+			if (NextRandomUnit(&Rng) < Params->AlphaNoise)
+			{
+				Tiles[TileIndex].Pixels[PixelIndex].A = (u8)NextRandom(&Rng);
+			}
+		}
+	}
+
+	s32 ImageWidth = (s32)Params->TileWidth * 8;
+	s32 ImageHeight = (s32)Params->TileHeight * 8;
+	pixel* ImagePixels = (pixel*)TrackedMalloc(sizeof(pixel) * ImageWidth * ImageHeight);
+	for (u32 TileIndex = 0; TileIndex < NumTiles; TileIndex++)
+	{
+		u32 TileX = TileIndex % Params->TileWidth;
+		u32 TileY = TileIndex / Params->TileWidth;
+		for (u32 PixelY = 0; PixelY < 8; PixelY++)
+		{
+			for (u32 PixelX = 0; PixelX < 8; PixelX++)
+			{
+				ImagePixels[(TileY * 8 + PixelY) * ImageWidth + TileX * 8 + PixelX] = *PixelAt(Tiles + TileIndex, PixelX, PixelY);
+			}
+		}
+	}
+
+	char FileName[MAX_PATH];
+	char FilePath[MAX_PATH];
+	snprintf(FileName, sizeof(FileName), "%s.png", Name);
+	JoinPath(Dir, FileName, FilePath);
+	stbi_write_png(FilePath, ImageWidth, ImageHeight, 4, ImagePixels, ImageWidth * sizeof(pixel));
+
+	snprintf(FileName, sizeof(FileName), "%s.tsj", Name);
+	JoinPath(Dir, FileName, FilePath);
+	FILE* File = fopen(FilePath, "w");
+	if (File)
+	{
+		fprintf(File, "{\"columns\":%u,\"image\":\"%s.png\",\"imageheight\":%d,\"imagewidth\":%d,\"margin\":0,\"name\":\"%s\","
+		        "\"spacing\":0,\"tilecount\":%u,\"tiledversion\":\"1.10.2\",\"tileheight\":8,\"tilewidth\":8,"
+		        "\"type\":\"tileset\",\"version\":\"1.10\"}\n",
+		        Params->TileWidth, Name, ImageHeight, ImageWidth, Name, NumTiles);
+		fclose(File);
+	}
+
+	TrackedFree(ImagePixels);
+	TrackedFree(Tiles);
+	return NumTiles;
+}
+
+// Writes Dir/Name.tmj along with its tilesets (Name_0.tsj, Name_1.tsj...)
+void GenerateMap(const char* Dir, const char* Name, bench_map_params* Params)
+{
+	bench_rng Rng = {Params->Seed * 0x9E3779B97F4A7C15ULL + 7};
+
+	u32* FirstGids = (u32*)TrackedMalloc(sizeof(u32) * Params->NumTilesets);
+	u32* NumTiles = (u32*)TrackedMalloc(sizeof(u32) * Params->NumTilesets);
+	u32 NextGid = 1;
+	for (u32 TilesetIndex = 0; TilesetIndex < Params->NumTilesets; TilesetIndex++)
+	{
+		char TilesetName[MAX_PATH];
+		snprintf(TilesetName, sizeof(TilesetName), "%s_%u", Name, TilesetIndex);
+		bench_tileset_params TilesetParams = Params->Tileset;
+		TilesetParams.Seed = Params->Seed * 131 + TilesetIndex;
+
+		FirstGids[TilesetIndex] = NextGid;
+		NumTiles[TilesetIndex] = GenerateTileset(Dir, TilesetName, &TilesetParams);
+		NextGid += NumTiles[TilesetIndex];
+	}
+
+	char FileName[MAX_PATH];
+	char FilePath[MAX_PATH];
+	snprintf(FileName, sizeof(FileName), "%s.tmj", Name);
+	JoinPath(Dir, FileName, FilePath);
+	FILE* File = fopen(FilePath, "w");
+	if (!File)
+	{
+		fprintf(stderr, "ERROR: Failed to open file '%s' for writing.\n", FilePath);
+		return;
+	}
+
+	fprintf(File, "{\"compressionlevel\":-1,\"height\":%u,\"infinite\":false,\"layers\":[", Params->Height);
+	for (u32 LayerIndex = 0; LayerIndex < Params->NumLayers; LayerIndex++)
+	{
+		fprintf(File, "%s{\"data\":[", LayerIndex ? "," : "");
+		u32 NumEntries = Params->Width * Params->Height;
+		for (u32 EntryIndex = 0; EntryIndex < NumEntries; EntryIndex++)
+		{
+			// Roughly one in ten entries is blank
+			u32 Gid = 0;
+			if (NextRandom(&Rng) % 10)
+			{
+				u32 TilesetIndex = NextRandom(&Rng) % Params->NumTilesets;
+				Gid = FirstGids[TilesetIndex] + NextRandom(&Rng) % NumTiles[TilesetIndex];
+				if (NextRandomUnit(&Rng) < Params->FlipRatio)
+				{
+					Gid |= (NextRandom(&Rng) & 1) ? TiledFlag_HFlip : TiledFlag_VFlip;
+				}
+			}
+			fprintf(File, "%s%u", EntryIndex ? "," : "", Gid);
+		}
+		fprintf(File, "],\"height\":%u,\"id\":%u,\"name\":\"Layer %u\",\"opacity\":1,\"type\":\"tilelayer\",\"visible\":true,"
+		        "\"width\":%u,\"x\":0,\"y\":0}", Params->Height, LayerIndex + 1, LayerIndex + 1, Params->Width);
+	}
+	fprintf(File, "],\"nextlayerid\":%u,\"nextobjectid\":1,\"orientation\":\"orthogonal\",\"renderorder\":\"right-down\","
+	        "\"tiledversion\":\"1.10.2\",\"tileheight\":8,\"tilesets\":[", Params->NumLayers + 1);
+	for (u32 TilesetIndex = 0; TilesetIndex < Params->NumTilesets; TilesetIndex++)
+	{
+		fprintf(File, "%s{\"firstgid\":%u,\"source\":\"%s_%u.tsj\"}", TilesetIndex ? "," : "", FirstGids[TilesetIndex], Name,
+		        TilesetIndex);
+	}
+	fprintf(File, "],\"tilewidth\":8,\"type\":\"map\",\"version\":\"1.10\",\"width\":%u}\n", Params->Width);
+	fclose(File);
+
+	TrackedFree(NumTiles);
+	TrackedFree(FirstGids);
+}
+
+// The pipeline prints a lot; keep it off the console while timing, but leave errors visible
+s32 SuppressStdout()
+{
+	fflush(stdout);
+#if _WIN32
+	s32 Result = _dup(_fileno(stdout));
+	FILE* Null = freopen("NUL", "w", stdout);
+#else
+	s32 Result = dup(fileno(stdout));
+	FILE* Null = freopen("/dev/null", "w", stdout);
+#endif
+	(void)Null;
+	return Result;
+}
+
+void RestoreStdout(s32 SavedStdout)
+{
+	fflush(stdout);
+#if _WIN32
+	_dup2(SavedStdout, _fileno(stdout));
+	_close(SavedStdout);
+#else
+	dup2(SavedStdout, fileno(stdout));
+	close(SavedStdout);
+#endif
+}
+
+struct bench_timing
+{
+	f64 MinMs;
+	f64 MedianMs;
+};
+
+bench_timing SummariseTimings(f64* RunMs, u32 NumRuns)
+{
+	std::sort(RunMs, RunMs + NumRuns);
+	bench_timing Result;
+	Result.MinMs = RunMs[0];
+	Result.MedianMs = (NumRuns % 2) ? RunMs[NumRuns / 2] : (RunMs[NumRuns / 2 - 1] + RunMs[NumRuns / 2]) * 0.5;
+	return Result;
+}
+
+// Times MinimiseTileset alone (parsing the tileset JSON isn't included); stage times are averaged over every run
+void BenchTileset(FILE* Json, b32 First, const char* Dir, const char* Name, bench_tileset_params* Params, u32 NumRuns)
+{
+	u32 NumTiles = GenerateTileset(Dir, Name, Params);
+
+	char TilesetPath[MAX_PATH];
+	snprintf(TilesetPath, sizeof(TilesetPath), "%s.tsj", Name);
+
+	stage_stats Stats[Stage_Count] = {};
+	f64* RunMs = (f64*)TrackedMalloc(sizeof(f64) * NumRuns);
+	u32 NumUniqueTiles = 0;
+	b32 Error = false;
+	memory_arena Arena = {};
+	for (u32 RunIndex = 0; RunIndex < NumRuns && !Error; RunIndex++)
+	{
+		// Every run (result included) is done in a temporary scope of the one arena
+		temp_memory RunMemory = BeginTemporaryMemory(&Arena);
+		json_document* JsonDoc = PushJsonDocument(&Arena);
+		str_buffer TilesetText = {};
+		if (!ParseTilesetJson(Dir, TilesetPath, &Arena, TilesetText, *JsonDoc))
+		{
+			EndTemporaryMemory(RunMemory);
+			Error = true;
+			break;
+		}
+
+		char NewTilesetPath[MAX_PATH];
+		s32 SavedStdout = SuppressStdout();
+		ThreadStageStats = Stats;
+		f64 StartSeconds = GetWallSeconds();
+		minimised_tileset MinTiles = MinimiseTileset(TilesetPath, *JsonDoc, TilesetText.Size, NewTilesetPath, Dir, &Arena, &Arena);
+		RunMs[RunIndex] = (GetWallSeconds() - StartSeconds) * 1000.0;
+		ThreadStageStats = nullptr;
+		RestoreStdout(SavedStdout);
+
+		Error = MinTiles.Error;
+		NumUniqueTiles = MinTiles.NumUniqueTiles;
+		EndTemporaryMemory(RunMemory);
+	}
+	ClearArena(&Arena);
+
+	bench_timing Timing = {};
+	if (!Error)
+	{
+		Timing = SummariseTimings(RunMs, NumRuns);
+	}
+	fprintf(stderr, "%-28s %6u tiles -> %6u  min %9.2f ms  median %9.2f ms%s\n", Name, NumTiles, NumUniqueTiles, Timing.MinMs,
+	        Timing.MedianMs, Error ? "  (FAILED)" : "");
+
+	fprintf(Json, "%s{\"name\":\"%s\",\"tiles\":%u,\"duplicate_ratio\":%.2f,\"flip_ratio\":%.2f,\"alpha_noise\":%.2f,"
+	        "\"unique_tiles\":%u,\"error\":%s,\"min_ms\":%.3f,\"median_ms\":%.3f,\"stages\":{",
+	        First ? "" : ",", Name, NumTiles, Params->DuplicateRatio, Params->FlipRatio, Params->AlphaNoise, NumUniqueTiles,
+	        Error ? "true" : "false", Timing.MinMs, Timing.MedianMs);
+	b32 FirstStage = true;
+	for (u32 Stage = 0; Stage < Stage_Count; Stage++)
+	{
+		if (Stats[Stage].Runs)
+		{
+			fprintf(Json, "%s\"%s\":%.3f", FirstStage ? "" : ",", StageNames[Stage], Stats[Stage].WallSeconds * 1000.0 / Stats[Stage].Runs);
+			FirstStage = false;
+		}
+	}
+	fprintf(Json, "}}");
+	TrackedFree(RunMs);
+}
+
+// Times RunSmint on a generated map, exactly as if it had been run from the command line
+void BenchPipeline(FILE* Json, b32 First, const char* Dir, const char* Name, bench_map_params* Params, const char* ExtraArg,
+                   u32 NumRuns)
+{
+	char FileName[MAX_PATH];
+	char MapPath[MAX_PATH];
+	snprintf(FileName, sizeof(FileName), "%s.tmj", Name);
+	JoinPath(Dir, FileName, MapPath);
+
+	f64* RunMs = (f64*)TrackedMalloc(sizeof(f64) * NumRuns);
+	s32 ExitCode = 0;
+	for (u32 RunIndex = 0; RunIndex < NumRuns && ExitCode == 0; RunIndex++)
+	{
+		char* Args[3] = {(char*)"smint", MapPath, (char*)ExtraArg};
+		s32 NumArgs = ExtraArg ? 3 : 2;
+
+		s32 SavedStdout = SuppressStdout();
+		f64 StartSeconds = GetWallSeconds();
+		ExitCode = RunSmint(NumArgs, Args);
+		RunMs[RunIndex] = (GetWallSeconds() - StartSeconds) * 1000.0;
+		RestoreStdout(SavedStdout);
+	}
+
+	bench_timing Timing = {};
+	if (ExitCode == 0)
+	{
+		Timing = SummariseTimings(RunMs, NumRuns);
+	}
+	fprintf(stderr, "%-28s %4ux%-4u %u layer(s) %u tileset(s) %-14s  min %9.2f ms  median %9.2f ms%s\n", Name, Params->Width,
+	        Params->Height, Params->NumLayers, Params->NumTilesets, ExtraArg ? ExtraArg : "", Timing.MinMs, Timing.MedianMs,
+	        ExitCode ? "  (FAILED)" : "");
+
+	fprintf(Json, "%s{\"name\":\"%s\",\"width\":%u,\"height\":%u,\"layers\":%u,\"tilesets\":%u,\"tileset_tiles\":%u,"
+	        "\"args\":\"%s\",\"exit_code\":%d,\"min_ms\":%.3f,\"median_ms\":%.3f}",
+	        First ? "" : ",", Name, Params->Width, Params->Height, Params->NumLayers, Params->NumTilesets,
+	        Params->Tileset.TileWidth * Params->Tileset.TileHeight, ExtraArg ? ExtraArg : "", ExitCode, Timing.MinMs,
+	        Timing.MedianMs);
+	TrackedFree(RunMs);
+}
+
+int main(int ArgC, char** ArgV)
+{
+	const char* OutDir = "bench_data";
+	const char* JsonPath = "bench_results.json";
+	u32 NumRuns = 5;
+	b32 Quick = false;
+	for (s32 ArgIndex = 1; ArgIndex < ArgC; ArgIndex++)
+	{
+		char* Arg = ArgV[ArgIndex];
+		if (strcmp(Arg, "--out") == 0 && ArgIndex + 1 < ArgC)
+		{
+			OutDir = ArgV[++ArgIndex];
+		}
+		else if (strcmp(Arg, "--json") == 0 && ArgIndex + 1 < ArgC)
+		{
+			JsonPath = ArgV[++ArgIndex];
+		}
+		else if (strcmp(Arg, "--repeat") == 0 && ArgIndex + 1 < ArgC)
+		{
+			NumRuns = (u32)atoi(ArgV[++ArgIndex]);
+			NumRuns = NumRuns ? NumRuns : 1;
+		}
+		else if (strcmp(Arg, "--quick") == 0)
+		{
+			Quick = true;
+		}
+		else
+		{
+			fprintf(stderr, "Usage: smint_bench [--out dir] [--json path] [--repeat N] [--quick]\n");
+			return 1;
+		}
+	}
+
+	MakeDirectory(OutDir);
+	char Dir[MAX_PATH];
+	GetFullPath(OutDir, Dir);
+
+	const char* Kernels = InitTileKernels(true);
+	FILE* Json = fopen(JsonPath, "w");
+	if (!Json)
+	{
+		fprintf(stderr, "ERROR: Failed to open file '%s' for writing.\n", JsonPath);
+		return 1;
+	}
+	fprintf(Json, "{\"kernels\":\"%s\",\"repeat\":%u,\"tilesets\":[", Kernels, NumRuns);
+
+	// MinimiseTileset across image sizes and duplicate ratios
+	u32 TilesetSizes[] = {16, 64, 128};
+	f32 DuplicateRatios[] = {0.25f, 0.9f};
+	u32 NumTilesetSizes = Quick ? 2 : ArrayCount(TilesetSizes);
+	b32 First = true;
+	for (u32 SizeIndex = 0; SizeIndex < NumTilesetSizes; SizeIndex++)
+	{
+		for (u32 RatioIndex = 0; RatioIndex < ArrayCount(DuplicateRatios); RatioIndex++)
+		{
+			bench_tileset_params Params = {};
+			Params.TileWidth = TilesetSizes[SizeIndex];
+			Params.TileHeight = TilesetSizes[SizeIndex];
+			Params.DuplicateRatio = DuplicateRatios[RatioIndex];
+			Params.FlipRatio = 0.5f;
+			Params.AlphaNoise = 0.1f;
+			Params.Seed = SizeIndex * 16 + RatioIndex + 1;
+
+			char Name[MAX_PATH];
+			snprintf(Name, sizeof(Name), "tileset_%ux%u_dup%02u", Params.TileWidth, Params.TileHeight,
+			         (u32)(Params.DuplicateRatio * 100.0f + 0.5f));
+			BenchTileset(Json, First, Dir, Name, &Params, NumRuns);
+			First = false;
+		}
+	}
+
+	// Full pipeline across map sizes, layer counts and tileset counts, with and without -rut
+	fprintf(Json, "],\"pipeline\":[");
+	struct map_case
+	{
+		u32 Width;
+		u32 Height;
+		u32 NumLayers;
+		u32 NumTilesets;
+	};
+	map_case MapCases[] =
+	{
+		{64, 64, 1, 1},
+		{128, 128, 4, 2},
+		{256, 256, 2, 4},
+		{512, 512, 4, 4},
+	};
+	const char* ExtraArgs[] = {nullptr, "-rut"};
+	u32 NumMapCases = Quick ? 2 : ArrayCount(MapCases);
+	First = true;
+	for (u32 CaseIndex = 0; CaseIndex < NumMapCases; CaseIndex++)
+	{
+		bench_map_params Params = {};
+		Params.Width = MapCases[CaseIndex].Width;
+		Params.Height = MapCases[CaseIndex].Height;
+		Params.NumLayers = MapCases[CaseIndex].NumLayers;
+		Params.NumTilesets = MapCases[CaseIndex].NumTilesets;
+		Params.FlipRatio = 0.25f;
+		Params.Tileset.TileWidth = 64;
+		Params.Tileset.TileHeight = 64;
+		Params.Tileset.DuplicateRatio = 0.75f;
+		Params.Tileset.FlipRatio = 0.5f;
+		Params.Tileset.AlphaNoise = 0.1f;
+		Params.Seed = CaseIndex + 1;
+
+		char Name[MAX_PATH];
+		snprintf(Name, sizeof(Name), "map_%ux%u_l%u_t%u", Params.Width, Params.Height, Params.NumLayers, Params.NumTilesets);
+		GenerateMap(Dir, Name, &Params);
+		for (u32 ArgIndex = 0; ArgIndex < ArrayCount(ExtraArgs); ArgIndex++)
+		{
+			BenchPipeline(Json, First, Dir, Name, &Params, ExtraArgs[ArgIndex], NumRuns);
+			First = false;
+		}
+	}
+	fprintf(Json, "]}\n");
+	fclose(Json);
+
+	fprintf(stderr, "Wrote benchmark results to '%s'.\n", JsonPath);
+	return 0;
+}
@@ -0,0 +1,354 @@
+// Content-addressed cache of minimised tilesets (--cache dir). Entries are keyed by a hash of the tileset JSON, the
+// image bytes and anything else that affects the result, and hold everything needed to skip MinimiseTileset entirely:
+// the unique tiles, the source tile mappings, the output .tsj/.png and the messages the original run printed.
+
+#define CACHE_MAGIC 0x31434D53 // "SMC1"
+#define CACHE_VERSION 2
+
+struct cache_key
+{
+	u64 Hash[2];
+	char Name[33]; // Hex, used as the file name
+};
+
+u64 RotateLeft64(u64 Value, u32 Shift)
+{
+	u64 Result = (Value << Shift) | (Value >> (64 - Shift));
+	return Result;
+}
+
+u64 MixHash64(u64 Value)
+{
+	Value ^= Value >> 33;
+	Value *= 0xFF51AFD7ED558CCDULL;
+	Value ^= Value >> 33;
+	Value *= 0xC4CEB9FE1A85EC53ULL;
+	Value ^= Value >> 33;
+	return Value;
+}
+
+// MurmurHash3 (x64, 128-bit); Hash is both the seed and the result, so several buffers can be chained together
+void HashBytes128(const void* Data, u64 Size, u64 Hash[2])
+{
+	const u8* Bytes = (const u8*)Data;
+	const u64 C1 = 0x87C37B91114253D5ULL;
+	const u64 C2 = 0x4CF5AD432745937FULL;
+	u64 H1 = Hash[0];
+	u64 H2 = Hash[1];
+
+	u64 NumBlocks = Size / 16;
+	for (u64 BlockIndex = 0; BlockIndex < NumBlocks; BlockIndex++)
+	{
+		u64 K1, K2;
+		memcpy(&K1, Bytes + BlockIndex * 16, 8);
+		memcpy(&K2, Bytes + BlockIndex * 16 + 8, 8);
+
+		K1 *= C1; K1 = RotateLeft64(K1, 31); K1 *= C2; H1 ^= K1;
+		H1 = RotateLeft64(H1, 27); H1 += H2; H1 = H1 * 5 + 0x52DCE729;
+		K2 *= C2; K2 = RotateLeft64(K2, 33); K2 *= C1; H2 ^= K2;
+		H2 = RotateLeft64(H2, 31); H2 += H1; H2 = H2 * 5 + 0x38495AB5;
+	}
+
+	const u8* Tail = Bytes + NumBlocks * 16;
+	u64 K1 = 0;
+	u64 K2 = 0;
+	// The last 1-15 bytes, little-endian: bytes 8 and up go into K2, the rest into K1
+	u32 TailSize = (u32)(Size & 15);
+	for (u32 ByteIndex = 0; ByteIndex < TailSize; ByteIndex++)
+	{
+		if (ByteIndex < 8)
+		{
+			K1 ^= (u64)Tail[ByteIndex] << (ByteIndex * 8);
+		}
+		else
+		{
+			K2 ^= (u64)Tail[ByteIndex] << ((ByteIndex - 8) * 8);
+		}
+	}
+	if (TailSize > 8)
+	{
+		K2 *= C2; K2 = RotateLeft64(K2, 33); K2 *= C1; H2 ^= K2;
+	}
+	if (TailSize > 0)
+	{
+		K1 *= C1; K1 = RotateLeft64(K1, 31); K1 *= C2; H1 ^= K1;
+	}
+
+	H1 ^= Size; H2 ^= Size;
+	H1 += H2; H2 += H1;
+	H1 = MixHash64(H1); H2 = MixHash64(H2);
+	H1 += H2; H2 += H1;
+
+	Hash[0] = H1;
+	Hash[1] = H2;
+}
+
+// Hashes the length too, so e.g. moving bytes from one buffer to the next gives a different key
+void HashBuffer(const void* Data, u64 Size, u64 Hash[2])
+{
+	HashBytes128(&Size, sizeof(Size), Hash);
+	HashBytes128(Data, Size, Hash);
+}
+
+// Returns false if the inputs can't be read, in which case the tileset just isn't cached
+b32 ComputeTilesetCacheKey(const char* BaseDir, const char* TilesetPath, tileset_paths* Paths, b8* TilesInUse, u32 NumTiles,
+                           u32 TileOrder, tile_usage* Usage, png_options* Png, cache_key* OutKey)
+{
+	char TilesetFullPath[MAX_PATH];
+	JoinPath(BaseDir, TilesetPath, TilesetFullPath);
+	str_buffer TilesetText = ReadBinaryFile(TilesetFullPath);
+	str_buffer ImageBytes = ReadBinaryFile(Paths->ImageFullPath);
+	b32 Result = TilesetText.Data && ImageBytes.Data;
+	if (Result)
+	{
+		u64 Hash[2] = {CACHE_MAGIC, CACHE_VERSION};
+		HashBuffer(TilesetText.Data, TilesetText.Size, Hash);
+		HashBuffer(ImageBytes.Data, ImageBytes.Size, Hash);
+
+		// The messages replayed on a hit name the tileset as the map refers to it (the image's name is in the text already)
+		HashBuffer(TilesetPath, strlen(TilesetPath), Hash);
+
+		// With -rut, the result also depends on which tiles the map(s) use
+		u8 HasTilesInUse = TilesInUse != nullptr;
+		HashBuffer(&HasTilesInUse, sizeof(HasTilesInUse), Hash);
+		if (TilesInUse)
+		{
+			HashBuffer(TilesInUse, NumTiles, Hash);
+		}
+
+		// As does the order of its tiles, unless it's the default (so keys from before tiles could be ordered still hit)
+		if (TileOrder != SMINT_TILE_ORDER_FIRST)
+		{
+			HashBuffer(&TileOrder, sizeof(TileOrder), Hash);
+			HashBuffer(Usage->Counts, sizeof(u32) * Usage->NumTiles, Hash);
+			HashBuffer(Usage->PairKeys, sizeof(u64) * Usage->PairCapacity, Hash);
+			HashBuffer(Usage->PairCounts, sizeof(u32) * Usage->PairCapacity, Hash);
+		}
+
+		// The image is stored as written, so the built-in PNG writer's settings matter too (but not its thread count)
+		if (Png)
+		{
+			u32 PngSettings[2] = {Png->Level, Png->Filter};
+			HashBuffer(PngSettings, sizeof(PngSettings), Hash);
+		}
+
+		OutKey->Hash[0] = Hash[0];
+		OutKey->Hash[1] = Hash[1];
+		snprintf(OutKey->Name, sizeof(OutKey->Name), "%016llx%016llx", (unsigned long long)Hash[0], (unsigned long long)Hash[1]);
+	}
+
+	TrackedFree(TilesetText.Data);
+	TrackedFree(ImageBytes.Data);
+	return Result;
+}
+
+struct cache_writer
+{
+	u8* Data;
+	u64 Size;
+	u64 Capacity;
+};
+
+void CacheWrite(cache_writer* Writer, const void* Data, u64 Size)
+{
+	if (Writer->Size + Size > Writer->Capacity)
+	{
+		u64 NewCapacity = Writer->Capacity ? Writer->Capacity : 4096;
+		while (NewCapacity < Writer->Size + Size)
+		{
+			NewCapacity *= 2;
+		}
+		Writer->Data = (u8*)TrackedRealloc(Writer->Data, NewCapacity);
+		Writer->Capacity = NewCapacity;
+	}
+	memcpy(Writer->Data + Writer->Size, Data, Size);
+	Writer->Size += Size;
+}
+
+void CacheWriteBlob(cache_writer* Writer, const void* Data, u64 Size)
+{
+	CacheWrite(Writer, &Size, sizeof(Size));
+	CacheWrite(Writer, Data, Size);
+}
+
+struct cache_reader
+{
+	u8* Data;
+	u64 Size;
+	u64 Offset;
+	b32 Error;
+};
+
+// Returns a pointer into the entry, or nullptr (and flags an error) if the entry is too short
+void* CacheRead(cache_reader* Reader, u64 Size)
+{
+	if (Reader->Error || Size > Reader->Size - Reader->Offset)
+	{
+		Reader->Error = true;
+		return nullptr;
+	}
+	void* Result = Reader->Data + Reader->Offset;
+	Reader->Offset += Size;
+	return Result;
+}
+
+u32 CacheReadU32(cache_reader* Reader)
+{
+	u32 Result = 0;
+	void* Data = CacheRead(Reader, sizeof(u32));
+	if (Data)
+	{
+		memcpy(&Result, Data, sizeof(u32));
+	}
+	return Result;
+}
+
+void* CacheReadBlob(cache_reader* Reader, u64* OutSize)
+{
+	*OutSize = 0;
+	void* SizeData = CacheRead(Reader, sizeof(u64));
+	if (SizeData)
+	{
+		memcpy(OutSize, SizeData, sizeof(u64));
+	}
+	return CacheRead(Reader, *OutSize);
+}
+
+void GetCacheEntryPath(const char* CacheDir, cache_key* Key, char* OutPath)
+{
+	char FileName[MAX_PATH];
+	snprintf(FileName, sizeof(FileName), "%s.smc", Key->Name);
+	JoinPath(CacheDir, FileName, OutPath);
+}
+
+// On a hit, writes the cached output files and fills in OutResult (on Arena) exactly as MinimiseTileset would have,
+// replaying its messages into Log. Anything unreadable is treated as a miss.
+b32 LoadCachedTileset(const char* CacheDir, cache_key* Key, tileset_paths* Paths, u32 NumTiles, memory_arena* Arena,
+                      message_log* Log, minimised_tileset* OutResult)
+{
+	char EntryPath[MAX_PATH];
+	GetCacheEntryPath(CacheDir, Key, EntryPath);
+	str_buffer Entry = ReadBinaryFile(EntryPath);
+	if (!Entry.Data)
+	{
+		return false;
+	}
+
+	cache_reader Reader = {};
+	Reader.Data = (u8*)Entry.Data;
+	Reader.Size = Entry.Size;
+	minimised_tileset Result = {};
+	b32 IsValid = CacheReadU32(&Reader) == CACHE_MAGIC && CacheReadU32(&Reader) == CACHE_VERSION &&
+	              CacheReadU32(&Reader) == NumTiles;
+	Result.OriginalImage.TileWidth = CacheReadU32(&Reader);
+	Result.OriginalImage.TileHeight = CacheReadU32(&Reader);
+	Result.NumUniqueTiles = CacheReadU32(&Reader);
+	Result.IsUnchanged = CacheReadU32(&Reader);
+	u32 KeyPixel = CacheReadU32(&Reader);
+	memcpy(&Result.KeyPixel, &KeyPixel, sizeof(pixel));
+	IsValid = IsValid && !Reader.Error && Result.OriginalImage.TileWidth * Result.OriginalImage.TileHeight == NumTiles &&
+	          Result.NumUniqueTiles <= NumTiles;
+
+	unique_tile* UniqueTiles = IsValid ? (unique_tile*)CacheRead(&Reader, sizeof(unique_tile) * Result.NumUniqueTiles) : nullptr;
+	u32* MappingData = IsValid ? (u32*)CacheRead(&Reader, sizeof(u32) * 2 * NumTiles) : nullptr;
+	u64 LogSize, TilesetTextSize, ImageSize;
+	char* LogRecords = (char*)CacheReadBlob(&Reader, &LogSize);
+	char* TilesetText = (char*)CacheReadBlob(&Reader, &TilesetTextSize);
+	u8* Image = (u8*)CacheReadBlob(&Reader, &ImageSize);
+	IsValid = IsValid && !Reader.Error && Reader.Offset == Reader.Size;
+
+	temp_memory ResultMemory = BeginTemporaryMemory(Arena);
+	if (IsValid)
+	{
+		Result.MinimisedTiles = (unique_tile*)PushCopy(Arena, UniqueTiles, sizeof(unique_tile) * Result.NumUniqueTiles);
+		Result.Mappings = PushArrayZero(Arena, NumTiles, tile_mapping);
+		for (u32 TileIndex = 0; TileIndex < NumTiles && IsValid; TileIndex++)
+		{
+			u32 UniqueTileIndex, Transform;
+			memcpy(&UniqueTileIndex, MappingData + TileIndex * 2, sizeof(u32));
+			memcpy(&Transform, MappingData + TileIndex * 2 + 1, sizeof(u32));
+			if (UniqueTileIndex != 0xFFFFFFFF)
+			{
+				IsValid = UniqueTileIndex < Result.NumUniqueTiles && Transform < TileTransform_Count;
+				Result.Mappings[TileIndex].EquivalentUniqueTile = Result.MinimisedTiles + UniqueTileIndex;
+				Result.Mappings[TileIndex].EqualAfterTransform = (tile_transform_type)Transform;
+			}
+		}
+	}
+
+	if (IsValid && !Result.IsUnchanged)
+	{
+		IsValid = WriteBinaryFile(Paths->ImageOutFullPath, Image, ImageSize) &&
+		          WriteBinaryFile(Paths->NewTilesetFullPath, TilesetText, TilesetTextSize);
+	}
+
+	if (IsValid)
+	{
+		AppendToMessageLog(Log, LogRecords, LogSize);
+		*OutResult = Result;
+		KeepTemporaryMemory(ResultMemory);
+	}
+	else
+	{
+		// Leaves the arena as it was, ready for MinimiseTileset
+		EndTemporaryMemory(ResultMemory);
+	}
+	TrackedFree(Entry.Data);
+	return IsValid;
+}
+
+// Stores a freshly minimised tileset; LogRecords are the messages MinimiseTileset logged for it. Failing to write the
+// entry isn't an error - the next run just won't get a hit.
+void StoreCachedTileset(const char* CacheDir, cache_key* Key, tileset_paths* Paths, u32 NumTiles, minimised_tileset* MinTiles,
+                        const char* LogRecords, u64 LogSize)
+{
+	str_buffer TilesetText = {};
+	str_buffer Image = {};
+	if (!MinTiles->IsUnchanged)
+	{
+		TilesetText = ReadBinaryFile(Paths->NewTilesetFullPath);
+		Image = ReadBinaryFile(Paths->ImageOutFullPath);
+		if (!TilesetText.Data || !Image.Data)
+		{
+			TrackedFree(TilesetText.Data);
+			TrackedFree(Image.Data);
+			return;
+		}
+	}
+
+	cache_writer Writer = {};
+	u32 KeyPixel;
+	memcpy(&KeyPixel, &MinTiles->KeyPixel, sizeof(pixel));
+	u32 Header[] = {CACHE_MAGIC, CACHE_VERSION, NumTiles, MinTiles->OriginalImage.TileWidth, MinTiles->OriginalImage.TileHeight,
+	                MinTiles->NumUniqueTiles, (u32)MinTiles->IsUnchanged, KeyPixel};
+	CacheWrite(&Writer, Header, sizeof(Header));
+	CacheWrite(&Writer, MinTiles->MinimisedTiles, sizeof(unique_tile) * MinTiles->NumUniqueTiles);
+	for (u32 TileIndex = 0; TileIndex < NumTiles; TileIndex++)
+	{
+		tile_mapping* Mapping = MinTiles->Mappings + TileIndex;
+		u32 MappingData[2] = {0xFFFFFFFF, 0};
+		if (Mapping->EquivalentUniqueTile)
+		{
+			MappingData[0] = (u32)(Mapping->EquivalentUniqueTile - MinTiles->MinimisedTiles);
+			MappingData[1] = Mapping->EqualAfterTransform;
+		}
+		CacheWrite(&Writer, MappingData, sizeof(MappingData));
+	}
+	CacheWriteBlob(&Writer, LogRecords, LogSize);
+	CacheWriteBlob(&Writer, TilesetText.Data, TilesetText.Size);
+	CacheWriteBlob(&Writer, Image.Data, Image.Size);
+
+	// Write under a temporary name first, so other processes sharing the cache never see a partial entry
+	char EntryPath[MAX_PATH];
+	GetCacheEntryPath(CacheDir, Key, EntryPath);
+	char TempPath[MAX_PATH + 32];
+	snprintf(TempPath, sizeof(TempPath), "%s.%u.%p.tmp", EntryPath, GetPid(), (void*)MinTiles);
+	if (WriteBinaryFile(TempPath, Writer.Data, Writer.Size) && rename(TempPath, EntryPath) != 0)
+	{
+		remove(TempPath); // Most likely someone else stored the same entry first
+	}
+
+	TrackedFree(Writer.Data);
+	TrackedFree(TilesetText.Data);
+	TrackedFree(Image.Data);
+}
@@ -0,0 +1,288 @@
+// Tiled can store a layer's data as a base64 string of little-endian u32 GIDs instead of a JSON array, optionally
+// compressed. zlib and gzip are handled with the deflate code already in stb_image/stb_image_write.
+
+enum layer_compression : u32
+{
+	LayerCompression_None,
+	LayerCompression_Zlib,
+	LayerCompression_Gzip,
+	LayerCompression_Zstd, // Recognised so we can give a sensible error, but not supported
+
+	LayerCompression_Invalid
+};
+
+layer_compression ParseLayerCompression(const char* Name)
+{
+	layer_compression Result = LayerCompression_Invalid;
+	if (!*Name)
+	{
+		Result = LayerCompression_None;
+	}
+	else if (strcmp(Name, "zlib") == 0)
+	{
+		Result = LayerCompression_Zlib;
+	}
+	else if (strcmp(Name, "gzip") == 0)
+	{
+		Result = LayerCompression_Gzip;
+	}
+	else if (strcmp(Name, "zstd") == 0)
+	{
+		Result = LayerCompression_Zstd;
+	}
+	return Result;
+}
+
+static const char Base64Chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Returns number of bytes written to OutBytes (which must hold at least Length * 3 / 4), or -1 if the input isn't valid base64
+s32 DecodeBase64(const char* Text, u32 Length, u8* OutBytes)
+{
+	s8 Lookup[256];
+	memset(Lookup, -1, sizeof(Lookup));
+	for (u32 i = 0; i < 64; i++)
+	{
+		Lookup[(u8)Base64Chars[i]] = (s8)i;
+	}
+
+	u32 Bits = 0;
+	u32 NumBits = 0;
+	s32 OutIndex = 0;
+	for (u32 i = 0; i < Length; i++)
+	{
+		u8 Char = (u8)Text[i];
+		if (Char == '=')
+		{
+			break;
+		}
+		if (Char == ' ' || Char == '\n' || Char == '\r' || Char == '\t')
+		{
+			continue; // Tiled's XML format line-wraps, so be lenient in case a map was converted
+		}
+		if (Lookup[Char] < 0)
+		{
+			return -1;
+		}
+
+		Bits = (Bits << 6) | (u32)Lookup[Char];
+		NumBits += 6;
+		if (NumBits >= 8)
+		{
+			NumBits -= 8;
+			OutBytes[OutIndex++] = (u8)(Bits >> NumBits);
+		}
+	}
+	return OutIndex;
+}
+
+// Returns NUL-terminated, malloc'd string
+char* EncodeBase64(u8* Bytes, u32 Length, u32* OutLength)
+{
+	u32 TextLength = ((Length + 2) / 3) * 4;
+	char* Result = (char*)TrackedMalloc(TextLength + 1);
+
+	u32 OutIndex = 0;
+	u32 i = 0;
+	for (; i + 2 < Length; i += 3)
+	{
+		u32 Group = (Bytes[i] << 16) | (Bytes[i + 1] << 8) | Bytes[i + 2];
+		Result[OutIndex++] = Base64Chars[(Group >> 18) & 63];
+		Result[OutIndex++] = Base64Chars[(Group >> 12) & 63];
+		Result[OutIndex++] = Base64Chars[(Group >> 6) & 63];
+		Result[OutIndex++] = Base64Chars[Group & 63];
+	}
+	if (i < Length)
+	{
+		u32 Group = Bytes[i] << 16;
+		if (i + 1 < Length)
+		{
+			Group |= Bytes[i + 1] << 8;
+		}
+		Result[OutIndex++] = Base64Chars[(Group >> 18) & 63];
+		Result[OutIndex++] = Base64Chars[(Group >> 12) & 63];
+		Result[OutIndex++] = (i + 1 < Length) ? Base64Chars[(Group >> 6) & 63] : '=';
+		Result[OutIndex++] = '=';
+	}
+	Assert(OutIndex == TextLength);
+	Result[OutIndex] = 0;
+
+	*OutLength = TextLength;
+	return Result;
+}
+
+// Skips the gzip header (RFC 1952) and returns the offset of the raw deflate stream, or -1 if it isn't gzip
+s32 FindGzipDeflateStream(u8* Data, u32 Length)
+{
+	if (Length < 18 || Data[0] != 0x1F || Data[1] != 0x8B || Data[2] != 8)
+	{
+		return -1;
+	}
+
+	u8 Flags = Data[3];
+	u32 Offset = 10;
+	if (Flags & 4) // FEXTRA
+	{
+		if (Offset + 2 > Length)
+		{
+			return -1;
+		}
+		Offset += 2 + (Data[Offset] | (Data[Offset + 1] << 8));
+	}
+	if (Flags & 8) // FNAME
+	{
+		while (Offset < Length && Data[Offset])
+		{
+			Offset++;
+		}
+		Offset++;
+	}
+	if (Flags & 16) // FCOMMENT
+	{
+		while (Offset < Length && Data[Offset])
+		{
+			Offset++;
+		}
+		Offset++;
+	}
+	if (Flags & 2) // FHCRC
+	{
+		Offset += 2;
+	}
+
+	if (Offset + 8 > Length)
+	{
+		return -1;
+	}
+	return (s32)Offset;
+}
+
+// Returns malloc'd array of GIDs (with flip flags), or nullptr on failure
+u32* DecodeLayerData(const char* Text, u32 Length, layer_compression Compression, u32* OutCount)
+{
+	u8* Bytes = (u8*)TrackedMalloc(Length / 4 * 3 + 3);
+	s32 NumBytes = DecodeBase64(Text, Length, Bytes);
+	if (NumBytes < 0)
+	{
+		LogError("ERROR: Layer data is not valid base64.\n");
+		TrackedFree(Bytes);
+		return nullptr;
+	}
+
+	u8* Raw = Bytes;
+	s32 RawLength = NumBytes;
+	switch (Compression)
+	{
+		case LayerCompression_Zlib:
+		{
+			Raw = (u8*)stbi_zlib_decode_malloc((char*)Bytes, NumBytes, &RawLength);
+		} break;
+		case LayerCompression_Gzip:
+		{
+			s32 DeflateOffset = FindGzipDeflateStream(Bytes, NumBytes);
+			Raw = nullptr;
+			if (DeflateOffset >= 0)
+			{
+				Raw = (u8*)stbi_zlib_decode_noheader_malloc((char*)Bytes + DeflateOffset, NumBytes - DeflateOffset, &RawLength);
+			}
+		} break;
+		case LayerCompression_None:
+		{
+		} break;
+		default:
+		{
+			Raw = nullptr;
+		} break;
+	}
+
+	if (!Raw)
+	{
+		LogError("ERROR: Failed to decompress layer data.\n");
+		TrackedFree(Bytes);
+		return nullptr;
+	}
+	if (Raw != Bytes)
+	{
+		TrackedFree(Bytes);
+	}
+	if (RawLength % sizeof(u32) != 0)
+	{
+		LogError("ERROR: Layer data size (%d bytes) is not a multiple of 4.\n", RawLength);
+		TrackedFree(Raw);
+		return nullptr;
+	}
+
+	// GIDs are little-endian, same as every platform we build for, so the bytes can be used as they are
+	*OutCount = (u32)RawLength / sizeof(u32);
+	return (u32*)Raw;
+}
+
+// Returns malloc'd, NUL-terminated base64 string
+char* EncodeLayerData(u32* Entries, u32 Count, layer_compression Compression, u32* OutLength)
+{
+	u8* Bytes = (u8*)Entries;
+	s32 NumBytes = (s32)(Count * sizeof(u32));
+	u8* Compressed = nullptr;
+	switch (Compression)
+	{
+		case LayerCompression_Zlib:
+		{
+			Compressed = stbi_zlib_compress(Bytes, NumBytes, &NumBytes, stbi_write_png_compression_level);
+			Bytes = Compressed;
+		} break;
+		case LayerCompression_Gzip:
+		{
+			// Same deflate stream as zlib, just with a different header and trailer
+			s32 ZlibLength;
+			u8* Zlib = stbi_zlib_compress(Bytes, NumBytes, &ZlibLength, stbi_write_png_compression_level);
+			s32 DeflateLength = ZlibLength - 2 - 4;
+
+			Compressed = (u8*)TrackedMalloc(10 + DeflateLength + 8);
+			u8 Header[10] = {0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF};
+			memcpy(Compressed, Header, sizeof(Header));
+			memcpy(Compressed + 10, Zlib + 2, DeflateLength);
+
+			u32 Crc = stbiw__crc32(Bytes, NumBytes);
+			u8* Trailer = Compressed + 10 + DeflateLength;
+			for (u32 i = 0; i < 4; i++)
+			{
+				Trailer[i] = (u8)(Crc >> (8 * i));
+				Trailer[4 + i] = (u8)((u32)NumBytes >> (8 * i));
+			}
+
+			TrackedFree(Zlib);
+			Bytes = Compressed;
+			NumBytes = 10 + DeflateLength + 8;
+		} break;
+		default:
+		{
+		} break;
+	}
+
+	char* Result = EncodeBase64(Bytes, (u32)NumBytes, OutLength);
+	TrackedFree(Compressed);
+	return Result;
+}
+
+// Checks the 'encoding'/'compression' members of a layer whose data is a string (either may be nullptr if missing)
+b32 ValidateLayerEncoding(u32 LayerIndex, const char* Encoding, const char* Compression, layer_compression* OutCompression)
+{
+	if (!Encoding || strcmp(Encoding, "base64") != 0)
+	{
+		LogError("ERROR: Invalid map format - layer %u has string 'data' but its encoding is not base64.\n", LayerIndex);
+		return false;
+	}
+
+	*OutCompression = ParseLayerCompression(Compression ? Compression : "");
+	if (*OutCompression == LayerCompression_Zstd)
+	{
+		LogError("ERROR: Layer %u uses zstd compression, which isn't supported - please save the map with zlib or gzip compression instead.\n",
+		         LayerIndex);
+		return false;
+	}
+	if (*OutCompression == LayerCompression_Invalid)
+	{
+		LogError("ERROR: Layer %u has unrecognised compression '%s'.\n", LayerIndex, Compression);
+		return false;
+	}
+	return true;
+}
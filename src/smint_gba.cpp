@@ -0,0 +1,961 @@
+// --gba: exports each map as GBA background data as it's written, so it can go straight into a ROM without another tool
+// reading and deduplicating everything again. The unique tiles of every tileset the map uses are laid out one after the
+// other as 4bpp or 8bpp tile (charblock) data, and each layer becomes an array of screen entries (tile index |
+// hflip << 10 | vflip << 11 | palette bank << 12) pointing into them. 8bpp tiles share one palette; 4bpp tiles are each
+// given one of up to 16 palette banks (see smint_quantise.cpp). Tiles are deduplicated once more after being indexed,
+// since tiles that differ only in their palette bank can share their tile data.
+//
+// Empty cells get a tile of their own at index 0, made of colour index 0 (transparent on the GBA). Index 0 is always the
+// colour of the top-left pixel of the first tileset's original image (before -rut or --tile-order), in every bank, and
+// fully transparent pixels use it too.
+
+#define GBA_MAX_TILES 1024 // Tile indices in screen entries are 10 bits
+#define GBA_CHARBLOCK_TILES_4BPP 512 // 16KB each
+#define GBA_CHARBLOCK_TILES_8BPP 256
+#define GBA_SCREEN_HFLIP 0x0400
+#define GBA_SCREEN_VFLIP 0x0800
+#define GBA_SCREEN_BANK_SHIFT 12
+#define GBA_MAX_METATILE_SIZE 8 // In cells, each way
+#define GBA_MAX_METATILES 16384 // Metatile entries have 14 bits of index, then the flips
+#define GBA_METATILE_HFLIP 0x4000
+#define GBA_METATILE_VFLIP 0x8000
+
+// For 8bpp tiles
+struct gba_palette
+{
+	u16 Colours[256];
+	u32 NumColours;
+	u32 MaxColours;
+	u16* Lookup; // Index + 1 of every BGR555 colour, or 0 if it's not in the palette yet
+	b32 IsFull; // A colour didn't fit
+};
+
+struct gba_layer
+{
+	u32* Entries; // Tiled GIDs, with their flip flags
+	u32 Count;
+	u32 Width;
+	u32 Height;
+};
+
+u32 GetGbaPaletteIndex(gba_palette* Palette, pixel Pixel)
+{
+	u16 Colour = GetGbaColour(Pixel);
+	if (!Palette->Lookup[Colour])
+	{
+		if (Palette->NumColours == Palette->MaxColours)
+		{
+			Palette->IsFull = true;
+			return 0;
+		}
+		Palette->Colours[Palette->NumColours++] = Colour;
+		Palette->Lookup[Colour] = (u16)Palette->NumColours;
+	}
+	u32 Result = Palette->Lookup[Colour] - 1u;
+	return Result;
+}
+
+// 8bpp only; 4bpp tiles are indexed by QuantiseToPaletteBanks
+void IndexGbaTile(gba_palette* Palette, tile* Tile, indexed_tile* OutTile)
+{
+	for (u32 PixelIndex = 0; PixelIndex < ArrayCount(Tile->Pixels); PixelIndex++)
+	{
+		OutTile->Data[PixelIndex] = (u8)GetGbaPaletteIndex(Palette, Tile->Pixels[PixelIndex]);
+	}
+}
+
+void StoreU16(u8* Out, u16 Value)
+{
+	Out[0] = (u8)Value;
+	Out[1] = (u8)(Value >> 8);
+}
+
+// Layer data as GIDs, whichever way it was stored; pushed onto Arena
+b32 ReadGbaLayers(json_value& Layers, json_value& MapJson, memory_arena* Arena, gba_layer* OutLayers)
+{
+	u32 MapWidth = (MapJson.HasMember("width") && MapJson["width"].IsUint()) ? MapJson["width"].GetUint() : 0;
+	for (u32 LayerIndex = 0; LayerIndex < Layers.Size(); LayerIndex++)
+	{
+		json_value& Layer = Layers[LayerIndex];
+		json_value& LayerData = Layer["data"];
+		gba_layer* Out = OutLayers + LayerIndex;
+		if (LayerData.IsString())
+		{
+			u32* Entries = DecodeLayer(Layer, &Out->Count);
+			if (!Entries)
+			{
+				return false;
+			}
+			Out->Entries = (u32*)PushCopy(Arena, Entries, sizeof(u32) * Out->Count);
+			TrackedFree(Entries);
+		}
+		else
+		{
+			Out->Count = LayerData.Size();
+			Out->Entries = PushArray(Arena, Out->Count, u32);
+			for (u32 DataIndex = 0; DataIndex < Out->Count; DataIndex++)
+			{
+				Out->Entries[DataIndex] = LayerData[DataIndex].IsUint() ? LayerData[DataIndex].GetUint() : 0;
+			}
+		}
+
+		Out->Width = (Layer.HasMember("width") && Layer["width"].IsUint()) ? Layer["width"].GetUint() : MapWidth;
+		if (!Out->Width || Out->Count % Out->Width != 0)
+		{
+			LogError("ERROR: Layer %u has no usable width, so it can't be exported for the GBA.\n", LayerIndex);
+			return false;
+		}
+		Out->Height = Out->Count / Out->Width;
+	}
+	return true;
+}
+
+void MakeGbaIdentifier(const char* Name, char* OutIdentifier)
+{
+	u32 OutIndex = 0;
+	if (*Name >= '0' && *Name <= '9')
+	{
+		OutIdentifier[OutIndex++] = '_';
+	}
+	for (const char* Char = Name; *Char; Char++)
+	{
+		b32 IsAlphaNumeric = (*Char >= 'a' && *Char <= 'z') || (*Char >= 'A' && *Char <= 'Z') || (*Char >= '0' && *Char <= '9');
+		OutIdentifier[OutIndex++] = IsAlphaNumeric ? *Char : '_';
+	}
+	OutIdentifier[OutIndex] = 0;
+}
+
+struct gba_array
+{
+	const char* Suffix; // Of both the array's name and its .bin file
+	u8* Data;
+	u32 Size;
+	u32 ElementSize; // 2 or 4
+	u32 Width; // Only for layers, in entries
+	u32 Height;
+};
+
+// Little-endian, like the GBA
+u32 LoadGbaElement(gba_array* Array, u32 Offset)
+{
+	u32 Result = 0;
+	for (u32 ByteIndex = 0; ByteIndex < Array->ElementSize; ByteIndex++)
+	{
+		Result |= (u32)Array->Data[Offset + ByteIndex] << (ByteIndex * 8);
+	}
+	return Result;
+}
+
+void WriteGbaArrayElements(FILE* File, gba_array* Array, b32 IsAssembly)
+{
+	u32 PerLine = Array->ElementSize == 4 ? 8 : 16;
+	u32 NumElements = Array->Size / Array->ElementSize;
+	for (u32 ElementIndex = 0; ElementIndex < NumElements; ElementIndex++)
+	{
+		u32 Value = LoadGbaElement(Array, ElementIndex * Array->ElementSize);
+		b32 StartsLine = ElementIndex % PerLine == 0;
+		b32 EndsLine = ElementIndex % PerLine == PerLine - 1 || ElementIndex == NumElements - 1;
+		if (IsAssembly)
+		{
+			fprintf(File, "%s0x%0*X%s", StartsLine ? (Array->ElementSize == 4 ? "\t.word " : "\t.hword ") : "",
+			        Array->ElementSize * 2, Value, EndsLine ? "\n" : ",");
+		}
+		else
+		{
+			fprintf(File, "%s0x%0*X,%s", StartsLine ? "\t" : "", Array->ElementSize * 2, Value, EndsLine ? "\n" : "");
+		}
+	}
+}
+
+b32 CloseGbaTextFile(FILE* File, const char* FilePath)
+{
+	b32 Result = !ferror(File);
+	Result = (fclose(File) == 0) && Result;
+	if (!Result)
+	{
+		LogError("ERROR: Failed to write to file '%s'.\n", FilePath);
+	}
+	return Result;
+}
+
+// All output files are named <map>_<suffix>.<extension>, next to the map
+b32 MakeGbaFilePath(const char* OutBase, const char* Suffix, const char* Extension, char* OutPath)
+{
+	if (snprintf(OutPath, MAX_PATH, "%s_%s.%s", OutBase, Suffix, Extension) >= MAX_PATH)
+	{
+		LogError("ERROR: Output path '%s_%s.%s' is too long.\n", OutBase, Suffix, Extension);
+		return false;
+	}
+	return true;
+}
+
+// <map>_gba.h declares the arrays for both the C and assembly outputs
+b32 WriteGbaHeader(const char* OutBase, const char* Identifier, const char* SourceName, gba_array* Arrays, u32 NumArrays)
+{
+	char FilePath[MAX_PATH];
+	if (!MakeGbaFilePath(OutBase, "gba", "h", FilePath))
+	{
+		return false;
+	}
+	FILE* File = fopen(FilePath, "w");
+	if (!File)
+	{
+		LogError("ERROR: Failed to open file '%s' for writing.\n", FilePath);
+		return false;
+	}
+
+	fprintf(File, "// Generated by smint from %s\n#pragma once\n\n", SourceName);
+	for (u32 ArrayIndex = 0; ArrayIndex < NumArrays; ArrayIndex++)
+	{
+		gba_array* Array = Arrays + ArrayIndex;
+		char Upper[MAX_PATH];
+		snprintf(Upper, sizeof(Upper), "%s_%s", Identifier, Array->Suffix);
+		for (char* Char = Upper; *Char; Char++)
+		{
+			*Char = (*Char >= 'a' && *Char <= 'z') ? (char)(*Char - 'a' + 'A') : *Char;
+		}
+
+		fprintf(File, "#define %s_SIZE %u\n", Upper, Array->Size);
+		if (Array->Width)
+		{
+			fprintf(File, "#define %s_WIDTH %u\n#define %s_HEIGHT %u\n", Upper, Array->Width, Upper, Array->Height);
+		}
+		fprintf(File, "extern const unsigned %s %s_%s[%u];\n\n", Array->ElementSize == 4 ? "int" : "short", Identifier,
+		        Array->Suffix, Array->Size / Array->ElementSize);
+	}
+	return CloseGbaTextFile(File, FilePath);
+}
+
+b32 WriteGbaSource(const char* OutBase, const char* Identifier, const char* SourceName, gba_array* Arrays, u32 NumArrays,
+                   b32 IsAssembly)
+{
+	char FilePath[MAX_PATH];
+	if (!MakeGbaFilePath(OutBase, "gba", IsAssembly ? "s" : "c", FilePath))
+	{
+		return false;
+	}
+	FILE* File = fopen(FilePath, "w");
+	if (!File)
+	{
+		LogError("ERROR: Failed to open file '%s' for writing.\n", FilePath);
+		return false;
+	}
+
+	fprintf(File, IsAssembly ? "@ Generated by smint from %s\n\n\t.section .rodata\n" : "// Generated by smint from %s\n\n",
+	        SourceName);
+	for (u32 ArrayIndex = 0; ArrayIndex < NumArrays; ArrayIndex++)
+	{
+		gba_array* Array = Arrays + ArrayIndex;
+		if (IsAssembly)
+		{
+			fprintf(File, "\n\t.align 2\n\t.global %s_%s\n%s_%s:\n", Identifier, Array->Suffix, Identifier, Array->Suffix);
+			WriteGbaArrayElements(File, Array, true);
+		}
+		else
+		{
+			fprintf(File, "const unsigned %s %s_%s[%u] __attribute__((aligned(4))) =\n{\n", Array->ElementSize == 4 ? "int" : "short",
+			        Identifier, Array->Suffix, Array->Size / Array->ElementSize);
+			WriteGbaArrayElements(File, Array, false);
+			fprintf(File, "};\n\n");
+		}
+	}
+	return CloseGbaTextFile(File, FilePath);
+}
+
+// --metatiles: each Size x Size block of cells becomes one metatile, a list of Size * Size screen entries. Metatiles are
+// deduplicated across every layer of the map the same way tiles are: each is reduced to the smallest of its flips, and
+// looked up by that. Flipping a metatile mirrors the order of its cells and toggles each cell's own flips.
+struct metatile_table
+{
+	u16* Entries; // Size * Size screen entries per metatile, row by row, in the orientation it was first found in
+	u8* CanonicalTransforms; // Of each metatile, as first found
+	u32 NumMetatiles;
+	u32 Size;
+	tile_hash_table HashTable;
+};
+
+void CopyTransformedMetatile(u16* Metatile, u16* OutTransformed, u32 Size, u32 Transform)
+{
+	u16 FlipBits = (u16)(((Transform & TileTransform_HFlip) ? GBA_SCREEN_HFLIP : 0) |
+	                     ((Transform & TileTransform_VFlip) ? GBA_SCREEN_VFLIP : 0));
+	for (u32 Y = 0; Y < Size; Y++)
+	{
+		for (u32 X = 0; X < Size; X++)
+		{
+			u32 SourceX = (Transform & TileTransform_HFlip) ? Size - 1 - X : X;
+			u32 SourceY = (Transform & TileTransform_VFlip) ? Size - 1 - Y : Y;
+			OutTransformed[Y * Size + X] = Metatile[SourceY * Size + SourceX] ^ FlipBits;
+		}
+	}
+}
+
+s32 CompareMetatiles(u16* A, u16* B, u32 Size)
+{
+	for (u32 CellIndex = 0; CellIndex < Size * Size; CellIndex++)
+	{
+		if (A[CellIndex] != B[CellIndex])
+		{
+			return A[CellIndex] < B[CellIndex] ? -1 : 1;
+		}
+	}
+	return 0;
+}
+
+// OutCanonical gets the smallest flip of Metatile; returns the flip that takes Metatile to it
+u32 CanonicaliseMetatile(u16* Metatile, u16* OutCanonical, u32 Size)
+{
+	u32 Result = TileTransform_Unchanged;
+	memcpy(OutCanonical, Metatile, sizeof(u16) * Size * Size);
+	for (u32 Transform = TileTransform_HFlip; Transform < TileTransform_Count; Transform++)
+	{
+		u16 Variant[GBA_MAX_METATILE_SIZE * GBA_MAX_METATILE_SIZE];
+		CopyTransformedMetatile(Metatile, Variant, Size, Transform);
+		if (CompareMetatiles(Variant, OutCanonical, Size) < 0)
+		{
+			memcpy(OutCanonical, Variant, sizeof(u16) * Size * Size);
+			Result = Transform;
+		}
+	}
+	return Result;
+}
+
+u32 HashMetatile(u16* Metatile, u32 Size)
+{
+	u64 Hash = 14695981039346656037ull;
+	for (u32 CellIndex = 0; CellIndex < Size * Size; CellIndex++)
+	{
+		Hash ^= Metatile[CellIndex];
+		Hash *= 1099511628211ull;
+	}
+	u32 Result = (u32)(Hash ^ (Hash >> 32));
+	return Result;
+}
+
+// Returns the metatile entry (index and flips) for the metatile, adding it to the table if it's new
+u32 AddMetatile(metatile_table* Table, u16* Metatile, memory_arena* Arena)
+{
+	u32 Size = Table->Size;
+	u32 NumCells = Size * Size;
+	u16 Canonical[GBA_MAX_METATILE_SIZE * GBA_MAX_METATILE_SIZE];
+	u32 CanonicalTransform = CanonicaliseMetatile(Metatile, Canonical, Size);
+	u32 Hash = HashMetatile(Canonical, Size);
+
+	tile_hash_table* HashTable = &Table->HashTable;
+	u32 Mask = HashTable->Capacity - 1;
+	for (u32 Slot = Hash & Mask; HashTable->Entries[Slot].UniqueTileIndex; Slot = (Slot + 1) & Mask)
+	{
+		tile_hash_entry* Entry = HashTable->Entries + Slot;
+		u32 MetatileIndex = Entry->UniqueTileIndex - 1;
+		if (Entry->Hash != Hash)
+		{
+			continue;
+		}
+
+		// Stored metatiles are kept as they were found, so they're canonicalised again to compare
+		u16 Existing[GBA_MAX_METATILE_SIZE * GBA_MAX_METATILE_SIZE];
+		u8 ExistingTransform = Table->CanonicalTransforms[MetatileIndex];
+		CopyTransformedMetatile(Table->Entries + MetatileIndex * NumCells, Existing, Size, ExistingTransform);
+		if (CompareMetatiles(Existing, Canonical, Size) == 0)
+		{
+			// Flips compose by XOR: from the stored metatile to the canonical one, then on to this one
+			u32 Transform = CanonicalTransform ^ ExistingTransform;
+			u32 Result = MetatileIndex | ((Transform & TileTransform_HFlip) ? GBA_METATILE_HFLIP : 0) |
+			             ((Transform & TileTransform_VFlip) ? GBA_METATILE_VFLIP : 0);
+			return Result;
+		}
+	}
+
+	u32 Result = Table->NumMetatiles++;
+	memcpy(Table->Entries + Result * NumCells, Metatile, sizeof(u16) * NumCells);
+	Table->CanonicalTransforms[Result] = (u8)CanonicalTransform;
+	InsertUniqueTile(Arena, HashTable, Hash, Result);
+	return Result;
+}
+
+// Replaces every layer's screen entries with metatile entries (index | hflip << 14 | vflip << 15), and fills OutTable
+// with the screen entries of every metatile. Cells past the right or bottom edge of a layer are empty (screen entry 0).
+// Returns false if there are more metatiles than their entries can refer to.
+b32 BuildGbaMetatiles(gba_array* Layers, u32 NumLayers, u32 Size, memory_arena* Arena, gba_array* OutTable,
+                      u32* OutNumMetatiles)
+{
+	u32 MaxMetatiles = 0;
+	for (u32 LayerIndex = 0; LayerIndex < NumLayers; LayerIndex++)
+	{
+		gba_array* Layer = Layers + LayerIndex;
+		MaxMetatiles += ((Layer->Width + Size - 1) / Size) * ((Layer->Height + Size - 1) / Size);
+	}
+
+	metatile_table Table = {};
+	Table.Size = Size;
+	Table.Entries = PushArray(Arena, (u64)MaxMetatiles * Size * Size, u16);
+	Table.CanonicalTransforms = PushArray(Arena, MaxMetatiles, u8);
+	Table.HashTable = CreateTileHashTable(Arena, MaxMetatiles < 4096 ? MaxMetatiles : 4096);
+	for (u32 LayerIndex = 0; LayerIndex < NumLayers; LayerIndex++)
+	{
+		gba_array* Layer = Layers + LayerIndex;
+		u32 Width = (Layer->Width + Size - 1) / Size;
+		u32 Height = (Layer->Height + Size - 1) / Size;
+		u8* Data = PushArray(Arena, Width * Height * 2, u8);
+		for (u32 MetaY = 0; MetaY < Height; MetaY++)
+		{
+			for (u32 MetaX = 0; MetaX < Width; MetaX++)
+			{
+				u16 Metatile[GBA_MAX_METATILE_SIZE * GBA_MAX_METATILE_SIZE];
+				for (u32 Y = 0; Y < Size; Y++)
+				{
+					for (u32 X = 0; X < Size; X++)
+					{
+						u32 CellX = MetaX * Size + X;
+						u32 CellY = MetaY * Size + Y;
+						b32 IsInside = CellX < Layer->Width && CellY < Layer->Height;
+						Metatile[Y * Size + X] = IsInside ? (u16)LoadGbaElement(Layer, (CellY * Layer->Width + CellX) * 2) : 0;
+					}
+				}
+				StoreU16(Data + (MetaY * Width + MetaX) * 2, (u16)AddMetatile(&Table, Metatile, Arena));
+			}
+		}
+
+		Layer->Data = Data;
+		Layer->Size = Width * Height * 2;
+		Layer->Width = Width;
+		Layer->Height = Height;
+	}
+
+	OutTable->Data = PushArray(Arena, Table.NumMetatiles * Size * Size * 2, u8);
+	OutTable->Size = Table.NumMetatiles * Size * Size * 2;
+	OutTable->ElementSize = 2;
+	for (u32 CellIndex = 0; CellIndex < Table.NumMetatiles * Size * Size; CellIndex++)
+	{
+		StoreU16(OutTable->Data + CellIndex * 2, Table.Entries[CellIndex]);
+	}
+	*OutNumMetatiles = Table.NumMetatiles;
+	return Table.NumMetatiles <= GBA_MAX_METATILES;
+}
+
+// --vram-fit: folds the NumToMerge least-used GBA tiles into whichever of the others, in any flip, looks most like them
+// (by their colours, so tiles in different banks can be told apart). OutMergedInto gets the tile each one is now shown
+// as, or -1 if it's kept, and OutMergeTransforms the flip to show it with. Returns how many cells show a different tile.
+u32 MergeLeastUsedTiles(tile* SourceTiles, u32* GbaSourceTiles, u32* TileUsage, u32 NumGbaTiles, u32 NumToMerge,
+                        memory_arena* Arena, s32* OutMergedInto, u8* OutMergeTransforms)
+{
+	// Later tiles go first when they're used as much, so the tiles at the start stay where they were
+	u32* Order = PushArray(Arena, NumGbaTiles, u32);
+	for (u32 GbaTileIndex = 0; GbaTileIndex < NumGbaTiles; GbaTileIndex++)
+	{
+		Order[GbaTileIndex] = GbaTileIndex;
+	}
+	std::sort(Order, Order + NumGbaTiles, [TileUsage](u32 A, u32 B)
+	{
+		return TileUsage[A] < TileUsage[B] || (TileUsage[A] == TileUsage[B] && A > B);
+	});
+
+	u16 (*Colours)[64] = (u16 (*)[64])PushSize(Arena, sizeof(u16) * 64 * (u64)NumGbaTiles);
+	for (u32 GbaTileIndex = 0; GbaTileIndex < NumGbaTiles; GbaTileIndex++)
+	{
+		tile* Tile = SourceTiles + GbaSourceTiles[GbaTileIndex];
+		for (u32 PixelIndex = 0; PixelIndex < 64; PixelIndex++)
+		{
+			Colours[GbaTileIndex][PixelIndex] = GetGbaColour(Tile->Pixels[PixelIndex]);
+		}
+	}
+	for (u32 OrderIndex = 0; OrderIndex < NumToMerge; OrderIndex++)
+	{
+		OutMergedInto[Order[OrderIndex]] = 0; // Taken out of the running before any of them are matched
+	}
+
+	u32 Result = 0;
+	for (u32 OrderIndex = 0; OrderIndex < NumToMerge; OrderIndex++)
+	{
+		u32 MergedTile = Order[OrderIndex];
+
+		// Flips are their own inverse, so flipping this tile to match another is the same as flipping the other to match it
+		u16 Variants[TileTransform_Count][64];
+		for (u32 Transform = 0; Transform < TileTransform_Count; Transform++)
+		{
+			for (u32 Y = 0; Y < 8; Y++)
+			{
+				for (u32 X = 0; X < 8; X++)
+				{
+					u32 SourceX = (Transform & TileTransform_HFlip) ? 7 - X : X;
+					u32 SourceY = (Transform & TileTransform_VFlip) ? 7 - Y : Y;
+					Variants[Transform][Y * 8 + X] = Colours[MergedTile][SourceY * 8 + SourceX];
+				}
+			}
+		}
+
+		u32 BestDistance = 0xFFFFFFFF;
+		for (u32 OtherTile = 0; OtherTile < NumGbaTiles; OtherTile++)
+		{
+			if (OutMergedInto[OtherTile] >= 0)
+			{
+				continue;
+			}
+			for (u32 Transform = 0; Transform < TileTransform_Count; Transform++)
+			{
+				u32 Distance = 0;
+				for (u32 PixelIndex = 0; PixelIndex < 64 && Distance < BestDistance; PixelIndex++)
+				{
+					Distance += GetColourDistance(Variants[Transform][PixelIndex], Colours[OtherTile][PixelIndex]);
+				}
+				if (Distance < BestDistance)
+				{
+					BestDistance = Distance;
+					OutMergedInto[MergedTile] = (s32)OtherTile;
+					OutMergeTransforms[MergedTile] = (u8)Transform;
+				}
+			}
+		}
+		Result += TileUsage[MergedTile];
+	}
+	return Result;
+}
+
+// Map->Layers must still hold the map's original GIDs, i.e. this has to happen before they're remapped
+b32 ExportGbaMap(map_job* Map, tileset_job* Jobs, smint_settings* Settings)
+{
+	u32 BitsPerPixel = Settings->GbaBitsPerPixel;
+	u32 Formats = Settings->GbaFormats ? Settings->GbaFormats : SMINT_GBA_BIN;
+	u32 VramBudget = Settings->GbaVramBudget;
+	b32 FitVramBudget = Settings->GbaFitVramBudget;
+	u32 MetatileSize = Settings->GbaMetatileSize;
+	if (BitsPerPixel != 4 && BitsPerPixel != 8)
+	{
+		LogError("ERROR: GBA tiles must be 4 or 8 bits per pixel, not %u.\n", BitsPerPixel);
+		return false;
+	}
+	if (MetatileSize == 1 || MetatileSize > GBA_MAX_METATILE_SIZE)
+	{
+		LogError("ERROR: Metatiles must be from 2 to %u cells across, not %u.\n", GBA_MAX_METATILE_SIZE, MetatileSize);
+		return false;
+	}
+	if (!Map->Layers)
+	{
+		LogError("ERROR: GBA data can't be exported from maps that are streamed.\n");
+		return false;
+	}
+
+	stage_timer ExportTimer = BeginStage(Stage_ExportGba);
+	temp_memory ExportMemory = BeginTemporaryMemory(&Map->Arena);
+	memory_arena* Arena = &Map->Arena;
+	b32 Result = true;
+
+	json_value& Layers = *Map->Layers;
+	u32 NumLayers = Layers.Size();
+	gba_layer* GbaLayers = PushArrayZero(Arena, NumLayers, gba_layer);
+	Result = ReadGbaLayers(Layers, *Map->JsonDoc, Arena, GbaLayers);
+
+	// Every tileset's unique tiles follow on from the previous tileset's, after the blank tile if there is one
+	u32 NumGids = 1;
+	for (u32 TilesetIndex = 0; TilesetIndex < Map->NumTilesets; TilesetIndex++)
+	{
+		map_tileset_ref* Tileset = Map->Tilesets + TilesetIndex;
+		u32 EndGid = Tileset->FirstTileId + Jobs[Tileset->JobIndex].NumTiles;
+		NumGids = EndGid > NumGids ? EndGid : NumGids;
+	}
+	b32 HasEmptyCells = false;
+	for (u32 LayerIndex = 0; LayerIndex < NumLayers && Result && !HasEmptyCells; LayerIndex++)
+	{
+		gba_layer* Layer = GbaLayers + LayerIndex;
+		for (u32 DataIndex = 0; DataIndex < Layer->Count && !HasEmptyCells; DataIndex++)
+		{
+			u32 Gid = Layer->Entries[DataIndex] & ~TILED_FLAGS_MASK;
+			HasEmptyCells = Gid == 0 || Gid >= NumGids;
+		}
+
+		// Metatiles that hang over the edge of the layer are filled out with empty cells
+		HasEmptyCells = HasEmptyCells || (MetatileSize && (Layer->Width % MetatileSize || Layer->Height % MetatileSize));
+	}
+
+	// The unique tiles of every tileset, one after the other
+	u32* TilesetBases = PushArray(Arena, Map->NumTilesets, u32);
+	u32 NumSourceTiles = 0;
+	for (u32 TilesetIndex = 0; TilesetIndex < Map->NumTilesets; TilesetIndex++)
+	{
+		TilesetBases[TilesetIndex] = NumSourceTiles;
+		NumSourceTiles += Jobs[Map->Tilesets[TilesetIndex].JobIndex].MinTiles.NumUniqueTiles;
+	}
+	tile* SourceTiles = PushArray(Arena, NumSourceTiles, tile);
+	for (u32 TilesetIndex = 0; TilesetIndex < Map->NumTilesets; TilesetIndex++)
+	{
+		minimised_tileset* MinTiles = &Jobs[Map->Tilesets[TilesetIndex].JobIndex].MinTiles;
+		for (u32 UniqueTileIndex = 0; UniqueTileIndex < MinTiles->NumUniqueTiles; UniqueTileIndex++)
+		{
+			GetOriginalTile(MinTiles->MinimisedTiles + UniqueTileIndex, SourceTiles + TilesetBases[TilesetIndex] + UniqueTileIndex);
+		}
+	}
+
+	// Colour index 0 is the top-left pixel of the first tileset's image, as grit does it. Fully transparent pixels are
+	// transparent whatever their RGB, so they become that colour too.
+	pixel TransparentPixel = Map->NumTilesets ? Jobs[Map->Tilesets[0].JobIndex].MinTiles.KeyPixel : pixel{};
+	for (u32 SourceTileIndex = 0; SourceTileIndex < NumSourceTiles; SourceTileIndex++)
+	{
+		tile* Tile = SourceTiles + SourceTileIndex;
+		for (u32 PixelIndex = 0; PixelIndex < ArrayCount(Tile->Pixels); PixelIndex++)
+		{
+			if (Tile->Pixels[PixelIndex].A == 0)
+			{
+				Tile->Pixels[PixelIndex] = TransparentPixel;
+			}
+		}
+	}
+
+	// At 4bpp, every tile gets one of up to 16 palette banks; at 8bpp they all share one palette
+	indexed_tile* IndexedTiles = PushArray(Arena, NumSourceTiles, indexed_tile);
+	u8* TileBanks = PushArrayZero(Arena, NumSourceTiles, u8);
+	palette_banks* Banks = PushStruct(Arena, palette_banks);
+	gba_palette Palette = {};
+	if (BitsPerPixel == 4)
+	{
+		QuantiseToPaletteBanks(SourceTiles, NumSourceTiles, GetGbaColour(TransparentPixel), Arena, Banks, TileBanks, IndexedTiles);
+	}
+	else
+	{
+		Palette.MaxColours = 256;
+		Palette.Lookup = PushArrayZero(Arena, 32768, u16);
+		GetGbaPaletteIndex(&Palette, TransparentPixel);
+		for (u32 SourceTileIndex = 0; SourceTileIndex < NumSourceTiles; SourceTileIndex++)
+		{
+			IndexGbaTile(&Palette, SourceTiles + SourceTileIndex, IndexedTiles + SourceTileIndex);
+		}
+		if (Palette.IsFull)
+		{
+			LogError("ERROR: Map '%s' has more than %u colours, which is too many for 8bpp tiles.\n", Map->BaseName,
+			         Palette.MaxColours);
+			Result = false;
+		}
+	}
+
+	// Deduplicate again on the indexed tiles: tiles whose colours only differed before being converted to BGR555, or that
+	// only differ in their palette bank, become one
+	indexed_tile* CanonicalTiles = PushArray(Arena, NumSourceTiles, indexed_tile);
+	u8* CanonicalTransforms = PushArray(Arena, NumSourceTiles, u8);
+	u32* GbaTileIndices = PushArray(Arena, NumSourceTiles, u32);
+	u32* GbaSourceTiles = PushArray(Arena, NumSourceTiles, u32); // First source tile of each GBA tile
+	u32 NumGbaTiles = 0;
+	tile_hash_table HashTable = CreateTileHashTable(Arena, NumSourceTiles < 4096 ? NumSourceTiles : 4096);
+	for (u32 SourceTileIndex = 0; SourceTileIndex < NumSourceTiles && Result; SourceTileIndex++)
+	{
+		tile_key Key;
+		CanonicaliseIndexedTile(IndexedTiles + SourceTileIndex, BitsPerPixel, CanonicalTiles + SourceTileIndex, &Key);
+		CanonicalTransforms[SourceTileIndex] = (u8)Key.CanonicalTransform;
+		s32 GbaTileIndex = FindIndexedUniqueTile(&HashTable, CanonicalTiles, GbaSourceTiles, CanonicalTiles + SourceTileIndex,
+		                                         Key.Hash, BitsPerPixel);
+		if (GbaTileIndex < 0)
+		{
+			GbaSourceTiles[NumGbaTiles] = SourceTileIndex;
+			InsertUniqueTile(Arena, &HashTable, Key.Hash, NumGbaTiles);
+			GbaTileIndex = (s32)NumGbaTiles++;
+		}
+		GbaTileIndices[SourceTileIndex] = (u32)GbaTileIndex;
+	}
+
+	// The GBA tile, flips (on top of the GBA tile's own) and bank of every GID
+	s32* GidGbaTiles = PushArray(Arena, NumGids, s32);
+	u8* GidTransforms = PushArrayZero(Arena, NumGids, u8);
+	u8* GidBanks = PushArrayZero(Arena, NumGids, u8);
+	for (u32 Gid = 0; Gid < NumGids; Gid++)
+	{
+		GidGbaTiles[Gid] = -1;
+	}
+	for (u32 TilesetIndex = 0; TilesetIndex < Map->NumTilesets && Result; TilesetIndex++)
+	{
+		map_tileset_ref* Tileset = Map->Tilesets + TilesetIndex;
+		tileset_job* Job = Jobs + Tileset->JobIndex;
+		minimised_tileset* MinTiles = &Job->MinTiles;
+		for (u32 TileIndex = 0; TileIndex < Job->NumTiles; TileIndex++)
+		{
+			tile_mapping* Mapping = MinTiles->Mappings + TileIndex;
+			if (!Mapping->EquivalentUniqueTile)
+			{
+				continue; // Not used by any map
+			}
+
+			// Flips compose by XOR, so this takes the GBA tile to its unique tile and then on to this tile
+			u32 SourceTileIndex = TilesetBases[TilesetIndex] + (u32)(Mapping->EquivalentUniqueTile - MinTiles->MinimisedTiles);
+			u32 GbaTileIndex = GbaTileIndices[SourceTileIndex];
+			u32 Gid = Tileset->FirstTileId + TileIndex;
+			GidGbaTiles[Gid] = (s32)GbaTileIndex;
+			GidTransforms[Gid] = (u8)(Mapping->EqualAfterTransform ^ CanonicalTransforms[SourceTileIndex] ^
+			                          CanonicalTransforms[GbaSourceTiles[GbaTileIndex]]);
+			GidBanks[Gid] = TileBanks[SourceTileIndex];
+		}
+	}
+
+	// Every GBA tile is laid out as the first source tile that became it, after the blank tile if there is one
+	u32 FirstGbaTile = HasEmptyCells ? 1 : 0;
+	u32 NumTiles = FirstGbaTile + NumGbaTiles;
+	s32* MergedInto = PushArray(Arena, NumGbaTiles, s32);
+	u8* MergeTransforms = PushArrayZero(Arena, NumGbaTiles, u8);
+	for (u32 GbaTileIndex = 0; GbaTileIndex < NumGbaTiles; GbaTileIndex++)
+	{
+		MergedInto[GbaTileIndex] = -1;
+	}
+	if (Result && VramBudget)
+	{
+		u32 TilesPerCharblock = BitsPerPixel == 4 ? GBA_CHARBLOCK_TILES_4BPP : GBA_CHARBLOCK_TILES_8BPP;
+		u32 BudgetTiles = VramBudget * TilesPerCharblock;
+		BudgetTiles = BudgetTiles < GBA_MAX_TILES ? BudgetTiles : GBA_MAX_TILES;
+		u32 NumCharblocks = (NumTiles + TilesPerCharblock - 1) / TilesPerCharblock;
+		LogInfo("VRAM for map '%s': %u %ubpp tiles fill %u charblocks (%u tiles free in the last), against a budget of %u "
+		        "tiles in %u charblocks.\n", Map->BaseName, NumTiles, BitsPerPixel, NumCharblocks,
+		        NumCharblocks * TilesPerCharblock - NumTiles, BudgetTiles, VramBudget);
+
+		if (NumTiles > BudgetTiles && !FitVramBudget)
+		{
+			LogError("ERROR: Map '%s' is %u tiles over its VRAM budget (use --vram-fit to merge the least-used tiles into "
+			         "others until it fits).\n", Map->BaseName, NumTiles - BudgetTiles);
+			Result = false;
+		}
+		else if (NumTiles > BudgetTiles)
+		{
+			if (BudgetTiles <= FirstGbaTile)
+			{
+				LogError("ERROR: Map '%s' has no room in its VRAM budget for any tiles besides the blank one.\n", Map->BaseName);
+				Result = false;
+			}
+			else
+			{
+				// How many cells each GBA tile shows up in, so the ones that are hardly used are the ones to go
+				u32* TileUsage = PushArrayZero(Arena, NumGbaTiles, u32);
+				for (u32 LayerIndex = 0; LayerIndex < NumLayers; LayerIndex++)
+				{
+					gba_layer* Layer = GbaLayers + LayerIndex;
+					for (u32 DataIndex = 0; DataIndex < Layer->Count; DataIndex++)
+					{
+						u32 Gid = Layer->Entries[DataIndex] & ~TILED_FLAGS_MASK;
+						if (Gid < NumGids && GidGbaTiles[Gid] >= 0)
+						{
+							TileUsage[GidGbaTiles[Gid]]++;
+						}
+					}
+				}
+
+				u32 NumToMerge = NumTiles - BudgetTiles;
+				u32 NumCellsChanged = MergeLeastUsedTiles(SourceTiles, GbaSourceTiles, TileUsage, NumGbaTiles, NumToMerge,
+				                                          Arena, MergedInto, MergeTransforms);
+				NumTiles -= NumToMerge;
+				LogInfo("WARNING: Merged the %u least-used tiles of map '%s' into the ones that look most like them to fit its VRAM "
+				        "budget, changing %u cells.\n", NumToMerge, Map->BaseName, NumCellsChanged);
+			}
+		}
+	}
+	if (Result && NumTiles > GBA_MAX_TILES)
+	{
+		LogError("ERROR: Map '%s' needs %u tiles, but GBA screen entries can only refer to %u.\n", Map->BaseName, NumTiles,
+		         GBA_MAX_TILES);
+		Result = false;
+	}
+
+	// Merged tiles leave no gaps behind
+	u32* FinalTileIndices = PushArray(Arena, NumGbaTiles, u32);
+	u32 NextTileIndex = FirstGbaTile;
+	for (u32 GbaTileIndex = 0; GbaTileIndex < NumGbaTiles; GbaTileIndex++)
+	{
+		FinalTileIndices[GbaTileIndex] = MergedInto[GbaTileIndex] < 0 ? NextTileIndex++ : 0;
+	}
+
+	u32 TileSize = BitsPerPixel * 8;
+	u8* TileData = PushArrayZero(Arena, NumTiles * TileSize, u8);
+	for (u32 GbaTileIndex = 0; GbaTileIndex < NumGbaTiles && Result; GbaTileIndex++)
+	{
+		if (MergedInto[GbaTileIndex] >= 0)
+		{
+			continue;
+		}
+		u8* Source = IndexedTiles[GbaSourceTiles[GbaTileIndex]].Data;
+		u8* Dest = TileData + FinalTileIndices[GbaTileIndex] * TileSize;
+		for (u32 ByteIndex = 0; ByteIndex < TileSize; ByteIndex++)
+		{
+			// Indexed tiles keep the left pixel of each pair in the high nibble, but the GBA wants it in the low one
+			Dest[ByteIndex] = BitsPerPixel == 4 ? (u8)((Source[ByteIndex] >> 4) | (Source[ByteIndex] << 4)) : Source[ByteIndex];
+		}
+	}
+
+	// Screen entry (without flips from the map itself) of every GID
+	u16* ScreenEntries = PushArrayZero(Arena, NumGids, u16);
+	for (u32 Gid = 0; Gid < NumGids && Result; Gid++)
+	{
+		if (GidGbaTiles[Gid] < 0)
+		{
+			continue;
+		}
+		u32 GbaTileIndex = (u32)GidGbaTiles[Gid];
+		u32 Transform = GidTransforms[Gid];
+		u32 Bank = GidBanks[Gid];
+		if (MergedInto[GbaTileIndex] >= 0)
+		{
+			// Shown with the bank of the tile it was merged into, since that's the bank its colours are in
+			Transform ^= MergeTransforms[GbaTileIndex];
+			GbaTileIndex = (u32)MergedInto[GbaTileIndex];
+			Bank = TileBanks[GbaSourceTiles[GbaTileIndex]];
+		}
+
+		u32 Entry = FinalTileIndices[GbaTileIndex] | (Bank << GBA_SCREEN_BANK_SHIFT);
+		if (Transform == TileTransform_HFlip || Transform == TileTransform_DiagonalFlip)
+		{
+			Entry |= GBA_SCREEN_HFLIP;
+		}
+		if (Transform == TileTransform_VFlip || Transform == TileTransform_DiagonalFlip)
+		{
+			Entry |= GBA_SCREEN_VFLIP;
+		}
+		ScreenEntries[Gid] = (u16)Entry;
+	}
+
+	// Palette, tiles, then one array per layer, then the metatiles if there are any
+	u32 NumArrays = MetatileSize ? 3 + NumLayers : 2 + NumLayers;
+	gba_array* Arrays = PushArrayZero(Arena, NumArrays, gba_array);
+	char (*LayerSuffixes)[32] = (char (*)[32])PushSize(Arena, 32 * (u64)NumLayers);
+	if (Result)
+	{
+		// At 4bpp, each bank takes up 16 colours whether it uses them all or not
+		u32 NumPaletteColours = BitsPerPixel == 4 ? Banks->NumBanks * GBA_BANK_COLOURS : Palette.NumColours;
+		Arrays[0].Suffix = "pal";
+		Arrays[0].Size = NumPaletteColours * 2;
+		Arrays[0].Data = PushArrayZero(Arena, Arrays[0].Size, u8);
+		Arrays[0].ElementSize = 2;
+		if (BitsPerPixel == 4)
+		{
+			for (u32 BankIndex = 0; BankIndex < Banks->NumBanks; BankIndex++)
+			{
+				for (u32 ColourIndex = 0; ColourIndex < Banks->NumColours[BankIndex]; ColourIndex++)
+				{
+					StoreU16(Arrays[0].Data + (BankIndex * GBA_BANK_COLOURS + ColourIndex) * 2, Banks->Colours[BankIndex][ColourIndex]);
+				}
+			}
+		}
+		else
+		{
+			for (u32 ColourIndex = 0; ColourIndex < Palette.NumColours; ColourIndex++)
+			{
+				StoreU16(Arrays[0].Data + ColourIndex * 2, Palette.Colours[ColourIndex]);
+			}
+		}
+
+		Arrays[1].Suffix = "tiles";
+		Arrays[1].Data = TileData;
+		Arrays[1].Size = NumTiles * TileSize;
+		Arrays[1].ElementSize = 4;
+		for (u32 LayerIndex = 0; LayerIndex < NumLayers; LayerIndex++)
+		{
+			gba_layer* Layer = GbaLayers + LayerIndex;
+			gba_array* Array = Arrays + 2 + LayerIndex;
+			snprintf(LayerSuffixes[LayerIndex], sizeof(LayerSuffixes[LayerIndex]), "layer%u", LayerIndex);
+			Array->Suffix = LayerSuffixes[LayerIndex];
+			Array->Size = Layer->Count * 2;
+			Array->Data = PushArray(Arena, Array->Size, u8);
+			Array->ElementSize = 2;
+			Array->Width = Layer->Width;
+			Array->Height = Layer->Height;
+			for (u32 DataIndex = 0; DataIndex < Layer->Count; DataIndex++)
+			{
+				u32 TileIndex = Layer->Entries[DataIndex];
+				u32 Gid = TileIndex & ~TILED_FLAGS_MASK;
+				u16 Entry = Gid < NumGids ? ScreenEntries[Gid] : 0;
+				if (Gid && Gid < NumGids)
+				{
+					// Same flip handling as RemapTileEntry, which has already warned about rotations
+					if (TileIndex & (TiledFlag_HFlip | TiledFlag_DiagonalFlip))
+					{
+						Entry ^= GBA_SCREEN_HFLIP;
+					}
+					if (TileIndex & (TiledFlag_VFlip | TiledFlag_DiagonalFlip))
+					{
+						Entry ^= GBA_SCREEN_VFLIP;
+					}
+				}
+				StoreU16(Array->Data + DataIndex * 2, Entry);
+			}
+		}
+	}
+
+	u32 NumMetatiles = 0;
+	if (Result && MetatileSize)
+	{
+		gba_array* Table = Arrays + 2 + NumLayers;
+		Table->Suffix = "metatiles";
+		if (!BuildGbaMetatiles(Arrays + 2, NumLayers, MetatileSize, Arena, Table, &NumMetatiles))
+		{
+			LogError("ERROR: Map '%s' needs %u metatiles, but metatile entries can only refer to %u.\n", Map->BaseName,
+			         NumMetatiles, GBA_MAX_METATILES);
+			Result = false;
+		}
+		for (u32 LayerIndex = 0; LayerIndex < NumLayers; LayerIndex++)
+		{
+			snprintf(LayerSuffixes[LayerIndex], sizeof(LayerSuffixes[LayerIndex]), "layer%u_meta", LayerIndex);
+		}
+	}
+
+	char OutBase[MAX_PATH];
+	StripFileExtension(Map->FilePath, OutBase);
+	char Identifier[MAX_PATH];
+	char BaseName[MAX_PATH];
+	StripFileExtension(Map->BaseName, BaseName);
+	MakeGbaIdentifier(BaseName, Identifier);
+	if (Result && (Formats & SMINT_GBA_BIN))
+	{
+		for (u32 ArrayIndex = 0; ArrayIndex < NumArrays && Result; ArrayIndex++)
+		{
+			char FilePath[MAX_PATH];
+			Result = MakeGbaFilePath(OutBase, Arrays[ArrayIndex].Suffix, "bin", FilePath) &&
+			         WriteBinaryFile(FilePath, Arrays[ArrayIndex].Data, Arrays[ArrayIndex].Size);
+		}
+	}
+	if (Result && (Formats & (SMINT_GBA_C | SMINT_GBA_ASM)))
+	{
+		Result = WriteGbaHeader(OutBase, Identifier, Map->BaseName, Arrays, NumArrays);
+	}
+	if (Result && (Formats & SMINT_GBA_C))
+	{
+		Result = WriteGbaSource(OutBase, Identifier, Map->BaseName, Arrays, NumArrays, false);
+	}
+	if (Result && (Formats & SMINT_GBA_ASM))
+	{
+		Result = WriteGbaSource(OutBase, Identifier, Map->BaseName, Arrays, NumArrays, true);
+	}
+	if (Result)
+	{
+		if (BitsPerPixel == 4)
+		{
+			u32 NumBankColours = 0;
+			for (u32 BankIndex = 0; BankIndex < Banks->NumBanks; BankIndex++)
+			{
+				NumBankColours += Banks->NumColours[BankIndex] - 1;
+			}
+			LogInfo("Wrote GBA data for map '%s': %u 4bpp tiles, %u layers, %u of %u palette banks (%u of %u colours).\n",
+			        Map->BaseName, NumTiles, NumLayers, Banks->NumBanks, GBA_MAX_BANKS, NumBankColours,
+			        GBA_MAX_BANKS * (GBA_BANK_COLOURS - 1));
+			if (Banks->NumApproximatedTiles)
+			{
+				LogInfo("WARNING: %u of the tiles in map '%s' don't fit in any palette bank, so some of their colours have been "
+				        "replaced by the nearest ones in their bank.\n", Banks->NumApproximatedTiles, Map->BaseName);
+			}
+		}
+		else
+		{
+			LogInfo("Wrote GBA data for map '%s': %u 8bpp tiles, %u layers, %u colours.\n", Map->BaseName, NumTiles, NumLayers,
+			        Palette.NumColours);
+		}
+		if (MetatileSize)
+		{
+			u32 NumCells = 0;
+			u32 MetatileBytes = Arrays[2 + NumLayers].Size;
+			for (u32 LayerIndex = 0; LayerIndex < NumLayers; LayerIndex++)
+			{
+				NumCells += GbaLayers[LayerIndex].Count;
+				MetatileBytes += Arrays[2 + LayerIndex].Size;
+			}
+			LogInfo("Layers stored as %u unique %ux%u metatiles: %u bytes of map data (with the metatiles) instead of %u.\n",
+			        NumMetatiles, MetatileSize, MetatileSize, MetatileBytes, NumCells * 2);
+		}
+		if (NumGbaTiles < NumSourceTiles)
+		{
+			LogInfo("%u more duplicate tiles were found once converted, across tilesets or palette banks.\n",
+			        NumSourceTiles - NumGbaTiles);
+		}
+	}
+
+	EndTemporaryMemory(ExportMemory);
+	EndStage(&ExportTimer);
+	return Result;
+}
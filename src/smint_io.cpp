@@ -1,5 +1,13 @@
 #include <sys/stat.h>
+#if _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#endif
 #include <cstdlib>
+#include <cstdarg>
 
 #ifndef MAX_PATH
 #define MAX_PATH 260
@@ -11,7 +19,141 @@ struct str_buffer
 	u64 Size;
 };
 
-str_buffer ReadTextFile(const char* FileName)
+// Messages produced while processing a tileset on a worker thread are held here, then flushed in tileset order so the
+// console output is the same no matter how many jobs are running
+struct message_log
+{
+	char* Data; // Sequence of records: one byte (1 if stderr, 0 if stdout) followed by NUL-terminated text
+	u64 Size;
+	u64 Capacity;
+};
+
+static thread_local message_log* ThreadMessageLog;
+
+// Where messages end up once they're ready to be shown: the log callback of whichever context the current thread is
+// working for, or stdout/stderr if there's none
+struct log_sink
+{
+	smint_log_func* Callback;
+	void* UserData;
+};
+
+static thread_local log_sink* ThreadLogSink;
+
+void EmitLogMessage(b32 IsError, const char* Text)
+{
+	log_sink* Sink = ThreadLogSink;
+	if (Sink && Sink->Callback)
+	{
+		Sink->Callback(Sink->UserData, IsError, Text);
+	}
+	else
+	{
+		fputs(Text, IsError ? stderr : stdout);
+	}
+}
+
+void LogMessageV(FILE* Stream, const char* Format, va_list Args)
+{
+	message_log* Log = ThreadMessageLog;
+	if (!Log && !(ThreadLogSink && ThreadLogSink->Callback))
+	{
+		vfprintf(Stream, Format, Args);
+		return;
+	}
+
+	va_list ArgsCopy;
+	va_copy(ArgsCopy, Args);
+	s32 Length = vsnprintf(nullptr, 0, Format, ArgsCopy);
+	va_end(ArgsCopy);
+	if (Length < 0)
+	{
+		return;
+	}
+
+	if (!Log)
+	{
+		char SmallText[512];
+		char* Text = Length < (s32)sizeof(SmallText) ? SmallText : (char*)TrackedMalloc((u64)Length + 1);
+		vsnprintf(Text, Length + 1, Format, Args);
+		EmitLogMessage(Stream == stderr, Text);
+		if (Text != SmallText)
+		{
+			TrackedFree(Text);
+		}
+		return;
+	}
+
+	u64 RecordSize = 1 + (u64)Length + 1;
+	if (Log->Size + RecordSize > Log->Capacity)
+	{
+		u64 NewCapacity = Log->Capacity ? Log->Capacity * 2 : 1024;
+		while (NewCapacity < Log->Size + RecordSize)
+		{
+			NewCapacity *= 2;
+		}
+		Log->Data = (char*)TrackedRealloc(Log->Data, NewCapacity);
+		Log->Capacity = NewCapacity;
+	}
+
+	Log->Data[Log->Size] = Stream == stderr;
+	vsnprintf(Log->Data + Log->Size + 1, Length + 1, Format, Args);
+	Log->Size += RecordSize;
+}
+
+// Appends records taken from another log (e.g. replayed from the cache)
+void AppendToMessageLog(message_log* Log, const char* Records, u64 Size)
+{
+	if (!Size)
+	{
+		return;
+	}
+	if (Log->Size + Size > Log->Capacity)
+	{
+		u64 NewCapacity = Log->Capacity ? Log->Capacity : 1024;
+		while (NewCapacity < Log->Size + Size)
+		{
+			NewCapacity *= 2;
+		}
+		Log->Data = (char*)TrackedRealloc(Log->Data, NewCapacity);
+		Log->Capacity = NewCapacity;
+	}
+	memcpy(Log->Data + Log->Size, Records, Size);
+	Log->Size += Size;
+}
+
+void LogInfo(const char* Format, ...)
+{
+	va_list Args;
+	va_start(Args, Format);
+	LogMessageV(stdout, Format, Args);
+	va_end(Args);
+}
+
+void LogError(const char* Format, ...)
+{
+	va_list Args;
+	va_start(Args, Format);
+	LogMessageV(stderr, Format, Args);
+	va_end(Args);
+}
+
+void FlushMessageLog(message_log* Log)
+{
+	u64 Offset = 0;
+	while (Offset < Log->Size)
+	{
+		char* Text = Log->Data + Offset + 1;
+		EmitLogMessage(Log->Data[Offset], Text);
+		Offset += 1 + strlen(Text) + 1;
+	}
+
+	TrackedFree(Log->Data);
+	*Log = {};
+}
+
+// The text is pushed onto Arena, so it goes whenever the arena (or the caller's temporary memory) does
+str_buffer ReadTextFile(const char* FileName, memory_arena* Arena)
 {
 	str_buffer Result = {};
     FILE* File = fopen(FileName, "rt");
@@ -25,15 +167,14 @@ str_buffer ReadTextFile(const char* FileName)
         stat(FileName, &Stat);
 		#endif
         
-        Result.Data = (char*)malloc(sizeof(char) * Stat.st_size + 1);
+        Result.Data = (char*)PushSize(Arena, sizeof(char) * Stat.st_size + 1);
 		Result.Size = Stat.st_size;
         if(Result.Data)
         {
 			size_t NumChars = fread(Result.Data, sizeof(char), Stat.st_size, File);
 			if (ferror(File))
 			{
-				fprintf(stderr, "ERROR: Unable to read '%s' into string buffer.\n", FileName);
-				free(Result.Data);
+				LogError("ERROR: Unable to read '%s' into string buffer.\n", FileName);
 				Result.Data = nullptr;
 			}
 			else
@@ -47,32 +188,80 @@ str_buffer ReadTextFile(const char* FileName)
     }
     else
     {
-        fprintf(stderr, "ERROR: Unable to open '%s' for reading.\n", FileName);
+        LogError("ERROR: Unable to open '%s' for reading.\n", FileName);
     }
     
     return Result;
 }
 
-bool WriteJsonToFile(rapidjson::Document* JsonDoc, char* FilePath, u32 SizeHint = 0)
+// Unlike ReadTextFile, missing files aren't reported, since callers (e.g. the cache) treat that as a normal case
+str_buffer ReadBinaryFile(const char* FileName)
+{
+	str_buffer Result = {};
+	FILE* File = fopen(FileName, "rb");
+	if (!File)
+	{
+		return Result;
+	}
+
+	fseek(File, 0, SEEK_END);
+	s64 Size = ftell(File);
+	fseek(File, 0, SEEK_SET);
+	if (Size >= 0)
+	{
+		Result.Data = (char*)TrackedMalloc((u64)Size + 1);
+		Result.Size = (u64)Size;
+		if (fread(Result.Data, 1, (size_t)Size, File) != (size_t)Size)
+		{
+			TrackedFree(Result.Data);
+			Result = {};
+		}
+		else
+		{
+			Result.Data[Size] = 0;
+		}
+	}
+	fclose(File);
+	return Result;
+}
+
+b32 WriteBinaryFile(const char* FileName, const void* Data, u64 Size)
+{
+	FILE* File = fopen(FileName, "wb");
+	if (!File)
+	{
+		LogError("ERROR: Failed to open file '%s' for writing.\n", FileName);
+		return false;
+	}
+	b32 Result = fwrite(Data, 1, Size, File) == Size;
+	Result = (fclose(File) == 0) && Result;
+	if (!Result)
+	{
+		LogError("ERROR: Failed to write to file '%s'.\n", FileName);
+	}
+	return Result;
+}
+
+bool WriteJsonToFile(json_document* JsonDoc, char* FilePath, u32 SizeHint = 0)
 {
 	rapidjson::StringBuffer OutStringBuffer(0, SizeHint);
 	rapidjson::Writer<rapidjson::StringBuffer> JsonWriter(OutStringBuffer);
 	if (!JsonDoc->Accept(JsonWriter))
 	{
-		fprintf(stderr, "ERROR: Failed to convert JSON document to string for file '%s'.\n", FilePath);
+		LogError("ERROR: Failed to convert JSON document to string for file '%s'.\n", FilePath);
 		return false;
 	}
 	
 	FILE* OutFile = fopen(FilePath, "wb");
 	if (!OutFile)
 	{
-		fprintf(stderr, "ERROR: Failed to open file '%s' for writing.\n", FilePath);
+		LogError("ERROR: Failed to open file '%s' for writing.\n", FilePath);
 		return false;
 	}
 
 	if (fprintf(OutFile, "%s", OutStringBuffer.GetString()) < 0)
 	{
-		fprintf(stderr, "ERROR: Failed to write to file '%s'.\n", FilePath);
+		LogError("ERROR: Failed to write to file '%s'.\n", FilePath);
 		return false;
 	}
 	fclose(OutFile);
@@ -80,42 +269,182 @@ bool WriteJsonToFile(rapidjson::Document* JsonDoc, char* FilePath, u32 SizeHint
 	return true;
 }
 
-#if _WIN32
-#include <Windows.h>
-bool ChangeWorkingDir(char* DirPath)
+// Like GetFullPath, but quietly falls back to the path as given (e.g. if the file doesn't exist)
+b32 TryGetFullPath(const char* RelPath, char* OutFullPath)
 {
-	if (!SetCurrentDirectory(DirPath))
+	char* Result;
+#if _WIN32
+	Result = _fullpath(OutFullPath, RelPath, MAX_PATH);
+#else
+	Result = realpath(RelPath, OutFullPath);
+#endif
+	if (!Result)
 	{
-		fprintf(stderr, "ERROR: Failed to change working directory to '%s'\n", DirPath);
-		return false;
+		strcpy(OutFullPath, RelPath);
 	}
-	return true;
+	return Result != nullptr;
 }
-#else
-#include <unistd.h>
-bool ChangeWorkingDir(char* DirPath)
+
+void GetFullPath(const char* RelPath, char* OutFullPath)
 {
-	if (chdir(DirPath) != 0)
+	if (!TryGetFullPath(RelPath, OutFullPath))
 	{
-		fprintf(stderr, "ERROR: Failed to change working directory to '%s'\n", DirPath);
-		return false;
+		LogError("Failed to get absolute path for '%s'\n.", RelPath);
 	}
-	return true;
 }
+
+// Does nothing if it already exists
+void MakeDirectory(const char* Path)
+{
+#if _WIN32
+	_mkdir(Path);
+#else
+	mkdir(Path, 0755);
 #endif
+}
 
-void GetFullPath(const char* RelPath, char* OutFullPath)
+u32 GetPid()
 {
-	char* Result;
 #if _WIN32
-	Result = _fullpath(OutFullPath, RelPath, MAX_PATH);
+	u32 Result = (u32)_getpid();
 #else
-	Result = realpath(RelPath, OutFullPath);
+	u32 Result = (u32)getpid();
 #endif
-	if (!Result)
+	return Result;
+}
+
+b32 IsDirectory(const char* Path)
+{
+#if _WIN32
+	struct __stat64 Stat;
+	b32 Result = _stat64(Path, &Stat) == 0 && (Stat.st_mode & _S_IFDIR);
+#else
+	struct stat Stat;
+	b32 Result = stat(Path, &Stat) == 0 && S_ISDIR(Stat.st_mode);
+#endif
+	return Result;
+}
+
+// Enough to tell whether a file has been saved again since it was last looked at
+struct file_stamp
+{
+	b32 Exists;
+	u64 Size;
+	s64 ModifiedTime; // In platform-specific units; only ever compared for equality
+};
+
+file_stamp GetFileStamp(const char* Path)
+{
+	file_stamp Result = {};
+#if _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA Data;
+	if (GetFileAttributesExA(Path, GetFileExInfoStandard, &Data))
+	{
+		Result.Exists = true;
+		Result.Size = (u64)Data.nFileSizeHigh << 32 | Data.nFileSizeLow;
+		Result.ModifiedTime = (s64)((u64)Data.ftLastWriteTime.dwHighDateTime << 32 | Data.ftLastWriteTime.dwLowDateTime);
+	}
+#else
+	struct stat Stat;
+	if (stat(Path, &Stat) == 0)
+	{
+		Result.Exists = true;
+		Result.Size = (u64)Stat.st_size;
+#if __linux__
+		Result.ModifiedTime = (s64)Stat.st_mtim.tv_sec * 1000000000 + Stat.st_mtim.tv_nsec;
+#else
+		Result.ModifiedTime = (s64)Stat.st_mtime;
+#endif
+	}
+#endif
+	return Result;
+}
+
+b32 AreFileStampsEqual(file_stamp A, file_stamp B)
+{
+	b32 Result = A.Exists == B.Exists && A.Size == B.Size && A.ModifiedTime == B.ModifiedTime;
+	return Result;
+}
+
+b32 IsAbsolutePath(const char* Path)
+{
+	b32 Result = Path[0] == '/' || Path[0] == '\\' || (Path[0] && Path[1] == ':');
+	return Result;
+}
+
+// Resolves RelPath against BaseDir without touching the process-wide working directory
+void JoinPath(const char* BaseDir, const char* RelPath, char* OutPath)
+{
+	if (!*BaseDir || IsAbsolutePath(RelPath))
+	{
+		strcpy(OutPath, RelPath);
+		return;
+	}
+
+	u32 OutIndex = 0;
+	for (u32 i = 0; BaseDir[i]; i++)
+	{
+		OutPath[OutIndex++] = BaseDir[i];
+	}
+	if (OutPath[OutIndex - 1] != '/' && OutPath[OutIndex - 1] != '\\')
+	{
+		OutPath[OutIndex++] = '/';
+	}
+	for (u32 i = 0; RelPath[i]; i++)
 	{
-		fprintf(stderr, "Failed to get absolute path for '%s'\n.", RelPath);
+		OutPath[OutIndex++] = RelPath[i];
 	}
+	OutPath[OutIndex] = 0;
+}
+
+b32 IsPathSeparator(char Char)
+{
+	b32 Result = Char == '/' || Char == '\\';
+	return Result;
+}
+
+// Path to ToPath from the directory FromDir, with forward slashes; both must be absolute. Paths on different drives
+// have no relative path, so ToPath comes back as it is.
+void GetRelativePath(const char* FromDir, const char* ToPath, char* OutPath)
+{
+	// Length of the directories the two have in common, up to (but not including) the separator after them
+	u32 CommonLength = 0;
+	u32 Index = 0;
+	for (; FromDir[Index] && ToPath[Index]; Index++)
+	{
+		if (IsPathSeparator(FromDir[Index]) && IsPathSeparator(ToPath[Index]))
+		{
+			CommonLength = Index;
+		}
+		else if (FromDir[Index] != ToPath[Index])
+		{
+			break;
+		}
+	}
+	if (!FromDir[Index] && IsPathSeparator(ToPath[Index]))
+	{
+		CommonLength = Index; // ToPath is inside FromDir
+	}
+	if (CommonLength == 0 && !IsPathSeparator(FromDir[0]))
+	{
+		strcpy(OutPath, ToPath); // Different drives
+		return;
+	}
+
+	u32 OutIndex = 0;
+	for (u32 i = CommonLength; FromDir[i]; i++)
+	{
+		if (IsPathSeparator(FromDir[i]) && FromDir[i + 1] && !IsPathSeparator(FromDir[i + 1]))
+		{
+			strcpy(OutPath + OutIndex, "../");
+			OutIndex += 3;
+		}
+	}
+	for (u32 i = CommonLength + 1; ToPath[i]; i++)
+	{
+		OutPath[OutIndex++] = IsPathSeparator(ToPath[i]) ? '/' : ToPath[i];
+	}
+	OutPath[OutIndex] = 0;
 }
 
 void AppendToFilePath(const char* FilePath, const char* Suffix, char* OutPath)
@@ -217,4 +546,58 @@ void ExtractBaseFileName(const char* FilePath, char* OutName)
 		OutName[OutIndex++] = FilePath[i];
 	}
 	OutName[OutIndex] = 0;
-}
\ No newline at end of file
+}
+
+void AddMapFile(const char* Dir, const char* FileName, char (**OutPaths)[MAX_PATH], u32* OutNumPaths)
+{
+	char Extension[MAX_PATH];
+	char NameNoExtension[MAX_PATH];
+	GetFileExtension(FileName, Extension);
+	StripFileExtension(FileName, NameNoExtension);
+	u32 NameLength = (u32)strlen(NameNoExtension);
+	b32 IsOutput = NameLength >= 4 && strcmp(NameNoExtension + NameLength - 4, "_min") == 0;
+	if ((strcmp(Extension, ".tmj") == 0 || strcmp(Extension, ".json") == 0) && !IsOutput)
+	{
+		*OutPaths = (char (*)[MAX_PATH])TrackedRealloc(*OutPaths, sizeof(**OutPaths) * (*OutNumPaths + 1));
+		JoinPath(Dir, FileName, (*OutPaths)[(*OutNumPaths)++]);
+	}
+}
+
+// Appends every map file (.tmj/.json) directly inside Dir to OutPaths, sorted by name. Our own *_min output is skipped so
+// re-running over the same directory doesn't minimise it again.
+b32 ListMapFiles(const char* Dir, char (**OutPaths)[MAX_PATH], u32* OutNumPaths)
+{
+	u32 FirstNewPath = *OutNumPaths;
+#if _WIN32
+	char Pattern[MAX_PATH];
+	JoinPath(Dir, "*", Pattern);
+	WIN32_FIND_DATAA FindData;
+	HANDLE FindHandle = FindFirstFileA(Pattern, &FindData);
+	if (FindHandle == INVALID_HANDLE_VALUE)
+	{
+		LogError("ERROR: Unable to open directory '%s'.\n", Dir);
+		return false;
+	}
+	do
+	{
+		AddMapFile(Dir, FindData.cFileName, OutPaths, OutNumPaths);
+	} while (FindNextFileA(FindHandle, &FindData));
+	FindClose(FindHandle);
+#else
+	DIR* DirHandle = opendir(Dir);
+	if (!DirHandle)
+	{
+		LogError("ERROR: Unable to open directory '%s'.\n", Dir);
+		return false;
+	}
+	while (dirent* Entry = readdir(DirHandle))
+	{
+		AddMapFile(Dir, Entry->d_name, OutPaths, OutNumPaths);
+	}
+	closedir(DirHandle);
+#endif
+
+	qsort(*OutPaths + FirstNewPath, *OutNumPaths - FirstNewPath, sizeof(**OutPaths),
+	      [](const void* A, const void* B) { return strcmp((const char*)A, (const char*)B); });
+	return true;
+}
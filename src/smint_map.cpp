@@ -0,0 +1,518 @@
+enum tiled_flip_flags : u32
+{
+	TiledFlag_HFlip 	   = 0x80000000,
+	TiledFlag_VFlip 	   = 0x40000000,
+	TiledFlag_DiagonalFlip = 0x20000000,
+	TiledFlag_Rotated      = 0x10000000
+};
+
+#define TILED_FLAGS_MASK (TiledFlag_HFlip | TiledFlag_VFlip | TiledFlag_DiagonalFlip | TiledFlag_Rotated)
+
+// GIDs or tile indices, as an open-addressing table, so that it takes as much memory as there are distinct ones rather
+// than however high they go (a stray GID of 0x0FFFFFF0 is just one more entry)
+struct tile_index_set
+{
+	u32* Keys; // Index + 1, or 0 for an empty slot
+	u32 Capacity; // Always a power of 2, or 0 before the first index
+	u32 Count;
+};
+
+void FreeTileIndexSet(tile_index_set* Set)
+{
+	TrackedFree(Set->Keys);
+	*Set = {};
+}
+
+u32 GetTileIndexSlot(u32* Keys, u32 Capacity, u32 Key)
+{
+	u32 Mask = Capacity - 1;
+	u32 Slot = (u32)(((u64)Key * 0x9E3779B97F4A7C15ull) >> 32) & Mask;
+	while (Keys[Slot] && Keys[Slot] != Key)
+	{
+		Slot = (Slot + 1) & Mask;
+	}
+	return Slot;
+}
+
+void AddToTileIndexSet(tile_index_set* Set, u32 Index)
+{
+	if ((Set->Count + 1) * 2 >= Set->Capacity)
+	{
+		u32 OldCapacity = Set->Capacity;
+		u32* OldKeys = Set->Keys;
+		Set->Capacity = OldCapacity ? OldCapacity * 2 : 256;
+		Set->Keys = (u32*)TrackedCalloc(Set->Capacity, sizeof(u32));
+		for (u32 Slot = 0; Slot < OldCapacity; Slot++)
+		{
+			if (OldKeys[Slot])
+			{
+				Set->Keys[GetTileIndexSlot(Set->Keys, Set->Capacity, OldKeys[Slot])] = OldKeys[Slot];
+			}
+		}
+		TrackedFree(OldKeys);
+	}
+
+	u32 Slot = GetTileIndexSlot(Set->Keys, Set->Capacity, Index + 1);
+	if (!Set->Keys[Slot])
+	{
+		Set->Keys[Slot] = Index + 1;
+		Set->Count++;
+	}
+}
+
+// Flip flags are stripped, and the blank tile isn't counted as in use
+void MarkGidInUse(tile_index_set* GidsInUse, u32 TileIndex)
+{
+	u32 Gid = TileIndex & ~TILED_FLAGS_MASK;
+	if (Gid)
+	{
+		AddToTileIndexSet(GidsInUse, Gid);
+	}
+}
+
+const char* GetOptionalString(json_value& Object, const char* Name)
+{
+	const char* Result = nullptr;
+	if (Object.HasMember(Name) && Object[Name].IsString())
+	{
+		Result = Object[Name].GetString();
+	}
+	return Result;
+}
+
+// Layer data is either a JSON array of GIDs or a base64 string, which has to have a supported encoding/compression
+b32 ValidateLayer(json_value& Layer, u32 LayerIndex)
+{
+	if (!Layer.IsObject() || !Layer.HasMember("data") || !(Layer["data"].IsArray() || Layer["data"].IsString()))
+	{
+		LogError("ERROR: Invalid map format - layer %u has unexpected format and/or is missing 'data' array.\n", LayerIndex);
+		return false;
+	}
+
+	if (Layer["data"].IsString())
+	{
+		layer_compression Compression;
+		return ValidateLayerEncoding(LayerIndex, GetOptionalString(Layer, "encoding"), GetOptionalString(Layer, "compression"),
+		                             &Compression);
+	}
+	return true;
+}
+
+// Returns malloc'd GIDs of a layer stored as a base64 string
+u32* DecodeLayer(json_value& Layer, u32* OutCount)
+{
+	json_value& LayerData = Layer["data"];
+	const char* CompressionName = GetOptionalString(Layer, "compression");
+	layer_compression Compression = ParseLayerCompression(CompressionName ? CompressionName : "");
+	u32* Result = DecodeLayerData(LayerData.GetString(), LayerData.GetStringLength(), Compression, OutCount);
+	return Result;
+}
+
+// One pass over every layer, marking which GIDs appear anywhere in the map
+b32 MarkGidsInUse(json_value& Layers, tile_index_set* OutGidsInUse)
+{
+	tile_index_set GidsInUse = {};
+	for (u32 LayerIndex = 0; LayerIndex < Layers.Size(); LayerIndex++)
+	{
+		json_value& LayerData = Layers[LayerIndex]["data"];
+		if (LayerData.IsString())
+		{
+			u32 Count;
+			u32* Entries = DecodeLayer(Layers[LayerIndex], &Count);
+			if (!Entries)
+			{
+				FreeTileIndexSet(&GidsInUse);
+				return false;
+			}
+			for (u32 DataIndex = 0; DataIndex < Count; DataIndex++)
+			{
+				MarkGidInUse(&GidsInUse, Entries[DataIndex]);
+			}
+			TrackedFree(Entries);
+			continue;
+		}
+
+		for (u32 DataIndex = 0; DataIndex < LayerData.Size(); DataIndex++)
+		{
+			MarkGidInUse(&GidsInUse, LayerData[DataIndex].GetUint());
+		}
+	}
+
+	*OutGidsInUse = GidsInUse;
+	return true;
+}
+
+// A tileset as referenced by one map
+struct map_tileset_ref
+{
+	const char* Source;
+	u32 FirstTileId;
+	u32 JobIndex; // Maps that share a tileset share its job
+};
+
+// Everything --watch keeps of a tileset between runs: its last result, what that result was made from, and its decoded
+// tiles so that an edited image can be minimised again without canonicalising every tile
+struct resident_tileset
+{
+	char FullPath[MAX_PATH]; // Of the .tsj
+	char ImageFullPath[MAX_PATH];
+	file_stamp TilesetStamp;
+	file_stamp ImageStamp;
+	resident_tiles Tiles;
+
+	b32 HasResult;
+	minimised_tileset MinTiles;
+	char NewTilesetPath[MAX_PATH];
+	b8* TilesInUse; // That the result was made with (only with -rut)
+	u32 NumTiles;
+	memory_arena Arena; // MinTiles and TilesInUse; cleared whenever the result is dropped
+};
+
+struct tileset_job
+{
+	const char* TilesetPath; // Relative to BaseDir
+	const char* BaseDir; // Directory of the first map that referenced this tileset
+	tile_index_set UsedTiles; // Union of the tiles used by every map, by local tile index (only with -rut)
+	tile_usage Usage; // Across every map (only with a tile order other than the default)
+
+	u32 NumTiles;
+	b8* TilesInUse;
+	char NewTilesetPath[MAX_PATH];
+	minimised_tileset MinTiles;
+	b32 Error;
+	message_log Log;
+	stage_stats Stats[Stage_Count];
+	memory_arena Arena; // MinTiles and TilesInUse, unless MinTiles belongs to the resident tileset
+
+	resident_tileset* Resident; // Only with --watch; owns MinTiles if set
+	b32 IsReused; // MinTiles is the resident result from last time, since nothing it depends on has changed
+};
+
+struct tileset_job_queue
+{
+	tileset_job* Jobs;
+	u32 NumJobs;
+	std::atomic<u32> NextJobIndex;
+
+	b32 RemoveUnusedTiles;
+	b32 UseLinearDedup;
+	b32 UseIndexedTiles;
+	u32 ThreadsPerTileset; // Spare threads when there are fewer tilesets than --jobs
+	const char* CacheDir; // nullptr unless --cache is given
+	u32 TileOrder;
+	u32 PngLevel; // 0 unless --png-level is given
+	u32 PngFilter;
+};
+
+b32 AreTileMasksEqual(b8* A, b8* B, u32 NumTiles)
+{
+	b32 Result = (!A && !B) || (A && B && memcmp(A, B, NumTiles) == 0);
+	return Result;
+}
+
+// With --watch, reuses the previous result if the tileset, its image and the tiles in use are all unchanged. Otherwise
+// the previous result is dropped, and the stamps of the files about to be read are recorded. A result whose tiles are
+// ordered by how the maps use them is never reused, since any edit to a map may have changed that.
+b32 TryReuseResidentTileset(tileset_job* Job, file_stamp TilesetStamp, const char* ImageFullPath, u32 TileOrder)
+{
+	resident_tileset* Resident = Job->Resident;
+	file_stamp ImageStamp = GetFileStamp(ImageFullPath);
+	b32 IsCurrent = Resident->HasResult && TileOrder == SMINT_TILE_ORDER_FIRST && AreFileStampsEqual(TilesetStamp, Resident->TilesetStamp) &&
+	                AreFileStampsEqual(ImageStamp, Resident->ImageStamp) && strcmp(ImageFullPath, Resident->ImageFullPath) == 0 &&
+	                Resident->NumTiles == Job->NumTiles && AreTileMasksEqual(Job->TilesInUse, Resident->TilesInUse, Job->NumTiles);
+	Resident->TilesetStamp = TilesetStamp;
+	Resident->ImageStamp = ImageStamp;
+	strcpy(Resident->ImageFullPath, ImageFullPath);
+	if (IsCurrent)
+	{
+		Job->MinTiles = Resident->MinTiles;
+		strcpy(Job->NewTilesetPath, Resident->NewTilesetPath);
+		Job->IsReused = true;
+		return true;
+	}
+
+	ClearArena(&Resident->Arena);
+	Resident->MinTiles = {};
+	Resident->TilesInUse = nullptr;
+	Resident->HasResult = false;
+	return false;
+}
+
+// Job->MinTiles will have been pushed onto the resident tileset's arena already
+void KeepResidentTileset(tileset_job* Job)
+{
+	resident_tileset* Resident = Job->Resident;
+	Resident->MinTiles = Job->MinTiles;
+	strcpy(Resident->NewTilesetPath, Job->NewTilesetPath);
+	Resident->NumTiles = Job->NumTiles;
+	if (Job->TilesInUse)
+	{
+		Resident->TilesInUse = (b8*)PushCopy(&Resident->Arena, Job->TilesInUse, Job->NumTiles);
+	}
+	Resident->HasResult = true;
+}
+
+// Anything only needed while the tileset is being processed (its JSON included) goes on Scratch
+void ProcessTilesetJob(tileset_job_queue* Queue, tileset_job* Job, memory_arena* Scratch)
+{
+	file_stamp TilesetStamp = {};
+	if (Job->Resident)
+	{
+		// Taken before the file is read, so a save while it's being processed is picked up next time
+		TilesetStamp = GetFileStamp(Job->Resident->FullPath);
+	}
+
+	stage_timer ParseTimer = BeginStage(Stage_ParseTileset);
+	json_document* TilesetJson = PushJsonDocument(Scratch);
+	str_buffer TilesetText;
+	if (!ParseTilesetJson(Job->BaseDir, Job->TilesetPath, Scratch, TilesetText, *TilesetJson))
+	{
+		if (Job->Resident)
+		{
+			// Nothing more to do until it's saved again
+			Job->Resident->TilesetStamp = TilesetStamp;
+		}
+		Job->Error = true;
+		return;
+	}
+	EndStage(&ParseTimer);
+	u32 NumTiles = (*TilesetJson)["tilecount"].GetUint();
+	Job->NumTiles = NumTiles;
+	if (Queue->TileOrder != SMINT_TILE_ORDER_FIRST)
+	{
+		ClipTileUsage(&Job->Usage, NumTiles);
+	}
+
+	if (Queue->RemoveUnusedTiles)
+	{
+		// Any tile not used *somewhere* in the map(s) can safely be dropped. GIDs past the end of the tileset don't refer
+		// to any of its tiles.
+		Job->TilesInUse = PushArrayZero(&Job->Arena, NumTiles, b8);
+		for (u32 Slot = 0; Slot < Job->UsedTiles.Capacity; Slot++)
+		{
+			u32 Key = Job->UsedTiles.Keys[Slot];
+			if (Key && Key - 1 < NumTiles)
+			{
+				Job->TilesInUse[Key - 1] = true;
+			}
+		}
+	}
+
+	tileset_paths Paths;
+	GetTilesetPaths(Job->BaseDir, Job->TilesetPath, (*TilesetJson)["image"].GetString(), &Paths);
+	if (Job->Resident && TryReuseResidentTileset(Job, TilesetStamp, Paths.ImageFullPath, Queue->TileOrder))
+	{
+		return;
+	}
+
+	// A resident tileset's result has to outlive the job
+	memory_arena* ResultArena = Job->Resident ? &Job->Resident->Arena : &Job->Arena;
+
+	// Spare threads help deflate the image, as they do everything else
+	png_options Png = {Queue->PngLevel, Queue->PngFilter, Queue->ThreadsPerTileset};
+	png_options* PngOptions = Queue->PngLevel ? &Png : nullptr;
+
+	cache_key CacheKey;
+	b32 UseCache = false;
+	if (Queue->CacheDir)
+	{
+		stage_timer CacheTimer = BeginStage(Stage_Cache);
+		UseCache = ComputeTilesetCacheKey(Job->BaseDir, Job->TilesetPath, &Paths, Job->TilesInUse, NumTiles,
+		                                  Queue->TileOrder, &Job->Usage, PngOptions, &CacheKey);
+		b32 IsHit = UseCache && LoadCachedTileset(Queue->CacheDir, &CacheKey, &Paths, NumTiles, ResultArena, &Job->Log,
+		                                                 &Job->MinTiles);
+		EndStage(&CacheTimer);
+		if (IsHit)
+		{
+			strcpy(Job->NewTilesetPath, Paths.NewTilesetPath);
+			if (Job->Resident)
+			{
+				KeepResidentTileset(Job);
+			}
+			return;
+		}
+	}
+
+	u64 LogStart = Job->Log.Size;
+	Job->MinTiles = MinimiseTileset(Job->TilesetPath, *TilesetJson, TilesetText.Size, Job->NewTilesetPath, Job->BaseDir,
+	                                ResultArena, Scratch, Job->TilesInUse, Queue->UseLinearDedup, Queue->ThreadsPerTileset,
+	                                Job->Resident ? &Job->Resident->Tiles : nullptr, Queue->UseIndexedTiles,
+	                                Queue->TileOrder, &Job->Usage, PngOptions);
+	Job->Error = Job->MinTiles.Error;
+	if (Job->Resident && !Job->Error)
+	{
+		KeepResidentTileset(Job);
+	}
+
+	if (UseCache && !Job->Error)
+	{
+		stage_timer CacheTimer = BeginStage(Stage_Cache);
+		StoreCachedTileset(Queue->CacheDir, &CacheKey, &Paths, NumTiles, &Job->MinTiles, Job->Log.Data + LogStart,
+		                   Job->Log.Size - LogStart);
+		EndStage(&CacheTimer);
+	}
+}
+
+void RunTilesetJobs(tileset_job_queue* Queue)
+{
+	// Each tileset this thread processes gets a temporary scope of it, so nothing is held on to from one to the next
+	memory_arena Scratch = {};
+	for (;;)
+	{
+		u32 JobIndex = Queue->NextJobIndex++;
+		if (JobIndex >= Queue->NumJobs)
+		{
+			break;
+		}
+
+		tileset_job* Job = Queue->Jobs + JobIndex;
+		ThreadMessageLog = &Job->Log;
+		ThreadStageStats = Job->Stats;
+		temp_memory JobMemory = BeginTemporaryMemory(&Scratch);
+		ProcessTilesetJob(Queue, Job, &Scratch);
+		EndTemporaryMemory(JobMemory);
+		ThreadMessageLog = nullptr;
+		ThreadStageStats = nullptr;
+	}
+	ClearArena(&Scratch);
+}
+
+// Lookup from every old GID (flags stripped) to its new GID with the Tiled flip flags needed to match the old tile.
+// 0 means the GID is left alone, e.g. because its tileset was already minimal.
+u32* BuildGidRemapTable(tileset_job* Jobs, map_tileset_ref* Tilesets, u32 NumTilesets, u32* OutNumGids)
+{
+	u32 NumGids = 1;
+	for (u32 TilesetIndex = 0; TilesetIndex < NumTilesets; TilesetIndex++)
+	{
+		map_tileset_ref* Tileset = Tilesets + TilesetIndex;
+		tileset_job* Job = Jobs + Tileset->JobIndex;
+		if (!Job->MinTiles.IsUnchanged && Tileset->FirstTileId + Job->NumTiles > NumGids)
+		{
+			NumGids = Tileset->FirstTileId + Job->NumTiles;
+		}
+	}
+
+	u32* Result = (u32*)TrackedCalloc(NumGids, sizeof(u32));
+	for (u32 TilesetIndex = 0; TilesetIndex < NumTilesets; TilesetIndex++)
+	{
+		map_tileset_ref* Tileset = Tilesets + TilesetIndex;
+		tileset_job* Job = Jobs + Tileset->JobIndex;
+		minimised_tileset* MinTiles = &Job->MinTiles;
+		if (MinTiles->IsUnchanged)
+		{
+			continue;
+		}
+
+		for (u32 TileIndex = 0; TileIndex < Job->NumTiles; TileIndex++)
+		{
+			if (Job->TilesInUse && !Job->TilesInUse[TileIndex])
+			{
+				continue; // Not referenced by the map, so has no unique tile
+			}
+
+			tile_mapping* SourceTile = MinTiles->Mappings + TileIndex;
+			unique_tile* UniqueTile = SourceTile->EquivalentUniqueTile;
+			Assert(UniqueTile);
+
+			u32 NewTileIndex = UniqueTile - MinTiles->MinimisedTiles;
+			Assert(NewTileIndex < MinTiles->NumUniqueTiles);
+
+			NewTileIndex += Tileset->FirstTileId;
+
+			switch (SourceTile->EqualAfterTransform)
+			{
+				case TileTransform_HFlip:
+				{
+					NewTileIndex |= TiledFlag_HFlip;
+				} break;
+				case TileTransform_VFlip:
+				{
+					NewTileIndex |= TiledFlag_VFlip;
+				} break;
+				case TileTransform_DiagonalFlip:
+				{
+					NewTileIndex |= (TiledFlag_HFlip | TiledFlag_VFlip);
+				} break;
+			}
+
+			Result[Tileset->FirstTileId + TileIndex] = NewTileIndex;
+		}
+	}
+
+	*OutNumGids = NumGids;
+	return Result;
+}
+
+// Returns the new value for one layer data entry (GID + flip flags)
+u32 RemapTileEntry(u32 TileIndex, u32* GidRemapTable, u32 NumGids, u32 LayerIndex, u32 DataIndex)
+{
+	u32 Gid = TileIndex & ~TILED_FLAGS_MASK;
+	if (Gid >= NumGids || !GidRemapTable[Gid])
+	{
+		return TileIndex; // Blank tile, or belongs to a tileset that hasn't changed
+	}
+
+	u32 FlipFlags = TileIndex & (TiledFlag_HFlip | TiledFlag_VFlip);
+	if (TileIndex & TiledFlag_DiagonalFlip)
+	{
+		// tbh I don't actually know how to diagonally flip a tile in Tiled, but if we ever encounter one, let's treat it like HFLIP+VFLIP
+		FlipFlags |= (TiledFlag_HFlip | TiledFlag_VFlip);
+	}
+	if (TileIndex & TiledFlag_Rotated)
+	{
+		LogInfo("WARNING: (Layer %u, entry %u) Tile rotation is not supported for GBA - this entry will be unchanged in the output map.\n",
+		        LayerIndex, DataIndex);
+	}
+
+	// The output entry's flip is `OldFlip` XOR `NewFlip`
+	u32 Result = GidRemapTable[Gid] ^ FlipFlags;
+	return Result;
+}
+
+void RemapTileEntries(u32* Entries, u32 Count, u32* GidRemapTable, u32 NumGids, u32 LayerIndex)
+{
+	for (u32 DataIndex = 0; DataIndex < Count; DataIndex++)
+	{
+		Entries[DataIndex] = RemapTileEntry(Entries[DataIndex], GidRemapTable, NumGids, LayerIndex, DataIndex);
+	}
+}
+
+b32 RemapLayers(json_value& Layers, u32* GidRemapTable, u32 NumGids, arena_json_allocator& Allocator)
+{
+	for (u32 LayerIndex = 0; LayerIndex < Layers.Size(); LayerIndex++)
+	{
+		json_value& Layer = Layers[LayerIndex];
+		json_value& LayerData = Layer["data"];
+		if (LayerData.IsString())
+		{
+			// Remap the raw buffer, then re-encode it with the same compression it came in with
+			u32 Count;
+			u32* Entries = DecodeLayer(Layer, &Count);
+			if (!Entries)
+			{
+				return false;
+			}
+			RemapTileEntries(Entries, Count, GidRemapTable, NumGids, LayerIndex);
+
+			const char* Compression = GetOptionalString(Layer, "compression");
+			u32 EncodedLength;
+			char* Encoded = EncodeLayerData(Entries, Count, ParseLayerCompression(Compression ? Compression : ""), &EncodedLength);
+			LayerData.SetString(Encoded, EncodedLength, Allocator);
+
+			TrackedFree(Encoded);
+			TrackedFree(Entries);
+			continue;
+		}
+
+		for (u32 DataIndex = 0; DataIndex < LayerData.Size(); DataIndex++)
+		{
+			u32 TileIndex = LayerData[DataIndex].GetUint();
+			u32 NewTileIndex = RemapTileEntry(TileIndex, GidRemapTable, NumGids, LayerIndex, DataIndex);
+			if (NewTileIndex != TileIndex)
+			{
+				LayerData[DataIndex].SetUint(NewTileIndex);
+			}
+		}
+	}
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,199 @@
+// --merge-tilesets: once every tileset has been minimised on its own, their unique tiles are deduplicated against each
+// other into one more tileset, and every map is pointed at that instead. A tile that appears in several tilesets (in any
+// flip) is only kept once. Since unique tiles are already canonical, this is a single pass over them with one hash table.
+//
+// The merged tileset's JSON starts out as a copy of the first tileset's, minus any per-tile data (which belongs to tiles
+// of just one of the tilesets). The tilesets' own minimised files are still written as usual.
+
+struct merged_tileset
+{
+	char FullPath[MAX_PATH]; // Of the .tsj; the image is next to it, with the same name
+	unique_tile* Tiles;
+	u32 NumTiles;
+
+	// For each job's unique tiles, one after the other: the merged tile each became, and the flip that takes the merged
+	// tile's original orientation to the unique tile's
+	u32* JobTileBases;
+	u32* TileIndices;
+	u8* Transforms;
+
+	memory_arena Arena; // Everything above; cleared whenever the maps are
+};
+
+void SetMergedTilesetJson(json_document& JsonDoc, const char* Name, const char* ImagePath, u32 TileWidth, u32 TileHeight)
+{
+	json_document::AllocatorType& Allocator = JsonDoc.GetAllocator();
+	const char* UintFields[] = {"imagewidth", "imageheight", "tilecount", "columns"};
+	u32 UintValues[] = {TileWidth * 8, TileHeight * 8, TileWidth * TileHeight, TileWidth};
+	for (u32 FieldIndex = 0; FieldIndex < ArrayCount(UintFields); FieldIndex++)
+	{
+		if (JsonDoc.HasMember(UintFields[FieldIndex]))
+		{
+			JsonDoc[UintFields[FieldIndex]].SetUint(UintValues[FieldIndex]);
+		}
+		else
+		{
+			JsonDoc.AddMember(rapidjson::StringRef(UintFields[FieldIndex]), UintValues[FieldIndex], Allocator);
+		}
+	}
+	JsonDoc["image"].SetString(ImagePath, strlen(ImagePath), Allocator);
+	if (JsonDoc.HasMember("name"))
+	{
+		JsonDoc["name"].SetString(Name, strlen(Name), Allocator);
+	}
+
+	// Per-tile properties, animations, terrains etc. refer to tiles by their index in the original tileset
+	JsonDoc.RemoveMember("tiles");
+	JsonDoc.RemoveMember("wangsets");
+	JsonDoc.RemoveMember("terrains");
+}
+
+// Deduplicates every job's unique tiles against each other, and writes the result to FilePath (relative to the working
+// directory) and an image next to it (with the built-in PNG writer if Png is given). Returns false on error.
+b32 MergeTilesets(tileset_job* Jobs, u32 NumJobs, const char* FilePath, merged_tileset* Merged,
+                  png_options* Png = nullptr)
+{
+	ClearArena(&Merged->Arena);
+	memory_arena* Arena = &Merged->Arena;
+
+	// Resolved up front, since the file may not exist yet
+	char Dir[MAX_PATH];
+	char FullDir[MAX_PATH];
+	char FileName[MAX_PATH];
+	StripFileName(FilePath, Dir);
+	if (*Dir && !IsDirectory(Dir))
+	{
+		MakeDirectory(Dir);
+	}
+	TryGetFullPath(*Dir ? Dir : ".", FullDir);
+	ExtractBaseFileName(FilePath, FileName);
+	JoinPath(FullDir, FileName, Merged->FullPath);
+
+	u32 NumSourceTiles = 0;
+	Merged->JobTileBases = PushArray(Arena, NumJobs, u32);
+	for (u32 JobIndex = 0; JobIndex < NumJobs; JobIndex++)
+	{
+		Merged->JobTileBases[JobIndex] = NumSourceTiles;
+		NumSourceTiles += Jobs[JobIndex].MinTiles.NumUniqueTiles;
+	}
+	Merged->TileIndices = PushArray(Arena, NumSourceTiles, u32);
+	Merged->Transforms = PushArray(Arena, NumSourceTiles, u8);
+
+	unique_tile_store MergedTiles = CreateUniqueTileStore(Arena, NumSourceTiles);
+	tile_hash_table HashTable = CreateTileHashTable(Arena, NumSourceTiles < 4096 ? NumSourceTiles : 4096);
+	for (u32 JobIndex = 0; JobIndex < NumJobs; JobIndex++)
+	{
+		minimised_tileset* MinTiles = &Jobs[JobIndex].MinTiles;
+		for (u32 UniqueTileIndex = 0; UniqueTileIndex < MinTiles->NumUniqueTiles; UniqueTileIndex++)
+		{
+			unique_tile* UniqueTile = MinTiles->MinimisedTiles + UniqueTileIndex;
+			u32 Hash = HashTile(&UniqueTile->Canonical);
+			s32 MergedIndex = FindUniqueTile(&HashTable, &MergedTiles, UniqueTile, Hash);
+			if (MergedIndex < 0)
+			{
+				MergedIndex = (s32)MergedTiles.NumUniqueTiles;
+				InsertUniqueTile(Arena, &HashTable, Hash, MergedTiles.NumUniqueTiles);
+				*AddUniqueTile(&MergedTiles) = *UniqueTile;
+			}
+
+			// Both are flips of the same canonical tile, so this goes from one's original orientation to the other's
+			u32 SourceIndex = Merged->JobTileBases[JobIndex] + UniqueTileIndex;
+			Merged->TileIndices[SourceIndex] = (u32)MergedIndex;
+			Merged->Transforms[SourceIndex] = (u8)(UniqueTile->CanonicalTransform ^
+			                                       GetUniqueTile(&MergedTiles, (u32)MergedIndex)->CanonicalTransform);
+		}
+	}
+
+	u32 NumTiles = MergedTiles.NumUniqueTiles;
+	Merged->Tiles = PackUniqueTiles(&MergedTiles, Arena);
+	Merged->NumTiles = NumTiles;
+
+	if (NumTiles == 0)
+	{
+		LogError("ERROR: There are no tiles to merge.\n");
+		return false;
+	}
+
+	char ImagePath[MAX_PATH]; // Relative to the tileset
+	char ImageFullPath[MAX_PATH];
+	char Name[MAX_PATH];
+	StripFileExtension(FileName, Name);
+	if (snprintf(ImagePath, sizeof(ImagePath), "%s.png", Name) >= (s32)sizeof(ImagePath))
+	{
+		LogError("ERROR: Merged tileset name '%s' is too long.\n", Name);
+		return false;
+	}
+	JoinPath(FullDir, ImagePath, ImageFullPath);
+
+	temp_memory WriteMemory = BeginTemporaryMemory(Arena);
+	u32 TileWidth, TileHeight;
+	b32 Result = WriteUniqueTileImage(Merged->Tiles, NumTiles, ImageFullPath, Arena, &TileWidth, &TileHeight, Png);
+	if (!Result)
+	{
+		LogError("ERROR: Failed to write output image '%s'.\n", ImagePath);
+	}
+
+	json_document* JsonDoc = PushJsonDocument(Arena);
+	str_buffer TilesetText = {};
+	Result = Result && ParseTilesetJson(Jobs[0].BaseDir, Jobs[0].TilesetPath, Arena, TilesetText, *JsonDoc);
+	if (Result)
+	{
+		SetMergedTilesetJson(*JsonDoc, Name, ImagePath, TileWidth, TileHeight);
+	}
+	Result = Result && WriteJsonToFile(JsonDoc, Merged->FullPath, TilesetText.Size);
+	EndTemporaryMemory(WriteMemory);
+
+	if (Result)
+	{
+		f32 Pst = roundf((((f32)NumSourceTiles - (f32)NumTiles) / (f32)NumSourceTiles) * 100.0f);
+		LogInfo("Merged the unique tiles of %u tilesets: %u->%u (-%.0f%%)\n", NumJobs, NumSourceTiles, NumTiles, Pst);
+		LogInfo("Wrote merged tileset to '%s'.\n\n", FileName);
+	}
+	return Result;
+}
+
+// BuildGidRemapTable for a map being pointed at the merged tileset (as its only tileset, with a firstgid of 1)
+u32* BuildMergedGidRemapTable(tileset_job* Jobs, map_tileset_ref* Tilesets, u32 NumTilesets, merged_tileset* Merged,
+                              u32* OutNumGids)
+{
+	u32 NumGids = 1;
+	for (u32 TilesetIndex = 0; TilesetIndex < NumTilesets; TilesetIndex++)
+	{
+		map_tileset_ref* Tileset = Tilesets + TilesetIndex;
+		u32 EndGid = Tileset->FirstTileId + Jobs[Tileset->JobIndex].NumTiles;
+		NumGids = EndGid > NumGids ? EndGid : NumGids;
+	}
+
+	u32* Result = (u32*)TrackedCalloc(NumGids, sizeof(u32));
+	for (u32 TilesetIndex = 0; TilesetIndex < NumTilesets; TilesetIndex++)
+	{
+		map_tileset_ref* Tileset = Tilesets + TilesetIndex;
+		tileset_job* Job = Jobs + Tileset->JobIndex;
+		minimised_tileset* MinTiles = &Job->MinTiles;
+		for (u32 TileIndex = 0; TileIndex < Job->NumTiles; TileIndex++)
+		{
+			tile_mapping* Mapping = MinTiles->Mappings + TileIndex;
+			if (!Mapping->EquivalentUniqueTile)
+			{
+				continue; // Not referenced by the map, so has no unique tile
+			}
+
+			// Flips compose by XOR: from the merged tile to the tileset's unique tile, then on to this tile
+			u32 SourceIndex = Merged->JobTileBases[Tileset->JobIndex] + (u32)(Mapping->EquivalentUniqueTile - MinTiles->MinimisedTiles);
+			u32 Transform = Mapping->EqualAfterTransform ^ Merged->Transforms[SourceIndex];
+			u32 NewTileIndex = Merged->TileIndices[SourceIndex] + 1;
+			if (Transform == TileTransform_HFlip || Transform == TileTransform_DiagonalFlip)
+			{
+				NewTileIndex |= TiledFlag_HFlip;
+			}
+			if (Transform == TileTransform_VFlip || Transform == TileTransform_DiagonalFlip)
+			{
+				NewTileIndex |= TiledFlag_VFlip;
+			}
+			Result[Tileset->FirstTileId + TileIndex] = NewTileIndex;
+		}
+	}
+
+	*OutNumGids = NumGids;
+	return Result;
+}
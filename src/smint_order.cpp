@@ -0,0 +1,256 @@
+// --tile-order: lays out each minimised tileset's unique tiles by how the map(s) use them, instead of in the order they
+// were first found. "usage" puts the most used tiles first, so the ones that matter most sit in one contiguous range.
+// "adjacent" starts from the most used tile and then keeps picking whichever tile is found next to the last one most
+// often in the layers, so tiles that are drawn together end up together (which also helps LZ77-style compressors).
+// Either way, tiles the maps don't use at all go last, in their original order.
+
+// How often each tile of one tileset is used, and how often each pair of its tiles are next to each other, across all
+// the maps (flips ignored). Counted before the tileset is minimised, by local tile index. The tileset's tile count isn't
+// known until its job reads it, so uses are counted in a table like the pairs' (which stray GIDs can't blow up) and only
+// turned into Counts by ClipTileUsage.
+struct tile_usage
+{
+	u32* Counts;
+	u32 NumTiles; // That Counts has room for (the tileset's tile count), or 0 until clipped
+
+	// Open-addressing tables from a tile (its index + 1) or a pair of tiles (lower index in the high half, plus 1 so no
+	// key is 0) to its count
+	u64* UseKeys;
+	u32* UseCounts;
+	u32 UseCapacity; // Always a power of 2, or 0 before the first use
+	u32 NumUses;
+	u64* PairKeys;
+	u32* PairCounts;
+	u32 PairCapacity;
+	u32 NumPairs;
+};
+
+void FreeTileUsage(tile_usage* Usage)
+{
+	TrackedFree(Usage->Counts);
+	TrackedFree(Usage->UseKeys);
+	TrackedFree(Usage->UseCounts);
+	TrackedFree(Usage->PairKeys);
+	TrackedFree(Usage->PairCounts);
+	*Usage = {};
+}
+
+u64 GetTilePairKey(u32 A, u32 B)
+{
+	u64 Result = A < B ? ((u64)(A + 1) << 32 | B) : ((u64)(B + 1) << 32 | A);
+	return Result;
+}
+
+u32 GetTileCountSlot(u64* Keys, u32 Capacity, u64 Key)
+{
+	u32 Mask = Capacity - 1;
+	u32 Slot = (u32)((Key * 0x9E3779B97F4A7C15ull) >> 40) & Mask;
+	while (Keys[Slot] && Keys[Slot] != Key)
+	{
+		Slot = (Slot + 1) & Mask;
+	}
+	return Slot;
+}
+
+void AddTileCount(u64** Keys, u32** Counts, u32* Capacity, u32* NumKeys, u64 Key, u32 Count)
+{
+	if ((*NumKeys + 1) * 2 >= *Capacity)
+	{
+		u32 OldCapacity = *Capacity;
+		u64* OldKeys = *Keys;
+		u32* OldCounts = *Counts;
+		*Capacity = OldCapacity ? OldCapacity * 2 : 1024;
+		*Keys = (u64*)TrackedCalloc(*Capacity, sizeof(u64));
+		*Counts = (u32*)TrackedCalloc(*Capacity, sizeof(u32));
+		for (u32 Slot = 0; Slot < OldCapacity; Slot++)
+		{
+			if (OldKeys[Slot])
+			{
+				u32 NewSlot = GetTileCountSlot(*Keys, *Capacity, OldKeys[Slot]);
+				(*Keys)[NewSlot] = OldKeys[Slot];
+				(*Counts)[NewSlot] = OldCounts[Slot];
+			}
+		}
+		TrackedFree(OldKeys);
+		TrackedFree(OldCounts);
+	}
+
+	u32 Slot = GetTileCountSlot(*Keys, *Capacity, Key);
+	if (!(*Keys)[Slot])
+	{
+		(*Keys)[Slot] = Key;
+		(*NumKeys)++;
+	}
+	(*Counts)[Slot] += Count;
+}
+
+void AddTileUse(tile_usage* Usage, u32 TileIndex)
+{
+	AddTileCount(&Usage->UseKeys, &Usage->UseCounts, &Usage->UseCapacity, &Usage->NumUses, (u64)TileIndex + 1, 1);
+}
+
+void AddTilePair(tile_usage* Usage, u64 Key, u32 Count)
+{
+	AddTileCount(&Usage->PairKeys, &Usage->PairCounts, &Usage->PairCapacity, &Usage->NumPairs, Key, Count);
+}
+
+// Once the tileset's tile count is known: gives every tile its count, and forgets uses and pairs of GIDs past the end of
+// the tileset (which don't refer to any of its tiles)
+void ClipTileUsage(tile_usage* Usage, u32 NumTiles)
+{
+	TrackedFree(Usage->Counts);
+	Usage->Counts = (u32*)TrackedCalloc(NumTiles ? NumTiles : 1, sizeof(u32));
+	Usage->NumTiles = NumTiles;
+	for (u32 Slot = 0; Slot < Usage->UseCapacity; Slot++)
+	{
+		u64 Key = Usage->UseKeys[Slot];
+		if (Key && Key - 1 < NumTiles)
+		{
+			Usage->Counts[Key - 1] = Usage->UseCounts[Slot];
+		}
+	}
+
+	// Nothing is looked up in the pair table from here on, so entries can just be emptied
+	for (u32 Slot = 0; Slot < Usage->PairCapacity; Slot++)
+	{
+		u64 Key = Usage->PairKeys[Slot];
+		if (Key && ((u32)(Key >> 32) - 1 >= NumTiles || (u32)Key >= NumTiles))
+		{
+			Usage->PairKeys[Slot] = 0;
+			Usage->PairCounts[Slot] = 0;
+			Usage->NumPairs--;
+		}
+	}
+}
+
+struct tile_neighbour
+{
+	u32 UniqueTileIndex;
+	u32 Count;
+};
+
+// Works out where each unique tile goes (OutNewIndices, by old unique tile index). UniqueTileIndices is the unique tile
+// of each source tile, and is only read for tiles in use.
+void OrderUniqueTiles(u32 NumUniqueTiles, u32* UniqueTileIndices, u32 NumSourceTiles, b8* TilesInUse, tile_usage* Usage,
+                      u32 TileOrder, memory_arena* Scratch, u32* OutNewIndices)
+{
+	temp_memory OrderMemory = BeginTemporaryMemory(Scratch);
+	u32* UniqueCounts = PushArrayZero(Scratch, NumUniqueTiles, u32);
+	for (u32 TileIndex = 0; TileIndex < NumSourceTiles && TileIndex < Usage->NumTiles; TileIndex++)
+	{
+		if (!TilesInUse || TilesInUse[TileIndex])
+		{
+			UniqueCounts[UniqueTileIndices[TileIndex]] += Usage->Counts[TileIndex];
+		}
+	}
+
+	// Most used first; the sort is stable, so ties (including every unused tile) keep their original order
+	u32* ByUsage = PushArray(Scratch, NumUniqueTiles, u32);
+	for (u32 UniqueTileIndex = 0; UniqueTileIndex < NumUniqueTiles; UniqueTileIndex++)
+	{
+		ByUsage[UniqueTileIndex] = UniqueTileIndex;
+	}
+	std::stable_sort(ByUsage, ByUsage + NumUniqueTiles, [UniqueCounts](u32 A, u32 B)
+	{
+		return UniqueCounts[A] > UniqueCounts[B];
+	});
+
+	if (TileOrder != SMINT_TILE_ORDER_ADJACENT)
+	{
+		for (u32 Position = 0; Position < NumUniqueTiles; Position++)
+		{
+			OutNewIndices[ByUsage[Position]] = Position;
+		}
+		EndTemporaryMemory(OrderMemory);
+		return;
+	}
+
+	// Pairs of source tiles become pairs of unique tiles; a tile next to a copy of itself says nothing about the order
+	tile_usage UniquePairs = {};
+	for (u32 Slot = 0; Slot < Usage->PairCapacity; Slot++)
+	{
+		u64 Key = Usage->PairKeys[Slot];
+		if (!Key)
+		{
+			continue;
+		}
+		u32 A = (u32)(Key >> 32) - 1;
+		u32 B = (u32)Key;
+		b32 AreInUse = A < NumSourceTiles && B < NumSourceTiles && (!TilesInUse || (TilesInUse[A] && TilesInUse[B]));
+		if (AreInUse && UniqueTileIndices[A] != UniqueTileIndices[B])
+		{
+			AddTilePair(&UniquePairs, GetTilePairKey(UniqueTileIndices[A], UniqueTileIndices[B]), Usage->PairCounts[Slot]);
+		}
+	}
+
+	// Every unique tile's neighbours, most often adjacent first
+	u32* FirstNeighbours = PushArrayZero(Scratch, NumUniqueTiles + 1, u32);
+	for (u32 Slot = 0; Slot < UniquePairs.PairCapacity; Slot++)
+	{
+		if (UniquePairs.PairKeys[Slot])
+		{
+			FirstNeighbours[(u32)(UniquePairs.PairKeys[Slot] >> 32) - 1]++;
+			FirstNeighbours[(u32)UniquePairs.PairKeys[Slot]]++;
+		}
+	}
+	u32 NumNeighbours = 0;
+	for (u32 UniqueTileIndex = 0; UniqueTileIndex <= NumUniqueTiles; UniqueTileIndex++)
+	{
+		u32 Count = FirstNeighbours[UniqueTileIndex];
+		FirstNeighbours[UniqueTileIndex] = NumNeighbours;
+		NumNeighbours += Count;
+	}
+	tile_neighbour* Neighbours = PushArray(Scratch, NumNeighbours, tile_neighbour);
+	u32* NextNeighbours = (u32*)PushCopy(Scratch, FirstNeighbours, sizeof(u32) * NumUniqueTiles);
+	for (u32 Slot = 0; Slot < UniquePairs.PairCapacity; Slot++)
+	{
+		u64 Key = UniquePairs.PairKeys[Slot];
+		if (Key)
+		{
+			u32 A = (u32)(Key >> 32) - 1;
+			u32 B = (u32)Key;
+			Neighbours[NextNeighbours[A]++] = {B, UniquePairs.PairCounts[Slot]};
+			Neighbours[NextNeighbours[B]++] = {A, UniquePairs.PairCounts[Slot]};
+		}
+	}
+	FreeTileUsage(&UniquePairs);
+	for (u32 UniqueTileIndex = 0; UniqueTileIndex < NumUniqueTiles; UniqueTileIndex++)
+	{
+		std::sort(Neighbours + FirstNeighbours[UniqueTileIndex], Neighbours + FirstNeighbours[UniqueTileIndex + 1],
+		          [](tile_neighbour A, tile_neighbour B)
+		{
+			return A.Count > B.Count || (A.Count == B.Count && A.UniqueTileIndex < B.UniqueTileIndex);
+		});
+	}
+
+	// Follow the strongest link out of the last tile placed, or start again from the most used tile left
+	b8* IsPlaced = PushArrayZero(Scratch, NumUniqueTiles, b8);
+	u32 NextByUsage = 0;
+	s32 LastTile = -1;
+	for (u32 Position = 0; Position < NumUniqueTiles; Position++)
+	{
+		s32 Tile = -1;
+		if (LastTile >= 0)
+		{
+			// Placed tiles are never unplaced, so each list only needs to be walked once
+			u32* Next = NextNeighbours + LastTile;
+			for (*Next = FirstNeighbours[LastTile]; *Next < FirstNeighbours[LastTile + 1] && Tile < 0; ++*Next)
+			{
+				if (!IsPlaced[Neighbours[*Next].UniqueTileIndex])
+				{
+					Tile = (s32)Neighbours[*Next].UniqueTileIndex;
+				}
+			}
+		}
+		while (Tile < 0)
+		{
+			u32 Candidate = ByUsage[NextByUsage++];
+			Tile = IsPlaced[Candidate] ? -1 : (s32)Candidate;
+		}
+
+		IsPlaced[Tile] = true;
+		OutNewIndices[Tile] = Position;
+		LastTile = Tile;
+	}
+	EndTemporaryMemory(OrderMemory);
+}
@@ -0,0 +1,208 @@
+// --indexed: tiles converted to indices into a per-tileset palette before they're canonicalised and deduplicated, so
+// every hash, compare and flip touches 64 bytes (8bpp) or 32 bytes (4bpp, for up to 16 colours) instead of 256.
+//
+// The palette is sorted by the same pixel value CompareTiles orders by, and 4bpp tiles keep the left pixel of each
+// pair in the high nibble, so comparing indexed tiles byte by byte orders them exactly as comparing their pixels would.
+// That means indexed tiles canonicalise to the same transform as the RGBA tiles they came from, and the result can be
+// rebuilt from the source image as if it had been minimised in RGBA all along.
+
+#include <algorithm>
+
+#define MAX_PALETTE_COLOURS 256
+#define PALETTE_LOOKUP_SIZE 1024 // Power of 2, and big enough to keep probe sequences short when the palette is full
+
+struct tile_palette
+{
+	u32 Colours[MAX_PALETTE_COLOURS]; // RGB with alpha masked out, in ascending order
+	u32 NumColours;
+	u32 BitsPerPixel; // 4 or 8
+
+	// Open-addressing lookup from colour to index; a key of 0 is an empty slot, so keys have the alpha byte set
+	u32 LookupKeys[PALETTE_LOOKUP_SIZE];
+	u8 LookupIndices[PALETTE_LOOKUP_SIZE];
+};
+
+struct indexed_tile
+{
+	u8 Data[64]; // 8bpp: one index per pixel. 4bpp: only the first 32 bytes are used, two pixels per byte.
+};
+
+u32 GetPaletteSlot(tile_palette* Palette, u32 Key)
+{
+	u32 Mask = PALETTE_LOOKUP_SIZE - 1;
+	u32 Slot = (Key * 2654435761u) >> 22;
+	while (Palette->LookupKeys[Slot] && Palette->LookupKeys[Slot] != Key)
+	{
+		Slot = (Slot + 1) & Mask;
+	}
+	return Slot;
+}
+
+// Returns false if the image has too many colours to be indexed
+b32 BuildTilePalette(tileset_image* Image, tile_palette* OutPalette)
+{
+	tile_palette* Palette = OutPalette;
+	memset(Palette->LookupKeys, 0, sizeof(Palette->LookupKeys));
+	Palette->NumColours = 0;
+
+	// Row order doesn't matter here, so this can run on the image before it's been rearranged into tiles
+	u32* PixelBits = (u32*)Image->Tiles;
+	u32 NumPixels = Image->TileWidth * Image->TileHeight * 64;
+	u32 LastKey = 0;
+	for (u32 PixelIndex = 0; PixelIndex < NumPixels; PixelIndex++)
+	{
+		u32 Key = (PixelBits[PixelIndex] & PIXEL_RGB_MASK) | 0xFF000000;
+		if (Key == LastKey)
+		{
+			continue;
+		}
+		LastKey = Key;
+
+		u32 Slot = GetPaletteSlot(Palette, Key);
+		if (!Palette->LookupKeys[Slot])
+		{
+			if (Palette->NumColours == MAX_PALETTE_COLOURS)
+			{
+				return false;
+			}
+			Palette->LookupKeys[Slot] = Key;
+			Palette->Colours[Palette->NumColours++] = Key & PIXEL_RGB_MASK;
+		}
+	}
+
+	std::sort(Palette->Colours, Palette->Colours + Palette->NumColours);
+	for (u32 ColourIndex = 0; ColourIndex < Palette->NumColours; ColourIndex++)
+	{
+		u32 Slot = GetPaletteSlot(Palette, Palette->Colours[ColourIndex] | 0xFF000000);
+		Palette->LookupIndices[Slot] = (u8)ColourIndex;
+	}
+	Palette->BitsPerPixel = Palette->NumColours <= 16 ? 4 : 8;
+	return true;
+}
+
+u32 GetPaletteIndex(tile_palette* Palette, pixel Pixel)
+{
+	u32 PixelBits;
+	memcpy(&PixelBits, &Pixel, sizeof(PixelBits));
+	u32 Slot = GetPaletteSlot(Palette, (PixelBits & PIXEL_RGB_MASK) | 0xFF000000);
+	Assert(Palette->LookupKeys[Slot]);
+	u32 Result = Palette->LookupIndices[Slot];
+	return Result;
+}
+
+void IndexTile(tile_palette* Palette, tile* Tile, indexed_tile* OutTile)
+{
+	memset(OutTile->Data, 0, sizeof(OutTile->Data));
+	for (u32 PixelIndex = 0; PixelIndex < ArrayCount(Tile->Pixels); PixelIndex++)
+	{
+		u32 Index = GetPaletteIndex(Palette, Tile->Pixels[PixelIndex]);
+		if (Palette->BitsPerPixel == 4)
+		{
+			OutTile->Data[PixelIndex / 2] |= (u8)(PixelIndex % 2 ? Index : Index << 4);
+		}
+		else
+		{
+			OutTile->Data[PixelIndex] = (u8)Index;
+		}
+	}
+}
+
+u64 ReverseBytes64(u64 Value)
+{
+	Value = ((Value & 0x00FF00FF00FF00FFull) << 8) | ((Value >> 8) & 0x00FF00FF00FF00FFull);
+	Value = ((Value & 0x0000FFFF0000FFFFull) << 16) | ((Value >> 16) & 0x0000FFFF0000FFFFull);
+	Value = (Value << 32) | (Value >> 32);
+	return Value;
+}
+
+u32 ReverseNibbles32(u32 Value)
+{
+	Value = ((Value & 0x0F0F0F0F) << 4) | ((Value >> 4) & 0x0F0F0F0F);
+	Value = ((Value & 0x00FF00FF) << 8) | ((Value >> 8) & 0x00FF00FF);
+	Value = (Value << 16) | (Value >> 16);
+	return Value;
+}
+
+// A row is 8 bytes at 8bpp or 4 at 4bpp, so a flip is at most a byte (or nibble) reversal of each row
+void CopyTransformedIndexedTile(indexed_tile* SourceTile, indexed_tile* OutTransformedTile, tile_transform_type Transform,
+                                u32 BitsPerPixel)
+{
+	b32 HFlip = (Transform & TileTransform_HFlip) != 0;
+	b32 VFlip = (Transform & TileTransform_VFlip) != 0;
+	for (u32 Y = 0; Y < 8; Y++)
+	{
+		u32 SourceY = VFlip ? 8 - Y - 1 : Y;
+		if (BitsPerPixel == 4)
+		{
+			u32 Row;
+			memcpy(&Row, SourceTile->Data + SourceY * 4, sizeof(Row));
+			if (HFlip)
+			{
+				Row = ReverseNibbles32(Row);
+			}
+			memcpy(OutTransformedTile->Data + Y * 4, &Row, sizeof(Row));
+		}
+		else
+		{
+			u64 Row;
+			memcpy(&Row, SourceTile->Data + SourceY * 8, sizeof(Row));
+			if (HFlip)
+			{
+				Row = ReverseBytes64(Row);
+			}
+			memcpy(OutTransformedTile->Data + Y * 8, &Row, sizeof(Row));
+		}
+	}
+}
+
+// Same ordering as CompareTiles on the pixels the tiles came from
+s32 CompareIndexedTiles(indexed_tile* A, indexed_tile* B, u32 BitsPerPixel)
+{
+	s32 Result = BitsPerPixel == 4 ? memcmp(A->Data, B->Data, 32) : memcmp(A->Data, B->Data, 64);
+	return Result;
+}
+
+b32 AreIndexedTilesEqual(indexed_tile* A, indexed_tile* B, u32 BitsPerPixel)
+{
+	b32 Result = CompareIndexedTiles(A, B, BitsPerPixel) == 0;
+	return Result;
+}
+
+u32 HashIndexedTile(indexed_tile* Tile, u32 BitsPerPixel)
+{
+	u64 Hash = 14695981039346656037ull;
+	for (u32 Offset = 0; Offset < BitsPerPixel * 8; Offset += sizeof(u64))
+	{
+		u64 Word;
+		memcpy(&Word, Tile->Data + Offset, sizeof(Word));
+		Hash ^= Word;
+		Hash *= 1099511628211ull;
+	}
+	u32 Result = (u32)(Hash ^ (Hash >> 32));
+	return Result;
+}
+
+// Indexed equivalent of CanonicaliseTile: OutCanonical gets the smallest flip of Tile
+void CanonicaliseIndexedTile(indexed_tile* Tile, u32 BitsPerPixel, indexed_tile* OutCanonical, tile_key* OutKey)
+{
+	*OutCanonical = *Tile;
+	OutKey->CanonicalTransform = TileTransform_Unchanged;
+	OutKey->SymmetryMask = 1 << TileTransform_Unchanged;
+
+	for (u32 Transform = TileTransform_HFlip; Transform < TileTransform_Count; Transform++)
+	{
+		indexed_tile Variant;
+		CopyTransformedIndexedTile(Tile, &Variant, (tile_transform_type)Transform, BitsPerPixel);
+
+		if (CompareIndexedTiles(&Variant, OutCanonical, BitsPerPixel) < 0)
+		{
+			*OutCanonical = Variant;
+			OutKey->CanonicalTransform = (tile_transform_type)Transform;
+		}
+		if (AreIndexedTilesEqual(&Variant, Tile, BitsPerPixel))
+		{
+			OutKey->SymmetryMask |= 1 << Transform;
+		}
+	}
+	OutKey->Hash = HashIndexedTile(OutCanonical, BitsPerPixel);
+}
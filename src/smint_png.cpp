@@ -0,0 +1,1127 @@
+// Built-in PNG writer for minimised tileset images (--png-level). stb_image_write only has a simple deflate, which is
+// slow and leaves a lot on the table for big tilesets; this one has zlib-style hash chains with lazy matching, picks the
+// cheapest of stored/fixed/dynamic Huffman for every block, chooses a filter per row, and writes indexed colour (PLTE)
+// whenever the image has 256 colours or fewer, or plain RGB when it has no transparency.
+//
+// The filtered image is cut into fixed-size chunks that are deflated independently (each primed with the 32KB before
+// it, the way pigz does it) and joined into one zlib stream, so spare threads can share the work. The chunk size doesn't
+// depend on the number of threads, so neither does the output.
+
+#include <algorithm>
+
+#define PNG_DEFLATE_CHUNK_SIZE (256 * 1024)
+#define DEFLATE_WINDOW_SIZE 32768
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_TOO_FAR 4096 // A match of the minimum length further back than this costs more than its literals
+#define DEFLATE_HASH_BITS 15
+#define DEFLATE_SYMBOLS_PER_BLOCK 16384
+#define DEFLATE_NUM_LITLEN_CODES 286
+#define DEFLATE_NUM_DIST_CODES 30
+#define DEFLATE_NUM_CODE_LENGTH_CODES 19
+#define DEFLATE_MAX_CODE_LENGTH 15
+#define DEFLATE_MAX_CODE_LENGTH_CODE_LENGTH 7
+#define DEFLATE_END_OF_BLOCK 256
+#define DEFLATE_MAX_STORED_SIZE 65535
+
+struct png_options
+{
+	u32 Level; // 1 (fastest) to 9 (smallest)
+	u32 Filter; // SMINT_PNG_FILTER_*
+	u32 NumThreads; // For deflating; 0 means one per core
+};
+
+// Same meaning as zlib's configuration table, and the same values for each level
+struct deflate_level
+{
+	u32 GoodLength; // Search less hard once a match this long has been found
+	u32 LazyLength; // Don't look for a longer match at the next byte once one is this long; 0 never looks
+	u32 NiceLength; // Stop searching as soon as a match is this long
+	u32 MaxChain;
+};
+
+static const deflate_level DeflateLevels[10] =
+{
+	{0, 0, 0, 0},
+	{4, 0, 8, 4},
+	{4, 0, 16, 8},
+	{4, 0, 32, 32},
+	{4, 4, 16, 16},
+	{8, 16, 32, 32},
+	{8, 16, 128, 128},
+	{8, 32, 128, 256},
+	{32, 128, 258, 1024},
+	{32, 258, 258, 4096}
+};
+
+static const u16 DeflateLengthBase[29] =
+{
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const u8 DeflateLengthExtraBits[29] =
+{
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const u16 DeflateDistBase[DEFLATE_NUM_DIST_CODES] =
+{
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+	8193, 12289, 16385, 24577
+};
+static const u8 DeflateDistExtraBits[DEFLATE_NUM_DIST_CODES] =
+{
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+static const u8 CodeLengthCodeOrder[DEFLATE_NUM_CODE_LENGTH_CODES] =
+{
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+// Length (3-258) and distance (1-32768) to the index of their code, as in zlib's _length_code/_dist_code
+struct deflate_code_tables
+{
+	u8 LengthCodes[DEFLATE_MAX_MATCH + 1];
+	u8 DistCodes[512]; // Distances up to 256 directly, then by (Distance - 1) >> 7
+};
+
+deflate_code_tables BuildDeflateCodeTables()
+{
+	deflate_code_tables Result = {};
+	for (u32 Code = 0; Code < ArrayCount(DeflateLengthBase); Code++)
+	{
+		for (u32 Length = DeflateLengthBase[Code]; Length < DeflateLengthBase[Code] + (1u << DeflateLengthExtraBits[Code]) &&
+		                                           Length <= DEFLATE_MAX_MATCH; Length++)
+		{
+			Result.LengthCodes[Length] = (u8)Code;
+		}
+	}
+	Result.LengthCodes[DEFLATE_MAX_MATCH] = 28; // 258 has a code of its own, rather than being 227 + 31
+	for (u32 Code = 0; Code < DEFLATE_NUM_DIST_CODES; Code++)
+	{
+		for (u32 Dist = DeflateDistBase[Code]; Dist < DeflateDistBase[Code] + (1u << DeflateDistExtraBits[Code]); Dist++)
+		{
+			if (Dist <= 256)
+			{
+				Result.DistCodes[Dist - 1] = (u8)Code;
+			}
+			else
+			{
+				Result.DistCodes[256 + ((Dist - 1) >> 7)] = (u8)Code;
+			}
+		}
+	}
+	return Result;
+}
+
+const deflate_code_tables* GetDeflateCodeTables()
+{
+	static const deflate_code_tables Tables = BuildDeflateCodeTables();
+	return &Tables;
+}
+
+u32 GetDistCode(const deflate_code_tables* Tables, u32 Dist)
+{
+	u32 Result = Dist <= 256 ? Tables->DistCodes[Dist - 1] : Tables->DistCodes[256 + ((Dist - 1) >> 7)];
+	return Result;
+}
+
+// One LZ77 output symbol
+struct lz_symbol
+{
+	u16 LitLen; // A literal byte if Dist is 0, otherwise the length of the match
+	u16 Dist;
+};
+
+struct bit_writer
+{
+	u8* Data; // TrackedMalloc'd
+	u64 Size;
+	u64 Capacity;
+	u64 Bits;
+	u32 NumBits;
+};
+
+void WriteByte(bit_writer* Writer, u8 Byte)
+{
+	if (Writer->Size == Writer->Capacity)
+	{
+		Writer->Capacity = Writer->Capacity ? Writer->Capacity * 2 : 4096;
+		Writer->Data = (u8*)TrackedRealloc(Writer->Data, Writer->Capacity);
+	}
+	Writer->Data[Writer->Size++] = Byte;
+}
+
+// Deflate packs everything from the least significant bit up, apart from Huffman codes (see BuildHuffmanCodes)
+void WriteBits(bit_writer* Writer, u32 Value, u32 Count)
+{
+	Writer->Bits |= (u64)Value << Writer->NumBits;
+	Writer->NumBits += Count;
+	while (Writer->NumBits >= 8)
+	{
+		WriteByte(Writer, (u8)Writer->Bits);
+		Writer->Bits >>= 8;
+		Writer->NumBits -= 8;
+	}
+}
+
+// PNG and zlib both store their own numbers most significant byte first
+void WriteBigEndian32(bit_writer* Writer, u32 Value)
+{
+	for (s32 Shift = 24; Shift >= 0; Shift -= 8)
+	{
+		WriteByte(Writer, (u8)(Value >> Shift));
+	}
+}
+
+void AlignToByte(bit_writer* Writer)
+{
+	if (Writer->NumBits)
+	{
+		WriteByte(Writer, (u8)Writer->Bits);
+	}
+	Writer->Bits = 0;
+	Writer->NumBits = 0;
+}
+
+// Moffat and Katajainen's in-place minimum-redundancy code: Weights (in ascending order) become code lengths
+void CalculateMinimumRedundancy(u32* Weights, s32 Count)
+{
+	u32* A = Weights;
+	if (Count == 1)
+	{
+		A[0] = 1;
+		return;
+	}
+
+	A[0] += A[1];
+	s32 Root = 0;
+	s32 Leaf = 2;
+	for (s32 Next = 1; Next < Count - 1; Next++)
+	{
+		if (Leaf >= Count || A[Root] < A[Leaf])
+		{
+			A[Next] = A[Root];
+			A[Root++] = (u32)Next;
+		}
+		else
+		{
+			A[Next] = A[Leaf++];
+		}
+
+		if (Leaf >= Count || (Root < Next && A[Root] < A[Leaf]))
+		{
+			A[Next] += A[Root];
+			A[Root++] = (u32)Next;
+		}
+		else
+		{
+			A[Next] += A[Leaf++];
+		}
+	}
+
+	A[Count - 2] = 0;
+	for (s32 Next = Count - 3; Next >= 0; Next--)
+	{
+		A[Next] = A[A[Next]] + 1;
+	}
+
+	s32 Available = 1;
+	s32 Used = 0;
+	u32 Depth = 0;
+	Root = Count - 2;
+	s32 Next = Count - 1;
+	while (Available > 0)
+	{
+		while (Root >= 0 && A[Root] == Depth)
+		{
+			Used++;
+			Root--;
+		}
+		while (Available > Used)
+		{
+			A[Next--] = Depth;
+			Available--;
+		}
+		Available = 2 * Used;
+		Depth++;
+		Used = 0;
+	}
+}
+
+// Code lengths of at most MaxLength bits. Like zlib, at least two symbols always get a code (even if one of them is
+// never used), so every decoder accepts the result.
+void BuildHuffmanLengths(u32* Freqs, u32 NumSymbols, u32 MaxLength, u8* OutLengths)
+{
+	Assert(NumSymbols >= 2 && NumSymbols <= DEFLATE_NUM_LITLEN_CODES);
+	u32 Symbols[DEFLATE_NUM_LITLEN_CODES];
+	u32 Weights[DEFLATE_NUM_LITLEN_CODES] = {}; // Only the first NumUsed (always at least 2) are filled in
+	u32 NumUsed = 0;
+	for (u32 Symbol = 0; Symbol < NumSymbols; Symbol++)
+	{
+		if (Freqs[Symbol])
+		{
+			Symbols[NumUsed++] = Symbol;
+		}
+	}
+	for (u32 Symbol = 0; Symbol < NumSymbols && NumUsed < 2; Symbol++)
+	{
+		if (!Freqs[Symbol])
+		{
+			Symbols[NumUsed++] = Symbol;
+		}
+	}
+	std::stable_sort(Symbols, Symbols + NumUsed, [Freqs](u32 A, u32 B)
+	{
+		return Freqs[A] < Freqs[B];
+	});
+	for (u32 Index = 0; Index < NumUsed; Index++)
+	{
+		Weights[Index] = Freqs[Symbols[Index]] ? Freqs[Symbols[Index]] : 1;
+	}
+	CalculateMinimumRedundancy(Weights, (s32)NumUsed);
+
+	// Anything too long is cut down to MaxLength, then codes are pushed down a level until the lengths add up again
+	u32 NumCodes[DEFLATE_NUM_LITLEN_CODES + 1] = {};
+	for (u32 Index = 0; Index < NumUsed; Index++)
+	{
+		NumCodes[Weights[Index] < MaxLength ? Weights[Index] : MaxLength]++;
+	}
+	u32 Total = 0;
+	for (u32 Length = MaxLength; Length > 0; Length--)
+	{
+		Total += NumCodes[Length] << (MaxLength - Length);
+	}
+	while (Total != (1u << MaxLength))
+	{
+		NumCodes[MaxLength]--;
+		for (u32 Length = MaxLength - 1; Length > 0; Length--)
+		{
+			if (NumCodes[Length])
+			{
+				NumCodes[Length]--;
+				NumCodes[Length + 1] += 2;
+				break;
+			}
+		}
+		Total--;
+	}
+
+	// The least frequent symbols get the longest codes
+	memset(OutLengths, 0, NumSymbols);
+	u32 SortedIndex = 0;
+	for (u32 Length = MaxLength; Length > 0; Length--)
+	{
+		for (u32 Count = NumCodes[Length]; Count > 0; Count--)
+		{
+			OutLengths[Symbols[SortedIndex++]] = (u8)Length;
+		}
+	}
+}
+
+// Canonical codes, bit-reversed so they can go through WriteBits like everything else
+void BuildHuffmanCodes(u8* Lengths, u32 NumSymbols, u16* OutCodes)
+{
+	u32 NumCodes[DEFLATE_MAX_CODE_LENGTH + 1] = {};
+	for (u32 Symbol = 0; Symbol < NumSymbols; Symbol++)
+	{
+		NumCodes[Lengths[Symbol]]++;
+	}
+	NumCodes[0] = 0;
+
+	u32 NextCodes[DEFLATE_MAX_CODE_LENGTH + 1] = {};
+	u32 Code = 0;
+	for (u32 Length = 1; Length <= DEFLATE_MAX_CODE_LENGTH; Length++)
+	{
+		Code = (Code + NumCodes[Length - 1]) << 1;
+		NextCodes[Length] = Code;
+	}
+
+	for (u32 Symbol = 0; Symbol < NumSymbols; Symbol++)
+	{
+		u32 Length = Lengths[Symbol];
+		u32 Reversed = 0;
+		if (Length)
+		{
+			u32 SymbolCode = NextCodes[Length]++;
+			for (u32 Bit = 0; Bit < Length; Bit++)
+			{
+				Reversed = (Reversed << 1) | ((SymbolCode >> Bit) & 1);
+			}
+		}
+		OutCodes[Symbol] = (u16)Reversed;
+	}
+}
+
+// Code length codes for a dynamic block's header: lengths, with runs turned into 16 (repeat the previous length 3-6
+// times), 17 (3-10 zeros) and 18 (11-138 zeros)
+struct code_length_symbol
+{
+	u8 Symbol;
+	u8 ExtraBits;
+};
+
+u32 EncodeCodeLengths(u8* Lengths, u32 NumLengths, code_length_symbol* OutSymbols)
+{
+	u32 NumSymbols = 0;
+	u32 Index = 0;
+	while (Index < NumLengths)
+	{
+		u8 Length = Lengths[Index];
+		u32 Run = 1;
+		while (Index + Run < NumLengths && Lengths[Index + Run] == Length)
+		{
+			Run++;
+		}
+		Index += Run;
+
+		if (Length == 0)
+		{
+			while (Run >= 11)
+			{
+				u32 Count = Run < 138 ? Run : 138;
+				OutSymbols[NumSymbols++] = {18, (u8)(Count - 11)};
+				Run -= Count;
+			}
+			if (Run >= 3)
+			{
+				OutSymbols[NumSymbols++] = {17, (u8)(Run - 3)};
+				Run = 0;
+			}
+		}
+		else
+		{
+			OutSymbols[NumSymbols++] = {Length, 0};
+			Run--;
+			while (Run >= 3)
+			{
+				u32 Count = Run < 6 ? Run : 6;
+				OutSymbols[NumSymbols++] = {16, (u8)(Count - 3)};
+				Run -= Count;
+			}
+		}
+		while (Run > 0)
+		{
+			OutSymbols[NumSymbols++] = {Length, 0};
+			Run--;
+		}
+	}
+	return NumSymbols;
+}
+
+u32 GetFixedLitLenLength(u32 Symbol)
+{
+	u32 Result = Symbol < 144 ? 8 : Symbol < 256 ? 9 : Symbol < 280 ? 7 : 8;
+	return Result;
+}
+
+void WriteSymbols(bit_writer* Out, lz_symbol* Symbols, u32 NumSymbols, u16* LitLenCodes, u8* LitLenLengths, u16* DistCodes,
+                  u8* DistLengths)
+{
+	const deflate_code_tables* Tables = GetDeflateCodeTables();
+	for (u32 SymbolIndex = 0; SymbolIndex < NumSymbols; SymbolIndex++)
+	{
+		lz_symbol Symbol = Symbols[SymbolIndex];
+		if (!Symbol.Dist)
+		{
+			WriteBits(Out, LitLenCodes[Symbol.LitLen], LitLenLengths[Symbol.LitLen]);
+			continue;
+		}
+
+		u32 LengthCode = Tables->LengthCodes[Symbol.LitLen];
+		WriteBits(Out, LitLenCodes[257 + LengthCode], LitLenLengths[257 + LengthCode]);
+		WriteBits(Out, Symbol.LitLen - DeflateLengthBase[LengthCode], DeflateLengthExtraBits[LengthCode]);
+		u32 DistCode = GetDistCode(Tables, Symbol.Dist);
+		WriteBits(Out, DistCodes[DistCode], DistLengths[DistCode]);
+		WriteBits(Out, Symbol.Dist - DeflateDistBase[DistCode], DeflateDistExtraBits[DistCode]);
+	}
+	WriteBits(Out, LitLenCodes[DEFLATE_END_OF_BLOCK], LitLenLengths[DEFLATE_END_OF_BLOCK]);
+}
+
+// Writes Symbols (which encode the RawSize bytes at Raw) as whichever kind of block comes out smallest
+void WriteDeflateBlock(bit_writer* Out, lz_symbol* Symbols, u32 NumSymbols, u8* Raw, u32 RawSize, b32 IsFinal)
+{
+	const deflate_code_tables* Tables = GetDeflateCodeTables();
+	u32 LitLenFreqs[DEFLATE_NUM_LITLEN_CODES] = {};
+	u32 DistFreqs[DEFLATE_NUM_DIST_CODES] = {};
+	u64 ExtraBits = 0;
+	for (u32 SymbolIndex = 0; SymbolIndex < NumSymbols; SymbolIndex++)
+	{
+		lz_symbol Symbol = Symbols[SymbolIndex];
+		if (!Symbol.Dist)
+		{
+			LitLenFreqs[Symbol.LitLen]++;
+			continue;
+		}
+		u32 LengthCode = Tables->LengthCodes[Symbol.LitLen];
+		u32 DistCode = GetDistCode(Tables, Symbol.Dist);
+		LitLenFreqs[257 + LengthCode]++;
+		DistFreqs[DistCode]++;
+		ExtraBits += DeflateLengthExtraBits[LengthCode] + DeflateDistExtraBits[DistCode];
+	}
+	LitLenFreqs[DEFLATE_END_OF_BLOCK] = 1;
+
+	u8 LitLenLengths[DEFLATE_NUM_LITLEN_CODES];
+	u8 DistLengths[DEFLATE_NUM_DIST_CODES];
+	BuildHuffmanLengths(LitLenFreqs, DEFLATE_NUM_LITLEN_CODES, DEFLATE_MAX_CODE_LENGTH, LitLenLengths);
+	BuildHuffmanLengths(DistFreqs, DEFLATE_NUM_DIST_CODES, DEFLATE_MAX_CODE_LENGTH, DistLengths);
+
+	u32 NumLitLenLengths = DEFLATE_NUM_LITLEN_CODES;
+	while (NumLitLenLengths > 257 && !LitLenLengths[NumLitLenLengths - 1])
+	{
+		NumLitLenLengths--;
+	}
+	u32 NumDistLengths = DEFLATE_NUM_DIST_CODES;
+	while (NumDistLengths > 1 && !DistLengths[NumDistLengths - 1])
+	{
+		NumDistLengths--;
+	}
+
+	// Both sets of lengths are run-length encoded as one sequence
+	u8 AllLengths[DEFLATE_NUM_LITLEN_CODES + DEFLATE_NUM_DIST_CODES];
+	memcpy(AllLengths, LitLenLengths, NumLitLenLengths);
+	memcpy(AllLengths + NumLitLenLengths, DistLengths, NumDistLengths);
+	code_length_symbol CodeLengthSymbols[DEFLATE_NUM_LITLEN_CODES + DEFLATE_NUM_DIST_CODES];
+	u32 NumCodeLengthSymbols = EncodeCodeLengths(AllLengths, NumLitLenLengths + NumDistLengths, CodeLengthSymbols);
+
+	u32 CodeLengthFreqs[DEFLATE_NUM_CODE_LENGTH_CODES] = {};
+	for (u32 Index = 0; Index < NumCodeLengthSymbols; Index++)
+	{
+		CodeLengthFreqs[CodeLengthSymbols[Index].Symbol]++;
+	}
+	u8 CodeLengthLengths[DEFLATE_NUM_CODE_LENGTH_CODES];
+	BuildHuffmanLengths(CodeLengthFreqs, DEFLATE_NUM_CODE_LENGTH_CODES, DEFLATE_MAX_CODE_LENGTH_CODE_LENGTH, CodeLengthLengths);
+	u32 NumCodeLengthLengths = DEFLATE_NUM_CODE_LENGTH_CODES;
+	while (NumCodeLengthLengths > 4 && !CodeLengthLengths[CodeLengthCodeOrder[NumCodeLengthLengths - 1]])
+	{
+		NumCodeLengthLengths--;
+	}
+
+	u64 DynamicBits = 3 + 14 + 3 * NumCodeLengthLengths + ExtraBits;
+	u64 FixedBits = 3 + ExtraBits;
+	for (u32 Index = 0; Index < NumCodeLengthSymbols; Index++)
+	{
+		u32 Symbol = CodeLengthSymbols[Index].Symbol;
+		DynamicBits += CodeLengthLengths[Symbol] + (Symbol == 16 ? 2 : Symbol == 17 ? 3 : Symbol == 18 ? 7 : 0);
+	}
+	for (u32 Symbol = 0; Symbol < DEFLATE_NUM_LITLEN_CODES; Symbol++)
+	{
+		DynamicBits += (u64)LitLenFreqs[Symbol] * LitLenLengths[Symbol];
+		FixedBits += (u64)LitLenFreqs[Symbol] * GetFixedLitLenLength(Symbol);
+	}
+	for (u32 Symbol = 0; Symbol < DEFLATE_NUM_DIST_CODES; Symbol++)
+	{
+		DynamicBits += (u64)DistFreqs[Symbol] * DistLengths[Symbol];
+		FixedBits += (u64)DistFreqs[Symbol] * 5;
+	}
+	u32 NumStoredBlocks = RawSize ? (RawSize + DEFLATE_MAX_STORED_SIZE - 1) / DEFLATE_MAX_STORED_SIZE : 1;
+	u64 StoredBits = (u64)NumStoredBlocks * (3 + 7 + 32) + (u64)RawSize * 8;
+
+	if (StoredBits < FixedBits && StoredBits < DynamicBits)
+	{
+		u32 Offset = 0;
+		for (u32 BlockIndex = 0; BlockIndex < NumStoredBlocks; BlockIndex++)
+		{
+			u32 Size = RawSize - Offset < DEFLATE_MAX_STORED_SIZE ? RawSize - Offset : DEFLATE_MAX_STORED_SIZE;
+			WriteBits(Out, (IsFinal && BlockIndex == NumStoredBlocks - 1) ? 1 : 0, 1);
+			WriteBits(Out, 0, 2);
+			AlignToByte(Out);
+			WriteBits(Out, Size, 16);
+			WriteBits(Out, Size ^ 0xFFFF, 16);
+			for (u32 ByteIndex = 0; ByteIndex < Size; ByteIndex++)
+			{
+				WriteByte(Out, Raw[Offset + ByteIndex]);
+			}
+			Offset += Size;
+		}
+		return;
+	}
+
+	u16 LitLenCodes[DEFLATE_NUM_LITLEN_CODES + 2];
+	u16 DistCodes[DEFLATE_NUM_DIST_CODES];
+	if (FixedBits <= DynamicBits)
+	{
+		WriteBits(Out, IsFinal ? 1 : 0, 1);
+		WriteBits(Out, 1, 2);
+		u8 FixedLitLenLengths[DEFLATE_NUM_LITLEN_CODES + 2];
+		u8 FixedDistLengths[DEFLATE_NUM_DIST_CODES];
+		for (u32 Symbol = 0; Symbol < ArrayCount(FixedLitLenLengths); Symbol++)
+		{
+			FixedLitLenLengths[Symbol] = (u8)GetFixedLitLenLength(Symbol);
+		}
+		memset(FixedDistLengths, 5, sizeof(FixedDistLengths));
+		BuildHuffmanCodes(FixedLitLenLengths, ArrayCount(FixedLitLenLengths), LitLenCodes);
+		BuildHuffmanCodes(FixedDistLengths, DEFLATE_NUM_DIST_CODES, DistCodes);
+		WriteSymbols(Out, Symbols, NumSymbols, LitLenCodes, FixedLitLenLengths, DistCodes, FixedDistLengths);
+		return;
+	}
+
+	WriteBits(Out, IsFinal ? 1 : 0, 1);
+	WriteBits(Out, 2, 2);
+	WriteBits(Out, NumLitLenLengths - 257, 5);
+	WriteBits(Out, NumDistLengths - 1, 5);
+	WriteBits(Out, NumCodeLengthLengths - 4, 4);
+	for (u32 Index = 0; Index < NumCodeLengthLengths; Index++)
+	{
+		WriteBits(Out, CodeLengthLengths[CodeLengthCodeOrder[Index]], 3);
+	}
+	u16 CodeLengthCodes[DEFLATE_NUM_CODE_LENGTH_CODES];
+	BuildHuffmanCodes(CodeLengthLengths, DEFLATE_NUM_CODE_LENGTH_CODES, CodeLengthCodes);
+	for (u32 Index = 0; Index < NumCodeLengthSymbols; Index++)
+	{
+		code_length_symbol Symbol = CodeLengthSymbols[Index];
+		WriteBits(Out, CodeLengthCodes[Symbol.Symbol], CodeLengthLengths[Symbol.Symbol]);
+		if (Symbol.Symbol >= 16)
+		{
+			WriteBits(Out, Symbol.ExtraBits, Symbol.Symbol == 16 ? 2 : Symbol.Symbol == 17 ? 3 : 7);
+		}
+	}
+	BuildHuffmanCodes(LitLenLengths, DEFLATE_NUM_LITLEN_CODES, LitLenCodes);
+	BuildHuffmanCodes(DistLengths, DEFLATE_NUM_DIST_CODES, DistCodes);
+	WriteSymbols(Out, Symbols, NumSymbols, LitLenCodes, LitLenLengths, DistCodes, DistLengths);
+}
+
+// What each deflate thread keeps from one chunk to the next
+struct deflate_scratch
+{
+	u32* Head; // 1 << DEFLATE_HASH_BITS of them: the last position with each hash, plus 1 (0 is none)
+	u32* Prev; // The position before it with the same hash, by position; covers a chunk and the window before it
+	lz_symbol* Symbols; // DEFLATE_SYMBOLS_PER_BLOCK of them
+};
+
+u32 HashDeflateBytes(u8* Bytes)
+{
+	u32 Value = (u32)Bytes[0] << 16 | (u32)Bytes[1] << 8 | Bytes[2];
+	u32 Result = (Value * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+	return Result;
+}
+
+// Positions in Head/Prev are relative to Base
+struct deflate_matcher
+{
+	u8* Data;
+	u32 Base;
+	u32 End;
+	u32 NextInsert;
+	deflate_scratch* Scratch;
+	const deflate_level* Level;
+};
+
+// Adds every position before Pos to the hash chains
+void InsertDeflateHashes(deflate_matcher* Matcher, u32 Pos)
+{
+	for (; Matcher->NextInsert < Pos && Matcher->NextInsert + DEFLATE_MIN_MATCH <= Matcher->End; Matcher->NextInsert++)
+	{
+		u32 Hash = HashDeflateBytes(Matcher->Data + Matcher->NextInsert);
+		Matcher->Scratch->Prev[Matcher->NextInsert - Matcher->Base] = Matcher->Scratch->Head[Hash];
+		Matcher->Scratch->Head[Hash] = Matcher->NextInsert - Matcher->Base + 1;
+	}
+	if (Matcher->NextInsert < Pos)
+	{
+		Matcher->NextInsert = Pos;
+	}
+}
+
+// Returns the length of the longest match for the bytes at Pos (0 if there's none worth having)
+u32 FindLongestMatch(deflate_matcher* Matcher, u32 Pos, u32* OutDist)
+{
+	InsertDeflateHashes(Matcher, Pos);
+	u32 MaxLength = Matcher->End - Pos < DEFLATE_MAX_MATCH ? Matcher->End - Pos : DEFLATE_MAX_MATCH;
+	if (MaxLength < DEFLATE_MIN_MATCH)
+	{
+		return 0;
+	}
+
+	u8* Data = Matcher->Data;
+	u8* Current = Data + Pos;
+	u32 BestLength = DEFLATE_MIN_MATCH - 1;
+	u32 BestDist = 0;
+	u32 ChainLeft = Matcher->Level->MaxChain;
+	for (u32 Candidate = Matcher->Scratch->Head[HashDeflateBytes(Current)]; Candidate && ChainLeft; ChainLeft--)
+	{
+		u32 CandidatePos = Matcher->Base + Candidate - 1;
+		if (Pos - CandidatePos > DEFLATE_WINDOW_SIZE)
+		{
+			break;
+		}
+
+		u8* Previous = Data + CandidatePos;
+		if (Previous[BestLength] == Current[BestLength] && Previous[0] == Current[0])
+		{
+			// Eight bytes at a time until they differ, then byte by byte
+			u32 Length = 0;
+			while (Length + 8 <= MaxLength)
+			{
+				u64 PreviousBytes, CurrentBytes;
+				memcpy(&PreviousBytes, Previous + Length, 8);
+				memcpy(&CurrentBytes, Current + Length, 8);
+				if (PreviousBytes != CurrentBytes)
+				{
+					break;
+				}
+				Length += 8;
+			}
+			while (Length < MaxLength && Previous[Length] == Current[Length])
+			{
+				Length++;
+			}
+			if (Length > BestLength)
+			{
+				BestLength = Length;
+				BestDist = Pos - CandidatePos;
+				if (Length >= Matcher->Level->NiceLength || Length == MaxLength)
+				{
+					break;
+				}
+				if (Length >= Matcher->Level->GoodLength && ChainLeft > 4)
+				{
+					ChainLeft >>= 2;
+				}
+			}
+		}
+		Candidate = Matcher->Scratch->Prev[CandidatePos - Matcher->Base];
+	}
+
+	if (BestLength < DEFLATE_MIN_MATCH || (BestLength == DEFLATE_MIN_MATCH && BestDist > DEFLATE_TOO_FAR))
+	{
+		return 0;
+	}
+	*OutDist = BestDist;
+	return BestLength;
+}
+
+// Deflates Data[Start, End) as a run of blocks, with matches reaching back into the window before Start. Unless it's
+// the last chunk, it ends with an empty stored block so the next chunk's output starts on a byte boundary.
+void DeflateChunk(u8* Data, u32 Start, u32 End, b32 IsLast, const deflate_level* Level, deflate_scratch* Scratch,
+                  bit_writer* Out)
+{
+	deflate_matcher Matcher;
+	Matcher.Data = Data;
+	Matcher.Base = Start > DEFLATE_WINDOW_SIZE ? Start - DEFLATE_WINDOW_SIZE : 0;
+	Matcher.End = End;
+	Matcher.NextInsert = Matcher.Base;
+	Matcher.Scratch = Scratch;
+	Matcher.Level = Level;
+	memset(Scratch->Head, 0, sizeof(u32) << DEFLATE_HASH_BITS);
+
+	u32 NumSymbols = 0;
+	u32 BlockStart = Start;
+	u32 Pos = Start;
+	u32 PendingPos = 0; // A match already found at the next byte while deciding whether to take the last one
+	u32 PendingLength = 0;
+	u32 PendingDist = 0;
+	while (Pos < End)
+	{
+		u32 Dist = 0;
+		u32 Length;
+		if (PendingLength && PendingPos == Pos)
+		{
+			Length = PendingLength;
+			Dist = PendingDist;
+		}
+		else
+		{
+			Length = FindLongestMatch(&Matcher, Pos, &Dist);
+		}
+		PendingLength = 0;
+
+		if (Length && Length < Level->LazyLength && Pos + 1 < End)
+		{
+			// Lazy matching: a literal now is worth it if the next byte starts a longer match
+			u32 NextDist = 0;
+			u32 NextLength = FindLongestMatch(&Matcher, Pos + 1, &NextDist);
+			if (NextLength > Length)
+			{
+				PendingPos = Pos + 1;
+				PendingLength = NextLength;
+				PendingDist = NextDist;
+				Length = 0;
+			}
+		}
+
+		if (Length)
+		{
+			Scratch->Symbols[NumSymbols++] = {(u16)Length, (u16)Dist};
+			Pos += Length;
+		}
+		else
+		{
+			Scratch->Symbols[NumSymbols++] = {Data[Pos], 0};
+			Pos++;
+		}
+
+		if (NumSymbols == DEFLATE_SYMBOLS_PER_BLOCK && Pos < End)
+		{
+			WriteDeflateBlock(Out, Scratch->Symbols, NumSymbols, Data + BlockStart, Pos - BlockStart, false);
+			NumSymbols = 0;
+			BlockStart = Pos;
+		}
+	}
+	WriteDeflateBlock(Out, Scratch->Symbols, NumSymbols, Data + BlockStart, End - BlockStart, IsLast);
+
+	if (IsLast)
+	{
+		AlignToByte(Out);
+	}
+	else
+	{
+		WriteBits(Out, 0, 3);
+		AlignToByte(Out);
+		WriteBits(Out, 0x0000, 16);
+		WriteBits(Out, 0xFFFF, 16);
+	}
+}
+
+struct deflate_job
+{
+	u8* Data;
+	u32 Size;
+	u32 NumChunks;
+	const deflate_level* Level;
+	bit_writer* Outputs; // One per chunk
+	std::atomic<u32> NextChunkIndex;
+};
+
+void RunDeflateJob(deflate_job* Job)
+{
+	u32 MaxCovered = (Job->Size < PNG_DEFLATE_CHUNK_SIZE ? Job->Size : PNG_DEFLATE_CHUNK_SIZE) + DEFLATE_WINDOW_SIZE;
+	deflate_scratch Scratch;
+	Scratch.Head = (u32*)TrackedMalloc(sizeof(u32) << DEFLATE_HASH_BITS);
+	Scratch.Prev = (u32*)TrackedMalloc(sizeof(u32) * MaxCovered);
+	Scratch.Symbols = (lz_symbol*)TrackedMalloc(sizeof(lz_symbol) * DEFLATE_SYMBOLS_PER_BLOCK);
+	for (;;)
+	{
+		u32 ChunkIndex = Job->NextChunkIndex++;
+		if (ChunkIndex >= Job->NumChunks)
+		{
+			break;
+		}
+		u32 Start = ChunkIndex * PNG_DEFLATE_CHUNK_SIZE;
+		u32 End = Job->Size - Start > PNG_DEFLATE_CHUNK_SIZE ? Start + PNG_DEFLATE_CHUNK_SIZE : Job->Size;
+		DeflateChunk(Job->Data, Start, End, ChunkIndex == Job->NumChunks - 1, Job->Level, &Scratch,
+		             Job->Outputs + ChunkIndex);
+	}
+	TrackedFree(Scratch.Head);
+	TrackedFree(Scratch.Prev);
+	TrackedFree(Scratch.Symbols);
+}
+
+u32 ComputeAdler32(u8* Data, u32 Size)
+{
+	u32 A = 1;
+	u32 B = 0;
+	while (Size)
+	{
+		// The most bytes that can be summed before B could overflow
+		u32 Count = Size < 5552 ? Size : 5552;
+		Size -= Count;
+		while (Count--)
+		{
+			A += *Data++;
+			B += A;
+		}
+		A %= 65521;
+		B %= 65521;
+	}
+	u32 Result = (B << 16) | A;
+	return Result;
+}
+
+// Appends a zlib stream of Data to Out
+void WriteZlibStream(bit_writer* Out, u8* Data, u32 Size, u32 Level, u32 NumThreads)
+{
+	u32 NumChunks = Size ? (Size + PNG_DEFLATE_CHUNK_SIZE - 1) / PNG_DEFLATE_CHUNK_SIZE : 1;
+	deflate_job Job;
+	Job.Data = Data;
+	Job.Size = Size;
+	Job.NumChunks = NumChunks;
+	Job.Level = DeflateLevels + Level;
+	Job.Outputs = (bit_writer*)TrackedCalloc(NumChunks, sizeof(bit_writer));
+	Job.NextChunkIndex = 0;
+
+	if (NumThreads == 0)
+	{
+		NumThreads = std::thread::hardware_concurrency();
+	}
+	NumThreads = NumThreads < NumChunks ? NumThreads : NumChunks;
+	std::thread* Workers = new std::thread[NumThreads];
+	for (u32 ThreadIndex = 1; ThreadIndex < NumThreads; ThreadIndex++)
+	{
+		Workers[ThreadIndex] = std::thread(RunDeflateJob, &Job);
+	}
+	RunDeflateJob(&Job);
+	for (u32 ThreadIndex = 1; ThreadIndex < NumThreads; ThreadIndex++)
+	{
+		Workers[ThreadIndex].join();
+	}
+	delete[] Workers;
+
+	// FLEVEL is just a hint, on the same scale zlib uses
+	u32 Flags = (Level < 2 ? 0 : Level < 6 ? 1 : Level == 6 ? 2 : 3) << 6;
+	Flags += 31 - ((0x78 << 8) | Flags) % 31;
+	WriteByte(Out, 0x78);
+	WriteByte(Out, (u8)Flags);
+	for (u32 ChunkIndex = 0; ChunkIndex < NumChunks; ChunkIndex++)
+	{
+		bit_writer* Chunk = Job.Outputs + ChunkIndex;
+		for (u64 ByteIndex = 0; ByteIndex < Chunk->Size; ByteIndex++)
+		{
+			WriteByte(Out, Chunk->Data[ByteIndex]);
+		}
+		TrackedFree(Chunk->Data);
+	}
+	TrackedFree(Job.Outputs);
+
+	u32 Adler = ComputeAdler32(Data, Size);
+	WriteBigEndian32(Out, Adler);
+}
+
+// Colours are pixels as u32s, alpha included
+struct png_palette
+{
+	u32 Colours[256]; // Translucent colours first, so tRNS only has to cover those
+	u32 NumColours;
+	u32 NumTranslucent;
+
+	// Open-addressing lookup from colour to index + 1 (0 is an empty slot)
+	u32 LookupKeys[1024];
+	u16 LookupIndices[1024];
+};
+
+u32 GetPngPaletteSlot(png_palette* Palette, u32 Colour)
+{
+	u32 Mask = ArrayCount(Palette->LookupKeys) - 1;
+	u32 Slot = (Colour * 2654435761u) >> 22;
+	while (Palette->LookupIndices[Slot] && Palette->LookupKeys[Slot] != Colour)
+	{
+		Slot = (Slot + 1) & Mask;
+	}
+	return Slot;
+}
+
+// Returns false if there are too many colours for a palette
+b32 BuildPngPalette(u32* Pixels, u32 NumPixels, png_palette* OutPalette)
+{
+	png_palette* Palette = OutPalette;
+	memset(Palette->LookupIndices, 0, sizeof(Palette->LookupIndices));
+	Palette->NumColours = 0;
+	for (u32 PixelIndex = 0; PixelIndex < NumPixels; PixelIndex++)
+	{
+		u32 Slot = GetPngPaletteSlot(Palette, Pixels[PixelIndex]);
+		if (!Palette->LookupIndices[Slot])
+		{
+			if (Palette->NumColours == ArrayCount(Palette->Colours))
+			{
+				return false;
+			}
+			Palette->LookupKeys[Slot] = Pixels[PixelIndex];
+			Palette->LookupIndices[Slot] = 1;
+			Palette->Colours[Palette->NumColours++] = Pixels[PixelIndex];
+		}
+	}
+
+	// Otherwise in order of first appearance
+	std::stable_partition(Palette->Colours, Palette->Colours + Palette->NumColours, [](u32 Colour)
+	{
+		return (Colour >> 24) != 0xFF;
+	});
+	Palette->NumTranslucent = 0;
+	for (u32 ColourIndex = 0; ColourIndex < Palette->NumColours; ColourIndex++)
+	{
+		u32 Colour = Palette->Colours[ColourIndex];
+		Palette->LookupIndices[GetPngPaletteSlot(Palette, Colour)] = (u16)(ColourIndex + 1);
+		Palette->NumTranslucent += (Colour >> 24) != 0xFF;
+	}
+	return true;
+}
+
+u8 PaethPredictor(u8 Left, u8 Up, u8 UpLeft)
+{
+	s32 Estimate = (s32)Left + Up - UpLeft;
+	s32 ToLeft = abs(Estimate - Left);
+	s32 ToUp = abs(Estimate - Up);
+	s32 ToUpLeft = abs(Estimate - UpLeft);
+	u8 Result = (ToLeft <= ToUp && ToLeft <= ToUpLeft) ? Left : (ToUp <= ToUpLeft ? Up : UpLeft);
+	return Result;
+}
+
+// Filter is the PNG filter type (0-4); Previous is the unfiltered row above, or nullptr for the first
+void FilterPngRow(u8* Row, u8* Previous, u32 RowBytes, u32 BytesPerPixel, u32 Filter, u8* Out)
+{
+	for (u32 ByteIndex = 0; ByteIndex < RowBytes; ByteIndex++)
+	{
+		u8 Left = ByteIndex >= BytesPerPixel ? Row[ByteIndex - BytesPerPixel] : 0;
+		u8 Up = Previous ? Previous[ByteIndex] : 0;
+		u8 UpLeft = (Previous && ByteIndex >= BytesPerPixel) ? Previous[ByteIndex - BytesPerPixel] : 0;
+		u8 Prediction = 0;
+		switch (Filter)
+		{
+			case 1: Prediction = Left; break;
+			case 2: Prediction = Up; break;
+			case 3: Prediction = (u8)(((u32)Left + Up) / 2); break;
+			case 4: Prediction = PaethPredictor(Left, Up, UpLeft); break;
+		}
+		Out[ByteIndex] = (u8)(Row[ByteIndex] - Prediction);
+	}
+}
+
+// Every row prefixed by its filter type. Adaptive filtering tries all five on each row and keeps the one whose bytes,
+// as signed values, have the smallest sum of magnitudes (the heuristic the PNG spec suggests).
+u8* FilterPngRows(u8* Rows, u32 RowBytes, u32 Height, u32 BytesPerPixel, b32 IsAdaptive, u32 FixedFilter,
+                  memory_arena* Scratch)
+{
+	u8* Result = PushArray(Scratch, (u64)(RowBytes + 1) * Height, u8);
+	u8* Candidate = IsAdaptive ? PushArray(Scratch, RowBytes, u8) : nullptr;
+	for (u32 Y = 0; Y < Height; Y++)
+	{
+		u8* Row = Rows + (u64)Y * RowBytes;
+		u8* Previous = Y ? Row - RowBytes : nullptr;
+		u8* Out = Result + (u64)Y * (RowBytes + 1);
+		if (!IsAdaptive)
+		{
+			Out[0] = (u8)FixedFilter;
+			FilterPngRow(Row, Previous, RowBytes, BytesPerPixel, FixedFilter, Out + 1);
+			continue;
+		}
+
+		u64 BestCost = ~0ull;
+		for (u32 Filter = 0; Filter < 5; Filter++)
+		{
+			FilterPngRow(Row, Previous, RowBytes, BytesPerPixel, Filter, Candidate);
+			u64 Cost = 0;
+			for (u32 ByteIndex = 0; ByteIndex < RowBytes && Cost < BestCost; ByteIndex++)
+			{
+				Cost += (u64)abs((s32)(s8)Candidate[ByteIndex]);
+			}
+			if (Cost < BestCost)
+			{
+				BestCost = Cost;
+				Out[0] = (u8)Filter;
+				memcpy(Out + 1, Candidate, RowBytes);
+			}
+		}
+	}
+	return Result;
+}
+
+void WritePngChunk(bit_writer* Out, const char* Type, u8* Data, u32 Size)
+{
+	WriteBigEndian32(Out, Size);
+	u64 TypeStart = Out->Size;
+	for (u32 Index = 0; Index < 4; Index++)
+	{
+		WriteByte(Out, (u8)Type[Index]);
+	}
+	for (u32 Index = 0; Index < Size; Index++)
+	{
+		WriteByte(Out, Data[Index]);
+	}
+	u32 Crc = stbiw__crc32(Out->Data + TypeStart, (int)(Size + 4));
+	WriteBigEndian32(Out, Crc);
+}
+
+// Anything only needed while the image is encoded goes on Scratch; the file itself is built up with TrackedMalloc
+b32 WritePng(const char* FilePath, pixel* Pixels, u32 Width, u32 Height, png_options* Options, memory_arena* Scratch)
+{
+	temp_memory PngMemory = BeginTemporaryMemory(Scratch);
+	u32* Colours = (u32*)Pixels;
+	u32 NumPixels = Width * Height;
+
+	png_palette* Palette = PushStruct(Scratch, png_palette);
+	b32 IsIndexed = BuildPngPalette(Colours, NumPixels, Palette);
+	b32 IsOpaque = true;
+	for (u32 PixelIndex = 0; PixelIndex < NumPixels && IsOpaque && !IsIndexed; PixelIndex++)
+	{
+		IsOpaque = Pixels[PixelIndex].A == 0xFF;
+	}
+
+	// Indices are packed as tightly as the palette allows, leftmost pixel in the highest bits
+	u32 BitDepth = 8;
+	u32 ColourType = IsIndexed ? 3 : (IsOpaque ? 2 : 6);
+	u32 BytesPerPixel = IsIndexed ? 1 : (IsOpaque ? 3 : 4);
+	if (IsIndexed)
+	{
+		BitDepth = Palette->NumColours <= 2 ? 1 : Palette->NumColours <= 4 ? 2 : Palette->NumColours <= 16 ? 4 : 8;
+	}
+	u32 RowBytes = IsIndexed ? (Width * BitDepth + 7) / 8 : Width * BytesPerPixel;
+
+	u8* Rows = PushArrayZero(Scratch, (u64)RowBytes * Height, u8);
+	for (u32 Y = 0; Y < Height; Y++)
+	{
+		u8* Row = Rows + (u64)Y * RowBytes;
+		pixel* Source = Pixels + (u64)Y * Width;
+		for (u32 X = 0; X < Width; X++)
+		{
+			if (IsIndexed)
+			{
+				u32 Index = Palette->LookupIndices[GetPngPaletteSlot(Palette, Colours[(u64)Y * Width + X])] - 1;
+				u32 BitOffset = X * BitDepth;
+				Row[BitOffset / 8] |= (u8)(Index << (8 - BitDepth - BitOffset % 8));
+			}
+			else
+			{
+				memcpy(Row + X * BytesPerPixel, Source + X, BytesPerPixel);
+			}
+		}
+	}
+
+	// Filters hardly ever help indexed images, so by default they're left unfiltered
+	b32 IsAdaptive = Options->Filter == SMINT_PNG_FILTER_ADAPTIVE || (Options->Filter == SMINT_PNG_FILTER_AUTO && !IsIndexed);
+	u32 FixedFilter = Options->Filter >= SMINT_PNG_FILTER_NONE && Options->Filter <= SMINT_PNG_FILTER_PAETH ?
+	                  Options->Filter - SMINT_PNG_FILTER_NONE : 0;
+	u8* Filtered = FilterPngRows(Rows, RowBytes, Height, BytesPerPixel, IsAdaptive, FixedFilter, Scratch);
+
+	bit_writer File = {};
+	u8 Signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	for (u32 Index = 0; Index < sizeof(Signature); Index++)
+	{
+		WriteByte(&File, Signature[Index]);
+	}
+
+	u8 Header[13];
+	for (u32 Index = 0; Index < 4; Index++)
+	{
+		Header[Index] = (u8)(Width >> (24 - 8 * Index));
+		Header[4 + Index] = (u8)(Height >> (24 - 8 * Index));
+	}
+	Header[8] = (u8)BitDepth;
+	Header[9] = (u8)ColourType;
+	Header[10] = 0; // Deflate
+	Header[11] = 0; // Adaptive filtering
+	Header[12] = 0; // Not interlaced
+	WritePngChunk(&File, "IHDR", Header, sizeof(Header));
+
+	if (IsIndexed)
+	{
+		u8 PaletteBytes[256 * 3];
+		u8 Alphas[256];
+		for (u32 ColourIndex = 0; ColourIndex < Palette->NumColours; ColourIndex++)
+		{
+			u32 Colour = Palette->Colours[ColourIndex];
+			PaletteBytes[ColourIndex * 3 + 0] = (u8)Colour;
+			PaletteBytes[ColourIndex * 3 + 1] = (u8)(Colour >> 8);
+			PaletteBytes[ColourIndex * 3 + 2] = (u8)(Colour >> 16);
+			Alphas[ColourIndex] = (u8)(Colour >> 24);
+		}
+		WritePngChunk(&File, "PLTE", PaletteBytes, Palette->NumColours * 3);
+		if (Palette->NumTranslucent)
+		{
+			WritePngChunk(&File, "tRNS", Alphas, Palette->NumTranslucent);
+		}
+	}
+
+	bit_writer Zlib = {};
+	WriteZlibStream(&Zlib, Filtered, (RowBytes + 1) * Height, Options->Level, Options->NumThreads);
+	WritePngChunk(&File, "IDAT", Zlib.Data, (u32)Zlib.Size);
+	TrackedFree(Zlib.Data);
+	WritePngChunk(&File, "IEND", nullptr, 0);
+	EndTemporaryMemory(PngMemory);
+
+	b32 Result = false;
+	FILE* Out = fopen(FilePath, "wb");
+	if (Out)
+	{
+		Result = fwrite(File.Data, 1, File.Size, Out) == File.Size;
+		Result = (fclose(Out) == 0) && Result;
+	}
+	TrackedFree(File.Data);
+	return Result;
+}
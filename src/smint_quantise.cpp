@@ -0,0 +1,388 @@
+// Palette banks for --gba 4: every 4bpp tile is drawn with one of 16 banks of 16 colours (index 0 of each being
+// transparent), chosen per screen entry. Each tile's colours are a bitmap over every colour in the map, and tiles are
+// packed into banks greedily, largest colour set first, each going wherever it adds the fewest new colours. Banks that
+// turn out to fit together are then merged. Only tiles that can't fit anywhere (including those with more than 15
+// colours of their own) are approximated, by mapping the colours their bank has no room for to the nearest ones in it.
+
+#include <algorithm>
+
+#define GBA_MAX_BANKS 16
+#define GBA_BANK_COLOURS 16 // Including the transparent colour at index 0
+
+struct palette_banks
+{
+	u16 Colours[GBA_MAX_BANKS][GBA_BANK_COLOURS]; // [Bank][0] is always the transparent colour
+	u32 NumColours[GBA_MAX_BANKS]; // Including the transparent colour
+	u32 NumBanks;
+	u32 NumApproximatedTiles;
+};
+
+// Tiles with exactly the same colours (other than the transparent one) share a set
+struct colour_set
+{
+	u64* Bits;
+	u32 NumColours;
+	u32 NumTiles;
+	u32 FirstTile;
+	s32 Bank; // -1 until assigned
+};
+
+struct colour_bank
+{
+	u64* Bits;
+	u32 NumColours; // Not counting the transparent colour
+};
+
+u16 GetGbaColour(pixel Pixel)
+{
+	u16 Result = (u16)((Pixel.R >> 3) | ((Pixel.G >> 3) << 5) | ((Pixel.B >> 3) << 10));
+	return Result;
+}
+
+u32 CountBits64(u64 Value)
+{
+	Value = Value - ((Value >> 1) & 0x5555555555555555ull);
+	Value = (Value & 0x3333333333333333ull) + ((Value >> 2) & 0x3333333333333333ull);
+	Value = (Value + (Value >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+	u32 Result = (u32)((Value * 0x0101010101010101ull) >> 56);
+	return Result;
+}
+
+u32 CountUnionBits(u64* A, u64* B, u32 NumWords)
+{
+	u32 Result = 0;
+	for (u32 WordIndex = 0; WordIndex < NumWords; WordIndex++)
+	{
+		Result += CountBits64(A[WordIndex] | B[WordIndex]);
+	}
+	return Result;
+}
+
+void AddColourBits(colour_bank* Bank, u64* Bits, u32 NumWords)
+{
+	Bank->NumColours = 0;
+	for (u32 WordIndex = 0; WordIndex < NumWords; WordIndex++)
+	{
+		Bank->Bits[WordIndex] |= Bits[WordIndex];
+		Bank->NumColours += CountBits64(Bank->Bits[WordIndex]);
+	}
+}
+
+u32 GetColourDistance(u16 A, u16 B)
+{
+	s32 DR = (s32)(A & 31) - (s32)(B & 31);
+	s32 DG = (s32)((A >> 5) & 31) - (s32)((B >> 5) & 31);
+	s32 DB = (s32)((A >> 10) & 31) - (s32)((B >> 10) & 31);
+	u32 Result = (u32)(DR * DR + DG * DG + DB * DB);
+	return Result;
+}
+
+// Goes wherever it adds the fewest new colours without overflowing; returns false if there's nowhere
+b32 TryFitColourSet(colour_set* Set, colour_bank* Banks, u32* NumBanks, u32 NumWords)
+{
+	s32 BestBank = -1;
+	u32 BestAdded = 0;
+	for (u32 BankIndex = 0; BankIndex < *NumBanks; BankIndex++)
+	{
+		u32 Union = CountUnionBits(Banks[BankIndex].Bits, Set->Bits, NumWords);
+		u32 Added = Union - Banks[BankIndex].NumColours;
+		if (Union < GBA_BANK_COLOURS && (BestBank < 0 || Added < BestAdded))
+		{
+			BestBank = (s32)BankIndex;
+			BestAdded = Added;
+		}
+	}
+	if (BestBank < 0 && *NumBanks < GBA_MAX_BANKS && Set->NumColours < GBA_BANK_COLOURS)
+	{
+		BestBank = (s32)(*NumBanks)++;
+	}
+	if (BestBank >= 0)
+	{
+		AddColourBits(Banks + BestBank, Set->Bits, NumWords);
+		Set->Bank = BestBank;
+	}
+	return BestBank >= 0;
+}
+
+// Fills whatever room a bank has with the set's first missing colours; the cost is how far the rest are from their
+// nearest colour in the bank
+u32 GetApproximationCost(colour_set* Set, colour_bank* Bank, u16* Colours, u32 NumColours)
+{
+	u16 BankColours[GBA_BANK_COLOURS];
+	u32 NumBankColours = 0;
+	u32* Missing = (u32*)TrackedMalloc(sizeof(u32) * Set->NumColours);
+	u32 NumMissing = 0;
+	for (u32 ColourIndex = 0; ColourIndex < NumColours; ColourIndex++)
+	{
+		u64 Bit = 1ull << (ColourIndex % 64);
+		if (Bank->Bits[ColourIndex / 64] & Bit)
+		{
+			BankColours[NumBankColours++] = Colours[ColourIndex];
+		}
+		else if (Set->Bits[ColourIndex / 64] & Bit)
+		{
+			Missing[NumMissing++] = ColourIndex;
+		}
+	}
+
+	u32 Result = 0;
+	for (u32 MissingIndex = 0; MissingIndex < NumMissing; MissingIndex++)
+	{
+		u16 Colour = Colours[Missing[MissingIndex]];
+		if (NumBankColours < GBA_BANK_COLOURS - 1)
+		{
+			BankColours[NumBankColours++] = Colour;
+			continue;
+		}
+
+		u32 Nearest = 0xFFFFFFFF;
+		for (u32 BankColourIndex = 0; BankColourIndex < NumBankColours; BankColourIndex++)
+		{
+			u32 Distance = GetColourDistance(Colour, BankColours[BankColourIndex]);
+			Nearest = Distance < Nearest ? Distance : Nearest;
+		}
+		Result += Nearest;
+	}
+	TrackedFree(Missing);
+	return Result;
+}
+
+void ApproximateColourSet(colour_set* Set, colour_bank* Banks, u32* NumBanks, u16* Colours, u32 NumColours)
+{
+	u32 NumCandidates = *NumBanks < GBA_MAX_BANKS ? *NumBanks + 1 : *NumBanks; // An empty bank is worth considering too
+	u32 BestBank = 0;
+	u32 BestCost = 0xFFFFFFFF;
+	for (u32 BankIndex = 0; BankIndex < NumCandidates; BankIndex++)
+	{
+		u32 Cost = GetApproximationCost(Set, Banks + BankIndex, Colours, NumColours);
+		if (Cost < BestCost)
+		{
+			BestBank = BankIndex;
+			BestCost = Cost;
+		}
+	}
+	if (BestBank == *NumBanks)
+	{
+		(*NumBanks)++;
+	}
+
+	colour_bank* Bank = Banks + BestBank;
+	for (u32 ColourIndex = 0; ColourIndex < NumColours && Bank->NumColours < GBA_BANK_COLOURS - 1; ColourIndex++)
+	{
+		u64 Bit = 1ull << (ColourIndex % 64);
+		if ((Set->Bits[ColourIndex / 64] & Bit) && !(Bank->Bits[ColourIndex / 64] & Bit))
+		{
+			Bank->Bits[ColourIndex / 64] |= Bit;
+			Bank->NumColours++;
+		}
+	}
+	Set->Bank = (s32)BestBank;
+}
+
+// Index of the colour in the bank, or of the nearest one if the bank had no room for it
+u32 GetBankColourIndex(palette_banks* Banks, u32 Bank, u16 Colour)
+{
+	if (Colour == Banks->Colours[Bank][0])
+	{
+		return 0;
+	}
+
+	u32 Result = 0;
+	u32 BestDistance = 0xFFFFFFFF;
+	for (u32 ColourIndex = 1; ColourIndex < Banks->NumColours[Bank]; ColourIndex++)
+	{
+		u32 Distance = GetColourDistance(Colour, Banks->Colours[Bank][ColourIndex]);
+		if (Distance < BestDistance)
+		{
+			Result = ColourIndex;
+			BestDistance = Distance;
+			if (!Distance)
+			{
+				break;
+			}
+		}
+	}
+	return Result;
+}
+
+// Assigns every tile a bank, and gives its pixels as 4bpp indices into that bank (in the layout of smint_palette.cpp).
+// Scratch space is pushed onto Arena.
+void QuantiseToPaletteBanks(tile* Tiles, u32 NumTiles, u16 TransparentColour, memory_arena* Arena, palette_banks* OutBanks,
+                            u8* OutTileBanks, indexed_tile* OutIndexedTiles)
+{
+	// Every colour in the map other than the transparent one, in the order they're first seen
+	u16* ColourIndices = PushArrayZero(Arena, 32768, u16); // Index + 1
+	u16* Colours = PushArray(Arena, 32768, u16);
+	u32 NumColours = 0;
+	for (u32 TileIndex = 0; TileIndex < NumTiles; TileIndex++)
+	{
+		for (u32 PixelIndex = 0; PixelIndex < ArrayCount(Tiles->Pixels); PixelIndex++)
+		{
+			u16 Colour = GetGbaColour(Tiles[TileIndex].Pixels[PixelIndex]);
+			if (Colour != TransparentColour && !ColourIndices[Colour])
+			{
+				Colours[NumColours++] = Colour;
+				ColourIndices[Colour] = (u16)NumColours;
+			}
+		}
+	}
+
+	u32 NumWords = (NumColours + 63) / 64;
+	NumWords = NumWords ? NumWords : 1;
+	u64* TileBits = PushArrayZero(Arena, (u64)NumTiles * NumWords, u64);
+	for (u32 TileIndex = 0; TileIndex < NumTiles; TileIndex++)
+	{
+		u64* Bits = TileBits + (u64)TileIndex * NumWords;
+		for (u32 PixelIndex = 0; PixelIndex < ArrayCount(Tiles->Pixels); PixelIndex++)
+		{
+			u16 Colour = GetGbaColour(Tiles[TileIndex].Pixels[PixelIndex]);
+			if (Colour != TransparentColour)
+			{
+				u32 ColourIndex = ColourIndices[Colour] - 1u;
+				Bits[ColourIndex / 64] |= 1ull << (ColourIndex % 64);
+			}
+		}
+	}
+
+	// Group tiles with the same colours, biggest sets first (ties in the order the tiles come)
+	u32* SortedTiles = PushArray(Arena, NumTiles, u32);
+	for (u32 TileIndex = 0; TileIndex < NumTiles; TileIndex++)
+	{
+		SortedTiles[TileIndex] = TileIndex;
+	}
+	std::stable_sort(SortedTiles, SortedTiles + NumTiles, [TileBits, NumWords](u32 A, u32 B)
+	{
+		u64* BitsA = TileBits + (u64)A * NumWords;
+		u64* BitsB = TileBits + (u64)B * NumWords;
+		u32 CountA = 0, CountB = 0;
+		for (u32 WordIndex = 0; WordIndex < NumWords; WordIndex++)
+		{
+			CountA += CountBits64(BitsA[WordIndex]);
+			CountB += CountBits64(BitsB[WordIndex]);
+		}
+		if (CountA != CountB)
+		{
+			return CountA > CountB;
+		}
+		return memcmp(BitsA, BitsB, sizeof(u64) * NumWords) < 0;
+	});
+
+	colour_set* Sets = PushArray(Arena, NumTiles, colour_set);
+	u32* TileSets = PushArray(Arena, NumTiles, u32);
+	u32 NumSets = 0;
+	for (u32 SortedIndex = 0; SortedIndex < NumTiles; SortedIndex++)
+	{
+		u32 TileIndex = SortedTiles[SortedIndex];
+		u64* Bits = TileBits + (u64)TileIndex * NumWords;
+		if (!NumSets || memcmp(Sets[NumSets - 1].Bits, Bits, sizeof(u64) * NumWords) != 0)
+		{
+			colour_set* Set = Sets + NumSets++;
+			Set->Bits = Bits;
+			Set->NumColours = 0;
+			for (u32 WordIndex = 0; WordIndex < NumWords; WordIndex++)
+			{
+				Set->NumColours += CountBits64(Bits[WordIndex]);
+			}
+			Set->NumTiles = 0;
+			Set->FirstTile = TileIndex;
+			Set->Bank = -1;
+		}
+		Sets[NumSets - 1].NumTiles++;
+		TileSets[TileIndex] = NumSets - 1;
+	}
+
+	colour_bank Banks[GBA_MAX_BANKS];
+	for (u32 BankIndex = 0; BankIndex < GBA_MAX_BANKS; BankIndex++)
+	{
+		Banks[BankIndex].Bits = PushArrayZero(Arena, NumWords, u64);
+		Banks[BankIndex].NumColours = 0;
+	}
+	u32 NumBanks = 0;
+	for (u32 SetIndex = 0; SetIndex < NumSets; SetIndex++)
+	{
+		TryFitColourSet(Sets + SetIndex, Banks, &NumBanks, NumWords);
+	}
+
+	// Banks filled early on may have room for each other now that everything's been placed
+	s32 BankRemap[GBA_MAX_BANKS];
+	for (u32 BankIndex = 0; BankIndex < GBA_MAX_BANKS; BankIndex++)
+	{
+		BankRemap[BankIndex] = (s32)BankIndex;
+	}
+	u32 NumMergedBanks = 0;
+	for (u32 BankIndex = 0; BankIndex < NumBanks; BankIndex++)
+	{
+		s32 Target = -1;
+		for (u32 MergedIndex = 0; MergedIndex < NumMergedBanks && Target < 0; MergedIndex++)
+		{
+			if (CountUnionBits(Banks[MergedIndex].Bits, Banks[BankIndex].Bits, NumWords) < GBA_BANK_COLOURS)
+			{
+				Target = (s32)MergedIndex;
+			}
+		}
+		if (Target < 0)
+		{
+			Target = (s32)NumMergedBanks++;
+			if ((u32)Target != BankIndex)
+			{
+				memcpy(Banks[Target].Bits, Banks[BankIndex].Bits, sizeof(u64) * NumWords);
+				Banks[Target].NumColours = Banks[BankIndex].NumColours;
+			}
+		}
+		else
+		{
+			AddColourBits(Banks + Target, Banks[BankIndex].Bits, NumWords);
+		}
+		BankRemap[BankIndex] = Target;
+	}
+	for (u32 BankIndex = NumMergedBanks; BankIndex < NumBanks; BankIndex++)
+	{
+		memset(Banks[BankIndex].Bits, 0, sizeof(u64) * NumWords);
+		Banks[BankIndex].NumColours = 0;
+	}
+	NumBanks = NumMergedBanks;
+
+	OutBanks->NumApproximatedTiles = 0;
+	for (u32 SetIndex = 0; SetIndex < NumSets; SetIndex++)
+	{
+		colour_set* Set = Sets + SetIndex;
+		if (Set->Bank >= 0)
+		{
+			Set->Bank = BankRemap[Set->Bank];
+		}
+		else if (!TryFitColourSet(Set, Banks, &NumBanks, NumWords))
+		{
+			ApproximateColourSet(Set, Banks, &NumBanks, Colours, NumColours);
+			OutBanks->NumApproximatedTiles += Set->NumTiles;
+		}
+	}
+
+	// Each bank's colours in the order they were first seen, after the transparent one
+	OutBanks->NumBanks = NumBanks ? NumBanks : 1;
+	for (u32 BankIndex = 0; BankIndex < OutBanks->NumBanks; BankIndex++)
+	{
+		OutBanks->Colours[BankIndex][0] = TransparentColour;
+		OutBanks->NumColours[BankIndex] = 1;
+		for (u32 ColourIndex = 0; ColourIndex < NumColours; ColourIndex++)
+		{
+			if (Banks[BankIndex].Bits[ColourIndex / 64] & (1ull << (ColourIndex % 64)))
+			{
+				OutBanks->Colours[BankIndex][OutBanks->NumColours[BankIndex]++] = Colours[ColourIndex];
+			}
+		}
+	}
+
+	for (u32 TileIndex = 0; TileIndex < NumTiles; TileIndex++)
+	{
+		u32 Bank = (u32)Sets[TileSets[TileIndex]].Bank;
+		OutTileBanks[TileIndex] = (u8)Bank;
+
+		indexed_tile* Out = OutIndexedTiles + TileIndex;
+		memset(Out->Data, 0, sizeof(Out->Data));
+		for (u32 PixelIndex = 0; PixelIndex < ArrayCount(Tiles->Pixels); PixelIndex++)
+		{
+			u32 Index = GetBankColourIndex(OutBanks, Bank, GetGbaColour(Tiles[TileIndex].Pixels[PixelIndex]));
+			Out->Data[PixelIndex / 2] |= (u8)(PixelIndex % 2 ? Index : Index << 4);
+		}
+	}
+}
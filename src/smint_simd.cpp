@@ -0,0 +1,253 @@
+// Tile compare/flip kernels. An 8x8 RGBA tile is exactly 256 bytes, so a whole tile fits in 16 SSE2 or 8 AVX2 registers.
+// The best available version is picked at runtime by InitTileKernels; the scalar versions are the reference implementation.
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SMINT_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#if _WIN32
+#include <intrin.h>
+#define SMINT_TARGET_AVX2
+#else
+#define SMINT_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define SMINT_X86 0
+#endif
+
+// Alpha is ignored everywhere tiles are compared - GBA doesn't support it
+#define PIXEL_RGB_MASK 0x00FFFFFF
+#define TILE_BYTES (8 * 8 * sizeof(pixel))
+
+b32 AreTilesEqualNoFlip_Scalar(tile* A, tile* B)
+{
+	for (u32 Y = 0; Y < 8; Y++)
+	{
+		for (u32 X = 0; X < 8; X++)
+		{
+			pixel* PixelA = PixelAt(A, X, Y);
+			pixel* PixelB = PixelAt(B, X, Y);
+			if (*PixelA != *PixelB)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Lexicographic ordering of tiles (alpha ignored) - returns <0, 0 or >0 like memcmp
+s32 CompareTiles_Scalar(tile* A, tile* B)
+{
+	u32* PixelBitsA = (u32*)A->Pixels;
+	u32* PixelBitsB = (u32*)B->Pixels;
+	for (u32 PixelIndex = 0; PixelIndex < ArrayCount(A->Pixels); PixelIndex++)
+	{
+		u32 ValueA = PixelBitsA[PixelIndex] & PIXEL_RGB_MASK;
+		u32 ValueB = PixelBitsB[PixelIndex] & PIXEL_RGB_MASK;
+		if (ValueA != ValueB)
+		{
+			return ValueA < ValueB ? -1 : 1;
+		}
+	}
+	return 0;
+}
+
+void CopyTransformedTile_Scalar(tile* SourceTile, tile* OutTransformedTile, tile_transform_type Transform)
+{
+	for (u32 Y = 0; Y < 8; Y++)
+	{
+		for (u32 X = 0; X < 8; X++)
+		{
+			pixel* PixelToWrite = PixelAt(OutTransformedTile, X, Y);
+
+			pixel* PixelToRead;
+			switch (Transform)
+			{
+				case TileTransform_HFlip:
+				{
+					PixelToRead = PixelAt(SourceTile, 8 - X - 1, Y);
+				} break;
+				case TileTransform_VFlip:
+				{
+					PixelToRead = PixelAt(SourceTile, X, 8 - Y - 1);
+				} break;
+				case TileTransform_DiagonalFlip:
+				{
+					PixelToRead = PixelAt(SourceTile, 8 - X - 1, 8 - Y - 1);
+				} break;
+				default:
+				{
+					PixelToRead = PixelAt(SourceTile, X, Y);
+				} break;
+			}
+
+			*PixelToWrite = *PixelToRead;
+		}
+	}
+}
+
+#if SMINT_X86
+b32 AreTilesEqualNoFlip_SSE2(tile* A, tile* B)
+{
+	__m128i Mask = _mm_set1_epi32(PIXEL_RGB_MASK);
+	__m128i Diff = _mm_setzero_si128();
+	__m128i* RowsA = (__m128i*)A->Pixels;
+	__m128i* RowsB = (__m128i*)B->Pixels;
+	for (u32 Index = 0; Index < TILE_BYTES / 16; Index++)
+	{
+		__m128i Xor = _mm_xor_si128(_mm_loadu_si128(RowsA + Index), _mm_loadu_si128(RowsB + Index));
+		Diff = _mm_or_si128(Diff, _mm_and_si128(Xor, Mask));
+	}
+	b32 Result = _mm_movemask_epi8(_mm_cmpeq_epi8(Diff, _mm_setzero_si128())) == 0xFFFF;
+	return Result;
+}
+
+s32 CompareTiles_SSE2(tile* A, tile* B)
+{
+	__m128i Mask = _mm_set1_epi32(PIXEL_RGB_MASK);
+	__m128i* RowsA = (__m128i*)A->Pixels;
+	__m128i* RowsB = (__m128i*)B->Pixels;
+	for (u32 Index = 0; Index < TILE_BYTES / 16; Index++)
+	{
+		__m128i ValuesA = _mm_and_si128(_mm_loadu_si128(RowsA + Index), Mask);
+		__m128i ValuesB = _mm_and_si128(_mm_loadu_si128(RowsB + Index), Mask);
+		u32 EqualMask = (u32)_mm_movemask_epi8(_mm_cmpeq_epi32(ValuesA, ValuesB));
+		if (EqualMask != 0xFFFF)
+		{
+			// Fall back to scalar for the first 4 pixels that differ
+			u32 FirstPixel = Index * 4;
+			u32* PixelBitsA = (u32*)A->Pixels + FirstPixel;
+			u32* PixelBitsB = (u32*)B->Pixels + FirstPixel;
+			for (u32 PixelIndex = 0; PixelIndex < 4; PixelIndex++)
+			{
+				u32 ValueA = PixelBitsA[PixelIndex] & PIXEL_RGB_MASK;
+				u32 ValueB = PixelBitsB[PixelIndex] & PIXEL_RGB_MASK;
+				if (ValueA != ValueB)
+				{
+					return ValueA < ValueB ? -1 : 1;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+void CopyTransformedTile_SSE2(tile* SourceTile, tile* OutTransformedTile, tile_transform_type Transform)
+{
+	// Each row of 8 pixels is two 128-bit halves: HFlip swaps the halves and reverses the 4 pixels in each,
+	// VFlip just reads the rows in reverse order
+	b32 HFlip = (Transform & TileTransform_HFlip) != 0;
+	b32 VFlip = (Transform & TileTransform_VFlip) != 0;
+	__m128i* Source = (__m128i*)SourceTile->Pixels;
+	__m128i* Dest = (__m128i*)OutTransformedTile->Pixels;
+	for (u32 Y = 0; Y < 8; Y++)
+	{
+		u32 SourceY = VFlip ? 8 - Y - 1 : Y;
+		__m128i Left = _mm_loadu_si128(Source + SourceY * 2);
+		__m128i Right = _mm_loadu_si128(Source + SourceY * 2 + 1);
+		if (HFlip)
+		{
+			__m128i NewLeft = _mm_shuffle_epi32(Right, _MM_SHUFFLE(0, 1, 2, 3));
+			Right = _mm_shuffle_epi32(Left, _MM_SHUFFLE(0, 1, 2, 3));
+			Left = NewLeft;
+		}
+		_mm_storeu_si128(Dest + Y * 2, Left);
+		_mm_storeu_si128(Dest + Y * 2 + 1, Right);
+	}
+}
+
+SMINT_TARGET_AVX2
+b32 AreTilesEqualNoFlip_AVX2(tile* A, tile* B)
+{
+	__m256i Mask = _mm256_set1_epi32(PIXEL_RGB_MASK);
+	__m256i Diff = _mm256_setzero_si256();
+	__m256i* RowsA = (__m256i*)A->Pixels;
+	__m256i* RowsB = (__m256i*)B->Pixels;
+	for (u32 Y = 0; Y < 8; Y++)
+	{
+		__m256i Xor = _mm256_xor_si256(_mm256_loadu_si256(RowsA + Y), _mm256_loadu_si256(RowsB + Y));
+		Diff = _mm256_or_si256(Diff, _mm256_and_si256(Xor, Mask));
+	}
+	b32 Result = _mm256_testz_si256(Diff, Diff);
+	return Result;
+}
+
+SMINT_TARGET_AVX2
+void CopyTransformedTile_AVX2(tile* SourceTile, tile* OutTransformedTile, tile_transform_type Transform)
+{
+	// One row of 8 pixels is exactly one 256-bit register
+	b32 HFlip = (Transform & TileTransform_HFlip) != 0;
+	b32 VFlip = (Transform & TileTransform_VFlip) != 0;
+	__m256i Reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+	__m256i* Source = (__m256i*)SourceTile->Pixels;
+	__m256i* Dest = (__m256i*)OutTransformedTile->Pixels;
+	for (u32 Y = 0; Y < 8; Y++)
+	{
+		u32 SourceY = VFlip ? 8 - Y - 1 : Y;
+		__m256i Row = _mm256_loadu_si256(Source + SourceY);
+		if (HFlip)
+		{
+			Row = _mm256_permutevar8x32_epi32(Row, Reverse);
+		}
+		_mm256_storeu_si256(Dest + Y, Row);
+	}
+}
+
+b32 CpuSupportsAVX2()
+{
+#if _WIN32
+	s32 CpuInfo[4];
+	__cpuid(CpuInfo, 0);
+	if (CpuInfo[0] < 7)
+	{
+		return false;
+	}
+	__cpuid(CpuInfo, 1);
+	b32 OsSavesYmm = (CpuInfo[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+	__cpuidex(CpuInfo, 7, 0);
+	b32 Result = OsSavesYmm && (CpuInfo[1] & (1 << 5));
+	return Result;
+#else
+	b32 Result = __builtin_cpu_supports("avx2");
+	return Result;
+#endif
+}
+#endif
+
+typedef b32 tiles_equal_func(tile* A, tile* B);
+typedef s32 compare_tiles_func(tile* A, tile* B);
+typedef void copy_transformed_tile_func(tile* SourceTile, tile* OutTransformedTile, tile_transform_type Transform);
+
+static tiles_equal_func* AreTilesEqualNoFlip = AreTilesEqualNoFlip_Scalar;
+static compare_tiles_func* CompareTiles = CompareTiles_Scalar;
+static copy_transformed_tile_func* CopyTransformedTile = CopyTransformedTile_Scalar;
+
+// Returns name of the instruction set picked, for reporting
+const char* InitTileKernels(b32 AllowSimd)
+{
+	const char* Result = "scalar";
+	AreTilesEqualNoFlip = AreTilesEqualNoFlip_Scalar;
+	CompareTiles = CompareTiles_Scalar;
+	CopyTransformedTile = CopyTransformedTile_Scalar;
+
+#if SMINT_X86
+	if (AllowSimd)
+	{
+		// SSE2 is guaranteed on x86_64 (and anything new enough to be running this on x86)
+		AreTilesEqualNoFlip = AreTilesEqualNoFlip_SSE2;
+		CompareTiles = CompareTiles_SSE2;
+		CopyTransformedTile = CopyTransformedTile_SSE2;
+		Result = "SSE2";
+
+		if (CpuSupportsAVX2())
+		{
+			AreTilesEqualNoFlip = AreTilesEqualNoFlip_AVX2;
+			CopyTransformedTile = CopyTransformedTile_AVX2;
+			Result = "AVX2";
+		}
+	}
+#endif
+
+	return Result;
+}
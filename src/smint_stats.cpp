@@ -0,0 +1,314 @@
+// Per-stage timing and memory instrumentation for --stats/--stats-json. Every allocation smint makes (including those
+// inside rapidjson and stb) goes through the Tracked* functions below, so each stage can report how much extra memory
+// it needed at its peak. Stages record into whichever stats array the current thread has been pointed at, in the same
+// way that messages go to ThreadMessageLog.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+
+#if _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+enum stats_stage : u32
+{
+	Stage_ParseMap,
+	Stage_ParseTileset,
+	Stage_Cache,
+	Stage_LoadImage,
+	Stage_ExtractTiles,
+	Stage_Dedup,
+	Stage_WritePng,
+	Stage_WriteTileset,
+	Stage_RemapLayers,
+	Stage_WriteMap,
+	Stage_ExportGba,
+
+	Stage_Count
+};
+
+static const char* StageNames[Stage_Count] =
+{
+	"parse_map",
+	"parse_tileset",
+	"cache",
+	"load_image",
+	"extract_tiles",
+	"dedup",
+	"write_png",
+	"write_tileset",
+	"remap_layers",
+	"write_map",
+	"export_gba"
+};
+
+struct stage_stats
+{
+	f64 WallSeconds;
+	f64 CpuSeconds; // Of the thread that ran the stage; helper threads (e.g. tile row bands) aren't included
+	s64 PeakBytes; // Most memory allocated on top of what was already in use when the stage began
+	u32 Runs;
+};
+
+struct stage_timer
+{
+	stats_stage Stage;
+	f64 WallStart;
+	f64 CpuStart;
+	s64 BytesStart;
+};
+
+static thread_local stage_stats* ThreadStageStats; // Array of Stage_Count, or nullptr if this thread isn't recording
+static thread_local s64 ThreadBytesInUse;
+static thread_local s64 ThreadPeakBytes;
+// Process-wide, so the peaks reported for one context include every other context's allocations (see libsmint.h)
+static std::atomic<s64> GlobalBytesInUse;
+static std::atomic<s64> GlobalPeakBytes;
+static std::atomic<s64> GlobalArenaBytes; // Reserved in arena blocks, which are counted in the totals above as well
+static std::atomic<s64> GlobalArenaPeakBytes;
+
+// Keeps 16-byte alignment for whatever follows it
+struct alloc_header
+{
+	u64 Size;
+	u64 Padding;
+};
+
+void TrackAllocation(s64 Bytes)
+{
+	ThreadBytesInUse += Bytes;
+	if (ThreadBytesInUse > ThreadPeakBytes)
+	{
+		ThreadPeakBytes = ThreadBytesInUse;
+	}
+
+	s64 InUse = (GlobalBytesInUse += Bytes);
+	s64 Peak = GlobalPeakBytes.load(std::memory_order_relaxed);
+	while (InUse > Peak && !GlobalPeakBytes.compare_exchange_weak(Peak, InUse, std::memory_order_relaxed))
+	{
+	}
+}
+
+void* TrackedMalloc(size_t Size)
+{
+	alloc_header* Header = (alloc_header*)malloc(sizeof(alloc_header) + Size);
+	if (!Header)
+	{
+		return nullptr;
+	}
+	Header->Size = Size;
+	TrackAllocation((s64)Size);
+	return Header + 1;
+}
+
+void* TrackedCalloc(size_t Count, size_t Size)
+{
+	void* Result = TrackedMalloc(Count * Size);
+	if (Result)
+	{
+		memset(Result, 0, Count * Size);
+	}
+	return Result;
+}
+
+void TrackedFree(void* Ptr)
+{
+	if (Ptr)
+	{
+		alloc_header* Header = (alloc_header*)Ptr - 1;
+		TrackAllocation(-(s64)Header->Size);
+		free(Header);
+	}
+}
+
+void* TrackedRealloc(void* Ptr, size_t Size)
+{
+	if (!Ptr)
+	{
+		return TrackedMalloc(Size);
+	}
+
+	alloc_header* Header = (alloc_header*)Ptr - 1;
+	s64 OldSize = (s64)Header->Size;
+	alloc_header* NewHeader = (alloc_header*)realloc(Header, sizeof(alloc_header) + Size);
+	if (!NewHeader)
+	{
+		return nullptr;
+	}
+	NewHeader->Size = Size;
+	TrackAllocation((s64)Size - OldSize);
+	return NewHeader + 1;
+}
+
+void TrackArenaBytes(s64 Bytes)
+{
+	s64 InUse = (GlobalArenaBytes += Bytes);
+	s64 Peak = GlobalArenaPeakBytes.load(std::memory_order_relaxed);
+	while (InUse > Peak && !GlobalArenaPeakBytes.compare_exchange_weak(Peak, InUse, std::memory_order_relaxed))
+	{
+	}
+}
+
+f64 GetWallSeconds()
+{
+	f64 Result = std::chrono::duration<f64>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	return Result;
+}
+
+f64 GetThreadCpuSeconds()
+{
+	f64 Result;
+#if _WIN32
+	FILETIME Creation, Exit, Kernel, User;
+	GetThreadTimes(GetCurrentThread(), &Creation, &Exit, &Kernel, &User);
+	u64 Ticks = ((u64)Kernel.dwHighDateTime << 32 | Kernel.dwLowDateTime) + ((u64)User.dwHighDateTime << 32 | User.dwLowDateTime);
+	Result = (f64)Ticks * 1e-7;
+#else
+	timespec Time;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &Time);
+	Result = (f64)Time.tv_sec + (f64)Time.tv_nsec * 1e-9;
+#endif
+	return Result;
+}
+
+// Stages on one thread must not overlap
+stage_timer BeginStage(stats_stage Stage)
+{
+	stage_timer Result;
+	Result.Stage = Stage;
+	Result.WallStart = GetWallSeconds();
+	Result.CpuStart = GetThreadCpuSeconds();
+	Result.BytesStart = ThreadBytesInUse;
+	ThreadPeakBytes = ThreadBytesInUse;
+	return Result;
+}
+
+void EndStage(stage_timer* Timer)
+{
+	if (!ThreadStageStats)
+	{
+		return;
+	}
+
+	stage_stats* Stats = ThreadStageStats + Timer->Stage;
+	Stats->WallSeconds += GetWallSeconds() - Timer->WallStart;
+	Stats->CpuSeconds += GetThreadCpuSeconds() - Timer->CpuStart;
+	s64 PeakBytes = ThreadPeakBytes - Timer->BytesStart;
+	if (PeakBytes > Stats->PeakBytes)
+	{
+		Stats->PeakBytes = PeakBytes;
+	}
+	Stats->Runs++;
+}
+
+// Defined in smint_io.cpp, so the report goes wherever the rest of the output does
+void LogInfo(const char* Format, ...);
+void LogError(const char* Format, ...);
+
+// One line of the report: either a tileset or the map itself
+struct stats_row
+{
+	const char* Name;
+	stage_stats* Stages;
+};
+
+void PrintStatsTable(stats_row* Rows, u32 NumRows, f64 TotalWallSeconds)
+{
+	LogInfo("\n%-24s %-14s %10s %10s %12s\n", "Source", "Stage", "Wall (ms)", "CPU (ms)", "Peak (KB)");
+	stage_stats Totals[Stage_Count] = {};
+	for (u32 RowIndex = 0; RowIndex < NumRows; RowIndex++)
+	{
+		stats_row* Row = Rows + RowIndex;
+		for (u32 Stage = 0; Stage < Stage_Count; Stage++)
+		{
+			stage_stats* Stats = Row->Stages + Stage;
+			if (!Stats->Runs)
+			{
+				continue;
+			}
+			LogInfo("%-24s %-14s %10.2f %10.2f %12.1f\n", Row->Name, StageNames[Stage], Stats->WallSeconds * 1000.0,
+			       Stats->CpuSeconds * 1000.0, (f64)Stats->PeakBytes / 1024.0);
+
+			Totals[Stage].WallSeconds += Stats->WallSeconds;
+			Totals[Stage].CpuSeconds += Stats->CpuSeconds;
+			Totals[Stage].PeakBytes = Stats->PeakBytes > Totals[Stage].PeakBytes ? Stats->PeakBytes : Totals[Stage].PeakBytes;
+			Totals[Stage].Runs += Stats->Runs;
+		}
+	}
+
+	// Tileset stages may have overlapped in time, so these can add up to more than the total wall time
+	for (u32 Stage = 0; Stage < Stage_Count; Stage++)
+	{
+		if (Totals[Stage].Runs)
+		{
+			LogInfo("%-24s %-14s %10.2f %10.2f %12.1f\n", "(all)", StageNames[Stage], Totals[Stage].WallSeconds * 1000.0,
+			       Totals[Stage].CpuSeconds * 1000.0, (f64)Totals[Stage].PeakBytes / 1024.0);
+		}
+	}
+	LogInfo("Total wall time: %.2f ms, peak memory allocated: %.1f KB (%.1f KB of it in arenas)\n", TotalWallSeconds * 1000.0,
+	       (f64)GlobalPeakBytes.load() / 1024.0, (f64)GlobalArenaPeakBytes.load() / 1024.0);
+}
+
+void WriteJsonString(FILE* File, const char* String)
+{
+	fputc('"', File);
+	for (const char* Char = String; *Char; Char++)
+	{
+		if (*Char == '"' || *Char == '\\')
+		{
+			fputc('\\', File);
+		}
+		fputc(*Char, File);
+	}
+	fputc('"', File);
+}
+
+b32 WriteStatsJson(const char* FilePath, stats_row* Rows, u32 NumRows, f64 TotalWallSeconds)
+{
+	FILE* File = fopen(FilePath, "w");
+	if (!File)
+	{
+		LogError("ERROR: Failed to open file '%s' for writing.\n", FilePath);
+		return false;
+	}
+
+	fprintf(File, "{\"total_wall_ms\":%.3f,\"peak_bytes\":%lld,\"arena_peak_bytes\":%lld,\"rows\":[", TotalWallSeconds * 1000.0,
+	        (long long)GlobalPeakBytes.load(), (long long)GlobalArenaPeakBytes.load());
+	for (u32 RowIndex = 0; RowIndex < NumRows; RowIndex++)
+	{
+		stats_row* Row = Rows + RowIndex;
+		fprintf(File, "%s{\"name\":", RowIndex ? "," : "");
+		WriteJsonString(File, Row->Name);
+		fprintf(File, ",\"stages\":{");
+
+		b32 First = true;
+		for (u32 Stage = 0; Stage < Stage_Count; Stage++)
+		{
+			stage_stats* Stats = Row->Stages + Stage;
+			if (!Stats->Runs)
+			{
+				continue;
+			}
+			fprintf(File, "%s\"%s\":{\"wall_ms\":%.3f,\"cpu_ms\":%.3f,\"peak_bytes\":%lld}", First ? "" : ",", StageNames[Stage],
+			        Stats->WallSeconds * 1000.0, Stats->CpuSeconds * 1000.0, (long long)Stats->PeakBytes);
+			First = false;
+		}
+		fprintf(File, "}}");
+	}
+	fprintf(File, "]}\n");
+
+	b32 Result = !ferror(File);
+	if (!Result)
+	{
+		LogError("ERROR: Failed to write to file '%s'.\n", FilePath);
+	}
+	fclose(File);
+	return Result;
+}
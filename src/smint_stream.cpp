@@ -0,0 +1,558 @@
+// Streaming (SAX) alternative to loading the whole map into a rapidjson::Document. The map is read twice: once to find
+// its tilesets and which GIDs it uses, then again once the tilesets are minimised, rewriting layer data and tileset
+// paths on the fly as the JSON is copied to the output file. Only the tileset table and GID lookups are kept in memory.
+
+enum map_stream_context : u32
+{
+	MapContext_Other,
+	MapContext_Root,
+	MapContext_Layers,
+	MapContext_Layer,
+	MapContext_LayerData,
+	MapContext_Tilesets,
+	MapContext_Tileset
+};
+
+enum map_stream_key : u32
+{
+	MapKey_Other,
+	MapKey_Layers,
+	MapKey_Tilesets,
+	MapKey_Data,
+	MapKey_Encoding,
+	MapKey_Compression,
+	MapKey_FirstGid,
+	MapKey_Source
+};
+
+struct map_stream_handler
+{
+	// Only set when rewriting, in which case every event is passed through to it
+	rapidjson::Writer<rapidjson::FileWriteStream>* Writer;
+	const char** NewTilesetSources; // nullptr for tilesets that haven't changed
+	u32* GidRemapTable;
+	u32 NumRemapGids;
+	layer_compression* LayerCompressions; // From the scan, so string data can be decoded before its compression key is seen
+
+	// Only set when scanning
+	b32 CollectGidsInUse;
+	tile_index_set GidsInUse;
+	map_tileset_ref* Tilesets;
+	u32 TilesetCapacity;
+	u32 LayerCapacity;
+
+	map_stream_context Stack[4];
+	u32 StackSize;
+	u32 OtherDepth; // Depth of nesting inside containers we don't care about
+	map_stream_key CurrentKey;
+
+	b32 SawLayers;
+	b32 SawTilesets;
+	b32 Error;
+
+	u32 LayerIndex;
+	u32 DataIndex;
+	b32 LayerHasData;
+	b32 LayerDataIsString;
+	char* LayerDataText; // Only kept while scanning with CollectGidsInUse, since 'compression' may come after 'data'
+	u32 LayerDataLength;
+	char* LayerEncoding;
+	char* LayerCompressionName;
+
+	u32 NumTilesets;
+	b32 TilesetHasFirstGid;
+	b32 TilesetHasSource;
+	u32 TilesetFirstGid;
+	char* TilesetSource;
+
+	map_stream_context CurrentContext()
+	{
+		map_stream_context Result = (OtherDepth || !StackSize) ? MapContext_Other : Stack[StackSize - 1];
+		return Result;
+	}
+
+	// Elements of the layers/tilesets arrays must be objects
+	b32 CheckArrayElement()
+	{
+		map_stream_context Context = CurrentContext();
+		if (Context == MapContext_Layers)
+		{
+			LogError("ERROR: Invalid map format - layer %u has unexpected format and/or is missing 'data' array.\n", LayerIndex);
+			Error = true;
+		}
+		else if (Context == MapContext_Tilesets)
+		{
+			LogError("ERROR: Invalid format of tileset %u in map file.\n", NumTilesets);
+			Error = true;
+		}
+		return !Error;
+	}
+
+	char* CopyString(char* Existing, const char* Str, rapidjson::SizeType Length)
+	{
+		TrackedFree(Existing);
+		char* Result = (char*)TrackedMalloc(Length + 1);
+		memcpy(Result, Str, Length);
+		Result[Length] = 0;
+		return Result;
+	}
+
+	// Strings of a layer or tileset object that parsing stopped in the middle of
+	void FreePendingStrings()
+	{
+		TrackedFree(LayerDataText);
+		TrackedFree(LayerEncoding);
+		TrackedFree(LayerCompressionName);
+		TrackedFree(TilesetSource);
+		LayerDataText = LayerEncoding = LayerCompressionName = TilesetSource = nullptr;
+	}
+
+	b32 Scalar()
+	{
+		if (!CheckArrayElement())
+		{
+			return false;
+		}
+		if (CurrentContext() == MapContext_LayerData)
+		{
+			DataIndex++;
+		}
+		CurrentKey = MapKey_Other;
+		return true;
+	}
+
+	b32 Null()
+	{
+		return Scalar() && (!Writer || Writer->Null());
+	}
+
+	b32 Bool(bool Value)
+	{
+		return Scalar() && (!Writer || Writer->Bool(Value));
+	}
+
+	b32 Int(int Value)
+	{
+		return Scalar() && (!Writer || Writer->Int(Value));
+	}
+
+	b32 Uint(unsigned Value)
+	{
+		map_stream_context Context = CurrentContext();
+		if (Context == MapContext_Tileset && CurrentKey == MapKey_FirstGid)
+		{
+			TilesetHasFirstGid = true;
+			TilesetFirstGid = Value;
+		}
+		else if (Context == MapContext_LayerData)
+		{
+			if (Writer)
+			{
+				Value = RemapTileEntry(Value, GidRemapTable, NumRemapGids, LayerIndex, DataIndex);
+			}
+			else if (CollectGidsInUse)
+			{
+				MarkGidInUse(&GidsInUse, Value);
+			}
+		}
+		return Scalar() && (!Writer || Writer->Uint(Value));
+	}
+
+	b32 Int64(int64_t Value)
+	{
+		return Scalar() && (!Writer || Writer->Int64(Value));
+	}
+
+	b32 Uint64(uint64_t Value)
+	{
+		return Scalar() && (!Writer || Writer->Uint64(Value));
+	}
+
+	b32 Double(double Value)
+	{
+		return Scalar() && (!Writer || Writer->Double(Value));
+	}
+
+	b32 RawNumber(const char* Str, rapidjson::SizeType Length, bool /*Copy*/)
+	{
+		return Scalar() && (!Writer || Writer->RawValue(Str, Length, rapidjson::kNumberType));
+	}
+
+	b32 String(const char* Str, rapidjson::SizeType Length, bool /*Copy*/)
+	{
+		map_stream_context Context = CurrentContext();
+		if (Context == MapContext_Layer && CurrentKey == MapKey_Data)
+		{
+			LayerHasData = true;
+			LayerDataIsString = true;
+			if (Writer)
+			{
+				return Scalar() && WriteEncodedLayerData(Str, Length);
+			}
+			else if (CollectGidsInUse)
+			{
+				LayerDataText = CopyString(LayerDataText, Str, Length);
+				LayerDataLength = Length;
+			}
+		}
+		else if (Context == MapContext_Layer && CurrentKey == MapKey_Encoding && !Writer)
+		{
+			LayerEncoding = CopyString(LayerEncoding, Str, Length);
+		}
+		else if (Context == MapContext_Layer && CurrentKey == MapKey_Compression && !Writer)
+		{
+			LayerCompressionName = CopyString(LayerCompressionName, Str, Length);
+		}
+		else if (Context == MapContext_Tileset && CurrentKey == MapKey_Source)
+		{
+			TilesetHasSource = true;
+			if (Writer)
+			{
+				const char* NewSource = NewTilesetSources[NumTilesets];
+				if (NewSource)
+				{
+					Str = NewSource;
+					Length = (rapidjson::SizeType)strlen(NewSource);
+				}
+			}
+			else
+			{
+				TilesetSource = CopyString(TilesetSource, Str, Length);
+			}
+		}
+		return Scalar() && (!Writer || Writer->String(Str, Length));
+	}
+
+	b32 WriteEncodedLayerData(const char* Str, rapidjson::SizeType Length)
+	{
+		layer_compression Compression = LayerCompressions[LayerIndex];
+		u32 Count;
+		u32* Entries = DecodeLayerData(Str, Length, Compression, &Count);
+		if (!Entries)
+		{
+			Error = true;
+			return false;
+		}
+		RemapTileEntries(Entries, Count, GidRemapTable, NumRemapGids, LayerIndex);
+
+		u32 EncodedLength;
+		char* Encoded = EncodeLayerData(Entries, Count, Compression, &EncodedLength);
+		b32 Result = Writer->String(Encoded, EncodedLength);
+
+		TrackedFree(Encoded);
+		TrackedFree(Entries);
+		return Result;
+	}
+
+	// Called at the end of each layer while scanning, once its encoding and compression are both known
+	b32 ScanLayerEncoding()
+	{
+		layer_compression Compression = LayerCompression_None;
+		if (LayerDataIsString)
+		{
+			if (!ValidateLayerEncoding(LayerIndex, LayerEncoding, LayerCompressionName, &Compression))
+			{
+				return false;
+			}
+			if (CollectGidsInUse)
+			{
+				u32 Count;
+				u32* Entries = DecodeLayerData(LayerDataText, LayerDataLength, Compression, &Count);
+				if (!Entries)
+				{
+					return false;
+				}
+				for (u32 EntryIndex = 0; EntryIndex < Count; EntryIndex++)
+				{
+					MarkGidInUse(&GidsInUse, Entries[EntryIndex]);
+				}
+				TrackedFree(Entries);
+			}
+		}
+
+		if (LayerIndex == LayerCapacity)
+		{
+			LayerCapacity = LayerCapacity ? LayerCapacity * 2 : 16;
+			LayerCompressions = (layer_compression*)TrackedRealloc(LayerCompressions, sizeof(layer_compression) * LayerCapacity);
+		}
+		LayerCompressions[LayerIndex] = Compression;
+
+		TrackedFree(LayerDataText);
+		TrackedFree(LayerEncoding);
+		TrackedFree(LayerCompressionName);
+		LayerDataText = LayerEncoding = LayerCompressionName = nullptr;
+		return true;
+	}
+
+	b32 Key(const char* Str, rapidjson::SizeType Length, bool /*Copy*/)
+	{
+		CurrentKey = MapKey_Other;
+		map_stream_context Context = CurrentContext();
+		if (Context == MapContext_Root && strcmp(Str, "layers") == 0)
+		{
+			CurrentKey = MapKey_Layers;
+		}
+		else if (Context == MapContext_Root && strcmp(Str, "tilesets") == 0)
+		{
+			CurrentKey = MapKey_Tilesets;
+		}
+		else if (Context == MapContext_Layer && strcmp(Str, "data") == 0)
+		{
+			CurrentKey = MapKey_Data;
+		}
+		else if (Context == MapContext_Layer && strcmp(Str, "encoding") == 0)
+		{
+			CurrentKey = MapKey_Encoding;
+		}
+		else if (Context == MapContext_Layer && strcmp(Str, "compression") == 0)
+		{
+			CurrentKey = MapKey_Compression;
+		}
+		else if (Context == MapContext_Tileset && strcmp(Str, "firstgid") == 0)
+		{
+			CurrentKey = MapKey_FirstGid;
+		}
+		else if (Context == MapContext_Tileset && strcmp(Str, "source") == 0)
+		{
+			CurrentKey = MapKey_Source;
+		}
+		return !Writer || Writer->Key(Str, Length);
+	}
+
+	void Push(map_stream_context NewContext)
+	{
+		if (NewContext == MapContext_Other)
+		{
+			OtherDepth++;
+		}
+		else
+		{
+			Assert(StackSize < ArrayCount(Stack));
+			Stack[StackSize++] = NewContext;
+		}
+		CurrentKey = MapKey_Other;
+	}
+
+	map_stream_context Pop()
+	{
+		map_stream_context Result;
+		if (OtherDepth)
+		{
+			OtherDepth--;
+			Result = MapContext_Other;
+		}
+		else
+		{
+			Assert(StackSize);
+			Result = Stack[--StackSize];
+		}
+		CurrentKey = MapKey_Other;
+		return Result;
+	}
+
+	b32 StartObject()
+	{
+		map_stream_context Context = CurrentContext();
+		map_stream_context NewContext = MapContext_Other;
+		if (!StackSize && !OtherDepth)
+		{
+			NewContext = MapContext_Root;
+		}
+		else if (Context == MapContext_Layers)
+		{
+			NewContext = MapContext_Layer;
+			LayerHasData = false;
+			LayerDataIsString = false;
+			DataIndex = 0;
+		}
+		else if (Context == MapContext_Tilesets)
+		{
+			NewContext = MapContext_Tileset;
+			TilesetHasFirstGid = false;
+			TilesetHasSource = false;
+		}
+		Push(NewContext);
+		return !Writer || Writer->StartObject();
+	}
+
+	b32 EndObject(rapidjson::SizeType MemberCount)
+	{
+		map_stream_context Context = Pop();
+		if (Context == MapContext_Layer)
+		{
+			if (!LayerHasData)
+			{
+				LogError("ERROR: Invalid map format - layer %u has unexpected format and/or is missing 'data' array.\n", LayerIndex);
+				Error = true;
+				return false;
+			}
+			if (!Writer && !ScanLayerEncoding())
+			{
+				Error = true;
+				return false;
+			}
+			LayerIndex++;
+		}
+		else if (Context == MapContext_Tileset)
+		{
+			if (!TilesetHasFirstGid || !TilesetHasSource)
+			{
+				LogError("ERROR: Invalid format of tileset %u in map file.\n", NumTilesets);
+				Error = true;
+				return false;
+			}
+			if (!Writer)
+			{
+				if (NumTilesets == TilesetCapacity)
+				{
+					TilesetCapacity = TilesetCapacity ? TilesetCapacity * 2 : 16;
+					Tilesets = (map_tileset_ref*)TrackedRealloc(Tilesets, sizeof(map_tileset_ref) * TilesetCapacity);
+				}
+				map_tileset_ref* Tileset = Tilesets + NumTilesets;
+				Tileset->Source = TilesetSource;
+				Tileset->FirstTileId = TilesetFirstGid;
+				Tileset->JobIndex = 0;
+				TilesetSource = nullptr;
+			}
+			NumTilesets++;
+		}
+		return !Writer || Writer->EndObject(MemberCount);
+	}
+
+	b32 StartArray()
+	{
+		if (!CheckArrayElement())
+		{
+			return false;
+		}
+
+		map_stream_context Context = CurrentContext();
+		map_stream_context NewContext = MapContext_Other;
+		if (Context == MapContext_Root && CurrentKey == MapKey_Layers)
+		{
+			NewContext = MapContext_Layers;
+			SawLayers = true;
+		}
+		else if (Context == MapContext_Root && CurrentKey == MapKey_Tilesets)
+		{
+			NewContext = MapContext_Tilesets;
+			SawTilesets = true;
+		}
+		else if (Context == MapContext_Layer && CurrentKey == MapKey_Data)
+		{
+			NewContext = MapContext_LayerData;
+			LayerHasData = true;
+		}
+		Push(NewContext);
+		return !Writer || Writer->StartArray();
+	}
+
+	b32 EndArray(rapidjson::SizeType ElementCount)
+	{
+		Pop();
+		return !Writer || Writer->EndArray(ElementCount);
+	}
+};
+
+b32 ParseMapStreaming(const char* MapFilePath, map_stream_handler* Handler)
+{
+	FILE* File = fopen(MapFilePath, "rb");
+	if (!File)
+	{
+		LogError("ERROR: Unable to open '%s' for reading.\n", MapFilePath);
+		return false;
+	}
+
+	char ReadBuffer[1 << 16];
+	rapidjson::FileReadStream InStream(File, ReadBuffer, sizeof(ReadBuffer));
+	rapidjson::Reader Reader;
+	rapidjson::ParseResult ParseResult = Reader.Parse(InStream, *Handler);
+	fclose(File);
+	Handler->FreePendingStrings();
+
+	if (Handler->Error)
+	{
+		return false;
+	}
+	if (ParseResult.IsError())
+	{
+		LogError("ERROR: Failed to parse map '%s': %s\n", MapFilePath, rapidjson::GetParseError_En(ParseResult.Code()));
+		return false;
+	}
+	return true;
+}
+
+// First pass: finds the map's tilesets, and (if requested) every GID used in its layers
+b32 ScanMapStreaming(const char* MapFilePath, b32 CollectGidsInUse, map_tileset_ref** OutTilesets, u32* OutNumTilesets,
+                     tile_index_set* OutGidsInUse, layer_compression** OutLayerCompressions)
+{
+	map_stream_handler Handler = {};
+	Handler.CollectGidsInUse = CollectGidsInUse;
+	b32 Result = ParseMapStreaming(MapFilePath, &Handler);
+	if (Result && !Handler.SawLayers)
+	{
+		LogError("ERROR: Invalid map format - 'layers' element not found or invalid format.\n");
+		Result = false;
+	}
+	else if (Result && !Handler.SawTilesets)
+	{
+		LogError("ERROR: Invalid map format - 'tilesets' not found or invalid format.\n");
+		Result = false;
+	}
+	else if (Result && Handler.NumTilesets == 0)
+	{
+		LogError("ERROR: 'tilesets' array in map file is empty.\n");
+		Result = false;
+	}
+	if (!Result)
+	{
+		for (u32 TilesetIndex = 0; TilesetIndex < Handler.NumTilesets; TilesetIndex++)
+		{
+			TrackedFree((void*)Handler.Tilesets[TilesetIndex].Source);
+		}
+		TrackedFree(Handler.Tilesets);
+		TrackedFree(Handler.LayerCompressions);
+		FreeTileIndexSet(&Handler.GidsInUse);
+		return false;
+	}
+
+	*OutTilesets = Handler.Tilesets;
+	*OutNumTilesets = Handler.NumTilesets;
+	*OutGidsInUse = Handler.GidsInUse;
+	*OutLayerCompressions = Handler.LayerCompressions;
+	return true;
+}
+
+// Second pass: copies the map to OutPath, swapping in new tileset paths and remapped layer data as it goes
+b32 RewriteMapStreaming(const char* MapFilePath, const char* OutPath, const char** NewTilesetSources,
+                        u32* GidRemapTable, u32 NumRemapGids, layer_compression* LayerCompressions)
+{
+	FILE* OutFile = fopen(OutPath, "wb");
+	if (!OutFile)
+	{
+		LogError("ERROR: Failed to open file '%s' for writing.\n", OutPath);
+		return false;
+	}
+
+	char WriteBuffer[1 << 16];
+	rapidjson::FileWriteStream OutStream(OutFile, WriteBuffer, sizeof(WriteBuffer));
+	rapidjson::Writer<rapidjson::FileWriteStream> Writer(OutStream);
+
+	map_stream_handler Handler = {};
+	Handler.Writer = &Writer;
+	Handler.NewTilesetSources = NewTilesetSources;
+	Handler.GidRemapTable = GidRemapTable;
+	Handler.NumRemapGids = NumRemapGids;
+	Handler.LayerCompressions = LayerCompressions;
+
+	b32 Result = ParseMapStreaming(MapFilePath, &Handler);
+	OutStream.Flush();
+	if (ferror(OutFile))
+	{
+		LogError("ERROR: Failed to write to file '%s'.\n", OutPath);
+		Result = false;
+	}
+	fclose(OutFile);
+
+	return Result;
+}
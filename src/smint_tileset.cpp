@@ -1,104 +1,374 @@
 
-b32 AreTilesEqualNoFlip(tile* A, tile* B)
+void CanonicaliseTile(tile* Tile, unique_tile* OutUniqueTile)
 {
-	for (u32 Y = 0; Y < 8; Y++)
+	tile* Canonical = &OutUniqueTile->Canonical;
+	*Canonical = *Tile;
+	OutUniqueTile->CanonicalTransform = TileTransform_Unchanged;
+	OutUniqueTile->SymmetryMask = 1 << TileTransform_Unchanged;
+
+	for (u32 Transform = TileTransform_HFlip; Transform < TileTransform_Count; Transform++)
 	{
-		for (u32 X = 0; X < 8; X++)
+		tile Variant;
+		CopyTransformedTile(Tile, &Variant, (tile_transform_type)Transform);
+
+		s32 Order = CompareTiles(&Variant, Canonical);
+		if (Order < 0)
 		{
-			pixel* PixelA = PixelAt(A, X, Y);
-			pixel* PixelB = PixelAt(B, X, Y);
-			if (*PixelA != *PixelB)
+			*Canonical = Variant;
+			OutUniqueTile->CanonicalTransform = (tile_transform_type)Transform;
+		}
+		if (AreTilesEqualNoFlip(&Variant, Tile))
+		{
+			OutUniqueTile->SymmetryMask |= 1 << Transform;
+		}
+	}
+}
+
+// Given that a tile canonicalised to the same tile as UniqueTile, work out the transform to apply to the unique tile's
+// original orientation to get that tile. Symmetrical tiles have several valid answers; pick the lowest so results match
+// the order variants were always checked in.
+void MarkTileEquivalent(unique_tile* UniqueTile, tile_mapping* Mapping, tile_transform_type CanonicalTransform)
+{
+	// Flips commute and are their own inverse, so composing transforms is just an XOR
+	u32 Transform = CanonicalTransform ^ UniqueTile->CanonicalTransform;
+	for (u32 Symmetry = TileTransform_Unchanged; Symmetry < TileTransform_Count; Symmetry++)
+	{
+		if ((UniqueTile->SymmetryMask & (1 << Symmetry)) && (Transform ^ Symmetry) < Transform)
+		{
+			Transform ^= Symmetry;
+		}
+	}
+
+	Mapping->EquivalentUniqueTile = UniqueTile;
+	Mapping->EqualAfterTransform = (tile_transform_type)Transform;
+}
+
+void GetOriginalTile(unique_tile* UniqueTile, tile* OutTile)
+{
+	CopyTransformedTile(&UniqueTile->Canonical, OutTile, UniqueTile->CanonicalTransform);
+}
+
+u32 HashTile(tile* Tile)
+{
+	// Alpha is masked out, since AreTilesEqualNoFlip ignores it too
+	u64 Hash = 14695981039346656037ull;
+	u32* PixelBits = (u32*)Tile->Pixels;
+	for (u32 PixelIndex = 0; PixelIndex < ArrayCount(Tile->Pixels); PixelIndex++)
+	{
+		Hash ^= PixelBits[PixelIndex] & 0x00FFFFFF;
+		Hash *= 1099511628211ull;
+	}
+	u32 Result = (u32)(Hash ^ (Hash >> 32));
+	return Result;
+}
+
+tile_hash_table CreateTileHashTable(memory_arena* Arena, u32 MaxEntries)
+{
+	tile_hash_table Result = {};
+
+	// Keep load factor at or below 50% so probe sequences stay short
+	Result.Capacity = 16;
+	while (Result.Capacity < MaxEntries * 2)
+	{
+		Result.Capacity *= 2;
+	}
+	Result.Entries = PushArrayZero(Arena, Result.Capacity, tile_hash_entry);
+	return Result;
+}
+
+void InsertTileHashEntry(tile_hash_table* Table, u32 Hash, u32 UniqueTileIndex)
+{
+	Assert(Table->NumEntries * 2 < Table->Capacity);
+	u32 Mask = Table->Capacity - 1;
+	u32 Slot = Hash & Mask;
+	while (Table->Entries[Slot].UniqueTileIndex)
+	{
+		Slot = (Slot + 1) & Mask;
+	}
+
+	tile_hash_entry* Entry = Table->Entries + Slot;
+	Entry->Hash = Hash;
+	Entry->UniqueTileIndex = UniqueTileIndex + 1;
+	Table->NumEntries++;
+}
+
+// The table starts small and doubles as unique tiles are found, so its size follows the number of unique tiles rather
+// than the number of source tiles. Outgrown tables are left on the arena.
+void InsertUniqueTile(memory_arena* Arena, tile_hash_table* Table, u32 Hash, u32 UniqueTileIndex)
+{
+	if ((Table->NumEntries + 1) * 2 >= Table->Capacity)
+	{
+		tile_hash_table OldTable = *Table;
+		Table->Capacity *= 2;
+		Table->NumEntries = 0;
+		Table->Entries = PushArrayZero(Arena, Table->Capacity, tile_hash_entry);
+		for (u32 Slot = 0; Slot < OldTable.Capacity; Slot++)
+		{
+			tile_hash_entry* Entry = OldTable.Entries + Slot;
+			if (Entry->UniqueTileIndex)
 			{
-				return false;
+				InsertTileHashEntry(Table, Entry->Hash, Entry->UniqueTileIndex - 1);
 			}
 		}
 	}
-	return true;
+	InsertTileHashEntry(Table, Hash, UniqueTileIndex);
+}
+
+// Unique tiles as they're found, in fixed-size chunks pushed onto an arena as each one fills up. Tiles never move once
+// added, so memory grows with the number of unique tiles instead of being reserved for every tile being unique.
+#define UNIQUE_TILES_PER_CHUNK 1024
+
+struct unique_tile_store
+{
+	memory_arena* Arena;
+	unique_tile** Chunks;
+	u32 NumUniqueTiles;
+};
+
+unique_tile_store CreateUniqueTileStore(memory_arena* Arena, u32 MaxUniqueTiles)
+{
+	unique_tile_store Result = {};
+	Result.Arena = Arena;
+	Result.Chunks = PushArray(Arena, (MaxUniqueTiles + UNIQUE_TILES_PER_CHUNK - 1) / UNIQUE_TILES_PER_CHUNK, unique_tile*);
+	return Result;
+}
+
+unique_tile* GetUniqueTile(unique_tile_store* Store, u32 UniqueTileIndex)
+{
+	unique_tile* Result = Store->Chunks[UniqueTileIndex / UNIQUE_TILES_PER_CHUNK] + UniqueTileIndex % UNIQUE_TILES_PER_CHUNK;
+	return Result;
 }
 
-b32 AreTilesEqual(unique_tile* UniqueTile, tile* TileToCheck)
+unique_tile* AddUniqueTile(unique_tile_store* Store)
 {
-	for (u32 VariantIndex = TileTransform_Unchanged; VariantIndex < TileTransform_Count; VariantIndex++)
+	u32 UniqueTileIndex = Store->NumUniqueTiles++;
+	if (UniqueTileIndex % UNIQUE_TILES_PER_CHUNK == 0)
 	{
-		tile* UniqueVariant = UniqueTile->Variants + VariantIndex;
-		if (AreTilesEqualNoFlip(UniqueVariant, TileToCheck))
+		Store->Chunks[UniqueTileIndex / UNIQUE_TILES_PER_CHUNK] = PushArray(Store->Arena, UNIQUE_TILES_PER_CHUNK, unique_tile);
+	}
+	unique_tile* Result = GetUniqueTile(Store, UniqueTileIndex);
+	return Result;
+}
+
+// Copies every unique tile, in order, into one array of exactly the right size
+unique_tile* PackUniqueTiles(unique_tile_store* Store, memory_arena* Arena)
+{
+	unique_tile* Result = PushArray(Arena, Store->NumUniqueTiles, unique_tile);
+	for (u32 FirstIndex = 0; FirstIndex < Store->NumUniqueTiles; FirstIndex += UNIQUE_TILES_PER_CHUNK)
+	{
+		u32 Count = Store->NumUniqueTiles - FirstIndex;
+		if (Count > UNIQUE_TILES_PER_CHUNK)
+		{
+			Count = UNIQUE_TILES_PER_CHUNK;
+		}
+		memcpy(Result + FirstIndex, Store->Chunks[FirstIndex / UNIQUE_TILES_PER_CHUNK], sizeof(unique_tile) * Count);
+	}
+	return Result;
+}
+
+// Returns the index of the unique tile with the same canonical form as Candidate, or -1; a full compare only happens
+// on a hash hit
+s32 FindUniqueTile(tile_hash_table* Table, unique_tile_store* UniqueTiles, unique_tile* Candidate, u32 Hash)
+{
+	u32 Mask = Table->Capacity - 1;
+	for (u32 Slot = Hash & Mask; Table->Entries[Slot].UniqueTileIndex; Slot = (Slot + 1) & Mask)
+	{
+		tile_hash_entry* Entry = Table->Entries + Slot;
+		if (Entry->Hash != Hash)
 		{
-			TileToCheck->EquivalentUniqueTile = UniqueTile;
-			TileToCheck->EqualAfterTransform = (tile_transform_type)VariantIndex;
-			return true;
+			continue;
+		}
+
+		unique_tile* UniqueTile = GetUniqueTile(UniqueTiles, Entry->UniqueTileIndex - 1);
+		if (AreTilesEqualNoFlip(&UniqueTile->Canonical, &Candidate->Canonical))
+		{
+			return (s32)(Entry->UniqueTileIndex - 1);
 		}
 	}
 
-	return false;
+	return -1;
 }
 
-void CopyTransformedTile(tile* SourceTile, tile* OutTransformedTile, tile_transform_type Transform)
+// FindUniqueTile for --indexed, where unique tiles are compared by the indexed form of the source tile each came from
+s32 FindIndexedUniqueTile(tile_hash_table* Table, indexed_tile* IndexedTiles, u32* UniqueSourceTiles, indexed_tile* Candidate,
+                          u32 Hash, u32 BitsPerPixel)
 {
-	for (u32 Y = 0; Y < 8; Y++)
+	u32 Mask = Table->Capacity - 1;
+	for (u32 Slot = Hash & Mask; Table->Entries[Slot].UniqueTileIndex; Slot = (Slot + 1) & Mask)
 	{
-		for (u32 X = 0; X < 8; X++)
+		tile_hash_entry* Entry = Table->Entries + Slot;
+		if (Entry->Hash != Hash)
 		{
-			pixel* PixelToWrite = PixelAt(OutTransformedTile, X, Y);
+			continue;
+		}
 
-			pixel* PixelToRead;
-			switch (Transform)
+		indexed_tile* UniqueTile = IndexedTiles + UniqueSourceTiles[Entry->UniqueTileIndex - 1];
+		if (AreIndexedTilesEqual(UniqueTile, Candidate, BitsPerPixel))
+		{
+			return (s32)(Entry->UniqueTileIndex - 1);
+		}
+	}
+
+	return -1;
+}
+
+// Decoded tiles of a tileset image and their keys, kept from one minimisation to the next by --watch so that when the
+// image is saved again only the tiles whose pixels changed need canonicalising
+struct resident_tiles
+{
+	tileset_image Image;
+	tile_key* Keys; // For every tile, used or not
+	b32 AreKeysIndexed; // Hashed from indexed tiles, so no use to a run that isn't indexed (or has a different palette)
+};
+
+struct tile_rows_work
+{
+	tileset_image* Image;
+	tile_key* Keys;
+	b8* TilesInUse;
+	resident_tiles* Previous; // nullptr, or the same image as last time (same dimensions) to reuse unchanged tiles' keys from
+	tile_palette* Palette; // Only with --indexed
+	indexed_tile* IndexedTiles; // Canonical form of every tile, if Palette is set
+	u32 FirstRow;
+	u32 OnePastLastRow;
+};
+
+// Reorders a band of tile rows of the decoded image in place from scanline order to tile-major order, then canonicalises
+// and hashes each tile. Every band is independent of the others, so bands can be handed to separate threads.
+void PrepareTileRows(tile_rows_work* Work)
+{
+	tileset_image* Image = Work->Image;
+
+	// One tile row (8 scanlines) is the same number of pixels in either layout, so only one band needs copying aside
+	u32 PixelsPerBand = Image->TileWidth * 8 * 8;
+	pixel* Scanlines = (pixel*)TrackedMalloc(sizeof(pixel) * PixelsPerBand);
+
+	for (u32 TileY = Work->FirstRow; TileY < Work->OnePastLastRow; TileY++)
+	{
+		tile* BandTiles = Image->Tiles + TileY * Image->TileWidth;
+		memcpy(Scanlines, BandTiles, sizeof(pixel) * PixelsPerBand);
+
+		for (u32 TileX = 0; TileX < Image->TileWidth; TileX++)
+		{
+			tile* Tile = BandTiles + TileX;
+			for (u32 PixelY = 0; PixelY < 8; PixelY++)
 			{
-				case TileTransform_HFlip:
-				{
-					PixelToRead = PixelAt(SourceTile, 8 - X - 1, Y);
-				} break;
-				case TileTransform_VFlip:
-				{
-					PixelToRead = PixelAt(SourceTile, X, 8 - Y - 1);
-				} break;
-				case TileTransform_DiagonalFlip:
-				{
-					PixelToRead = PixelAt(SourceTile, 8 - X - 1, 8 - Y - 1);
-				} break;
-				default:
-				{
-					PixelToRead = PixelAt(SourceTile, X, Y);
-				} break;
+				pixel* PixelsToRead = Scanlines + PixelY * 8 * Image->TileWidth + TileX * 8;
+				memcpy(PixelAt(Tile, 0, PixelY), PixelsToRead, sizeof(pixel) * 8);
+			}
+		}
+
+		for (u32 TileX = 0; TileX < Image->TileWidth; TileX++)
+		{
+			u32 TileIndex = TileY * Image->TileWidth + TileX;
+			if (Work->TilesInUse && !Work->TilesInUse[TileIndex])
+			{
+				continue;
+			}
+
+			tile_key* Key = Work->Keys + TileIndex;
+			if (Work->Palette)
+			{
+				indexed_tile IndexedTile;
+				IndexTile(Work->Palette, BandTiles + TileX, &IndexedTile);
+				CanonicaliseIndexedTile(&IndexedTile, Work->Palette->BitsPerPixel, Work->IndexedTiles + TileIndex, Key);
+				continue;
+			}
+
+			if (Work->Previous && memcmp(BandTiles + TileX, Work->Previous->Image.Tiles + TileIndex, sizeof(tile)) == 0)
+			{
+				*Key = Work->Previous->Keys[TileIndex];
+				continue;
 			}
 
-			*PixelToWrite = *PixelToRead;
+			unique_tile Candidate;
+			CanonicaliseTile(BandTiles + TileX, &Candidate);
+
+			Key->Hash = HashTile(&Candidate.Canonical);
+			Key->CanonicalTransform = Candidate.CanonicalTransform;
+			Key->SymmetryMask = Candidate.SymmetryMask;
 		}
 	}
+
+	TrackedFree(Scanlines);
 }
 
-void GenerateTileVariants(tile* Tile, unique_tile* OutUniqueTile)
-{	
-	for (u32 Transform = TileTransform_Unchanged; Transform < TileTransform_Count; Transform++)
+// Don't bother spinning up threads for tilesets smaller than this
+#define MIN_TILES_PER_THREAD 2048
+
+void PrepareTiles(tileset_image* Image, tile_key* Keys, b8* TilesInUse, u32 NumThreads, resident_tiles* Previous = nullptr,
+                  tile_palette* Palette = nullptr, indexed_tile* IndexedTiles = nullptr)
+{
+	u32 MaxUsefulThreads = (Image->TileWidth * Image->TileHeight) / MIN_TILES_PER_THREAD;
+	if (NumThreads > MaxUsefulThreads)
+	{
+		NumThreads = MaxUsefulThreads;
+	}
+	if (NumThreads > Image->TileHeight)
+	{
+		NumThreads = Image->TileHeight;
+	}
+	if (NumThreads < 1)
+	{
+		NumThreads = 1;
+	}
+
+	tile_rows_work* Work = (tile_rows_work*)TrackedMalloc(sizeof(tile_rows_work) * NumThreads);
+	for (u32 ThreadIndex = 0; ThreadIndex < NumThreads; ThreadIndex++)
 	{
-		tile* DestTile = OutUniqueTile->Variants + Transform;
-		DestTile->EquivalentUniqueTile = nullptr;
-		DestTile->EqualAfterTransform = TileTransform_Unchanged;
+		Work[ThreadIndex].Image = Image;
+		Work[ThreadIndex].Keys = Keys;
+		Work[ThreadIndex].TilesInUse = TilesInUse;
+		Work[ThreadIndex].Previous = Previous;
+		Work[ThreadIndex].Palette = Palette;
+		Work[ThreadIndex].IndexedTiles = IndexedTiles;
+		Work[ThreadIndex].FirstRow = (u32)(((u64)Image->TileHeight * ThreadIndex) / NumThreads);
+		Work[ThreadIndex].OnePastLastRow = (u32)(((u64)Image->TileHeight * (ThreadIndex + 1)) / NumThreads);
+	}
 
-		CopyTransformedTile(Tile, DestTile, (tile_transform_type)Transform);
+	std::thread* Threads = new std::thread[NumThreads];
+	for (u32 ThreadIndex = 1; ThreadIndex < NumThreads; ThreadIndex++)
+	{
+		Threads[ThreadIndex] = std::thread(PrepareTileRows, Work + ThreadIndex);
 	}
+	PrepareTileRows(Work);
+	for (u32 ThreadIndex = 1; ThreadIndex < NumThreads; ThreadIndex++)
+	{
+		Threads[ThreadIndex].join();
+	}
+
+	delete[] Threads;
+	TrackedFree(Work);
 }
 
-b32 ParseTilesetJson(const char* TilesetPath, u64 OutStringLength, rapidjson::Document& OutJsonDoc)
+// OutTilesetText is parsed in place, so it has to outlive OutJsonDoc; it's pushed onto Arena
+b32 ParseTilesetJson(const char* BaseDir, const char* TilesetPath, memory_arena* Arena, str_buffer& OutTilesetText,
+                     json_document& OutJsonDoc)
 {
 	char FileExtension[16];
 	GetFileExtension(TilesetPath, FileExtension);
 	if (strcmp(FileExtension, ".tsj") != 0 && strcmp(FileExtension, ".json") != 0)
 	{
-		fprintf(stderr, "ERROR: Tileset file '%s' has unsupported extension '%s' - must be .tsj/.json\n", TilesetPath, FileExtension);
+		LogError("ERROR: Tileset file '%s' has unsupported extension '%s' - must be .tsj/.json\n", TilesetPath, FileExtension);
 		return false;
 	}
 
 	// Parse tileset .tsj file
-	str_buffer TilesetSpecStr = ReadTextFile(TilesetPath);
-	OutStringLength = TilesetSpecStr.Size;
-	if (OutJsonDoc.ParseInsitu(TilesetSpecStr.Data).HasParseError())
+	char TilesetFullPath[MAX_PATH];
+	JoinPath(BaseDir, TilesetPath, TilesetFullPath);
+	OutTilesetText = ReadTextFile(TilesetFullPath, Arena);
+	if (!OutTilesetText.Data)
+	{
+		return false;
+	}
+	if (OutJsonDoc.ParseInsitu(OutTilesetText.Data).HasParseError())
 	{
-		fprintf(stderr, "ERROR: Failed to parse tileset '%s': %s\n", TilesetPath, rapidjson::GetParseError_En(OutJsonDoc.GetParseError()));
+		LogError("ERROR: Failed to parse tileset '%s': %s\n", TilesetPath, rapidjson::GetParseError_En(OutJsonDoc.GetParseError()));
 		return false;
 	}
 	if (!OutJsonDoc.HasMember("image") || !OutJsonDoc["image"].IsString())
 	{
-		fprintf(stderr, "ERROR: Could not find 'image' field in tileset file.\n");
+		LogError("ERROR: Could not find 'image' field in tileset file.\n");
 		return false;
 	}
 	if (OutJsonDoc.HasMember("tilewidth") && OutJsonDoc["tilewidth"].IsUint() &&
@@ -106,32 +376,132 @@ b32 ParseTilesetJson(const char* TilesetPath, u64 OutStringLength, rapidjson::Do
 	{
 		if (OutJsonDoc["tilewidth"].GetUint() != 8 || OutJsonDoc["tileheight"].GetUint() != 8)
 		{
-			fprintf(stderr, "ERROR: Tile dimensions in tileset '%s' are not 8x8 - cannot minimise.\n", TilesetPath);
+			LogError("ERROR: Tile dimensions in tileset '%s' are not 8x8 - cannot minimise.\n", TilesetPath);
 			return false;
 		}
 	}
 	else
 	{
-		printf("WARNING: No tile dimensions found in tileset file '%s'; proceeding on the assumption that tiles are 8x8\n", TilesetPath);
+		LogInfo("WARNING: No tile dimensions found in tileset file '%s'; proceeding on the assumption that tiles are 8x8\n", TilesetPath);
 	}
 	return true;
 }
 
+// Where a tileset's image is read from and its minimised files are written to. TilesetPath is relative to the map, and
+// ImagePath is relative to the tileset.
+struct tileset_paths
+{
+	char TilesetDir[MAX_PATH];
+	char ImageFullPath[MAX_PATH];
+	char ImageOutPath[MAX_PATH]; // Relative to the tileset, as written into its JSON
+	char ImageOutFullPath[MAX_PATH];
+	char NewTilesetPath[MAX_PATH]; // Relative to the map
+	char NewTilesetFullPath[MAX_PATH];
+};
+
+void GetTilesetPaths(const char* MapDir, const char* TilesetPath, const char* ImagePath, tileset_paths* Out)
+{
+	char TilesetFullPath[MAX_PATH];
+	JoinPath(MapDir, TilesetPath, TilesetFullPath);
+	StripFileName(TilesetFullPath, Out->TilesetDir);
+	JoinPath(Out->TilesetDir, ImagePath, Out->ImageFullPath);
+
+	StripFileExtension(ImagePath, Out->ImageOutPath);
+	strcat(Out->ImageOutPath, "_min.png");
+	JoinPath(Out->TilesetDir, Out->ImageOutPath, Out->ImageOutFullPath);
+
+	AppendToFilePath(TilesetPath, "_min", Out->NewTilesetPath);
+	JoinPath(MapDir, Out->NewTilesetPath, Out->NewTilesetFullPath);
+}
+
 struct minimised_tileset
 {
-	tileset_image OriginalImage;
-	unique_tile* MinimisedTiles;
+	tileset_image OriginalImage; // Pixels are freed once deduplicated, only the dimensions are kept
+	tile_mapping* Mappings; // One per source tile
+	unique_tile* MinimisedTiles; // Exactly NumUniqueTiles of them
 	u32 NumUniqueTiles;
+	pixel KeyPixel; // Top-left pixel of the original image, whichever tiles -rut drops or --tile-order moves
 	b32 Error;
 	b32 IsUnchanged;
 };
 
+// Lays the tiles out (in their original orientation) in the most square-ish image whose width and height both evenly
+// divide NumTiles, so there are no blank/wasted tiles, and writes it out as a PNG (with the built-in writer if Png is
+// given, otherwise stb's). Returns false if it couldn't be written.
+b32 WriteUniqueTileImage(unique_tile* Tiles, u32 NumTiles, const char* FilePath, memory_arena* Scratch, u32* OutTileWidth,
+                         u32* OutTileHeight, png_options* Png = nullptr)
+{
+	u32 OutputTileHeight = (u32)sqrt(NumTiles);
+	u32 OutputTileWidth = NumTiles / OutputTileHeight;
+	while (!(NumTiles % OutputTileWidth == 0 && NumTiles % OutputTileHeight == 0))
+	{
+		OutputTileHeight--;
+		OutputTileWidth = NumTiles / OutputTileHeight;
+	}
+
+	s32 OutputImageWidth = (s32)OutputTileWidth * 8;
+	s32 OutputImageHeight = (s32)OutputTileHeight * 8;
+	Assert(OutputImageWidth > 0 && OutputTileHeight > 0);
+
+	temp_memory ImageMemory = BeginTemporaryMemory(Scratch);
+	pixel* OutputPixels = PushArray(Scratch, OutputImageWidth * OutputImageHeight, pixel);
+	for (u32 TileY = 0; TileY < OutputTileHeight; TileY++)
+	{
+		for (u32 TileX = 0; TileX < OutputTileWidth; TileX++)
+		{
+			u32 TileIndex = TileY * OutputTileWidth + TileX;
+			tile OriginalTile;
+			GetOriginalTile(Tiles + TileIndex, &OriginalTile);
+			tile* SourceTile = &OriginalTile;
+
+			for (u32 PixelY = 0; PixelY < 8; PixelY++)
+			{
+				for (u32 PixelX = 0; PixelX < 8; PixelX++)
+				{
+					u32 DestIndex = TileY * OutputImageWidth * 8 + PixelY * OutputImageWidth + TileX * 8 + PixelX;
+
+					pixel* PixelToWrite = OutputPixels + DestIndex;
+					pixel* PixelToRead = PixelAt(SourceTile, PixelX, PixelY);
+
+					*PixelToWrite = *PixelToRead;
+				}
+			}
+		}
+	}
+
+	b32 Result;
+	if (Png)
+	{
+		Result = WritePng(FilePath, OutputPixels, (u32)OutputImageWidth, (u32)OutputImageHeight, Png, Scratch);
+	}
+	else
+	{
+		s32 Stride = OutputImageWidth * sizeof(pixel);
+		Result = stbi_write_png(FilePath, OutputImageWidth, OutputImageHeight, 4, OutputPixels, Stride) != 0;
+	}
+	EndTemporaryMemory(ImageMemory);
+	*OutTileWidth = OutputTileWidth;
+	*OutTileHeight = OutputTileHeight;
+	return Result;
+}
+
+// The result is pushed onto Arena. Everything else that's needed along the way goes on Scratch (apart from the decoded
+// image, which stb allocates itself), so callers can give it back with a temporary memory scope.
 minimised_tileset MinimiseTileset(const char* TilesetPath,
-								  rapidjson::Document& JsonDoc,
+								  json_document& JsonDoc,
 								  u64 StringLength,
 								  char* OutNewTilesetPath,
-								  char* CurrentWorkingDir = nullptr,
-								  b8* TilesInUse = nullptr)
+								  const char* MapDir,
+								  memory_arena* Arena,
+								  memory_arena* Scratch,
+								  b8* TilesInUse = nullptr,
+								  b32 UseLinearDedup = false,
+								  u32 NumThreads = 1,
+								  resident_tiles* Resident = nullptr,
+								  b32 UseIndexedTiles = false,
+								  u32 TileOrder = SMINT_TILE_ORDER_FIRST,
+								  tile_usage* Usage = nullptr,
+								  png_options* Png = nullptr)
 {
 	minimised_tileset Result = {};
 
@@ -139,159 +509,249 @@ minimised_tileset MinimiseTileset(const char* TilesetPath,
 	ExtractBaseFileName(TilesetPath, TilesetBaseName);
 
 	const char* ImagePath = JsonDoc["image"].GetString();
-	char TilesetWorkingDir[MAX_PATH];
-	StripFileName(TilesetPath, TilesetWorkingDir);
-
-	if (*TilesetWorkingDir)
-	{
-		// Change working directory to where the .tsj file is so we can resolve the relative path to the image file
-		if (!ChangeWorkingDir(TilesetWorkingDir))
-		{
-			Result.Error = true;
-			return Result;
-		}
-	}
+	tileset_paths Paths;
+	GetTilesetPaths(MapDir, TilesetPath, ImagePath, &Paths);
 
+	stage_timer LoadTimer = BeginStage(Stage_LoadImage);
 	s32 ImageWidth, ImageHeight, ImageNumComponents;
-	u8* ImageData = stbi_load(ImagePath, &ImageWidth, &ImageHeight, &ImageNumComponents, 4);
+	u8* ImageData = stbi_load(Paths.ImageFullPath, &ImageWidth, &ImageHeight, &ImageNumComponents, 4);
 	if (!ImageData)
 	{
 		const char* FailReason = stbi_failure_reason();
-		fprintf(stderr, "ERROR: Failed to load image file '%s': %s\n", ImagePath, FailReason);
+		LogError("ERROR: Failed to load image file '%s': %s\n", ImagePath, FailReason);
 		Result.Error = true;
 		return Result;
 	}
 	Assert((ImageWidth * ImageHeight) % sizeof(pixel) == 0);
 	if ((ImageWidth % 8 != 0) || (ImageHeight % 8 != 0))
 	{
-		fprintf(stderr, "ERROR: Image dimensions (%dx%d) do not split evenly into 8x8 tiles; please modify the image before proceeding.\n",
+		LogError("ERROR: Image dimensions (%dx%d) do not split evenly into 8x8 tiles; please modify the image before proceeding.\n",
 		        ImageWidth, ImageHeight);
+		stbi_image_free(ImageData);
 		Result.Error = true;
 		return Result;
 	}
 
-	pixel* Pixels = (pixel*)ImageData;
+	EndStage(&LoadTimer);
+	Result.KeyPixel = *(pixel*)ImageData;
 
+	// The decoded image is rearranged into tiles in place, so there's never a second copy of it
 	tileset_image* OriginalImage = &Result.OriginalImage;
 	OriginalImage->TileWidth = (u32)ImageWidth / 8;
 	OriginalImage->TileHeight = (u32)ImageHeight / 8;
-	OriginalImage->Tiles = (tile*)malloc(sizeof(tile) * OriginalImage->TileWidth * OriginalImage->TileHeight);
-
-	// Copy pixels into tiles
-	for (u32 TileY = 0; TileY < OriginalImage->TileHeight; TileY++)
+	OriginalImage->Tiles = (tile*)ImageData;
+
+	// Canonicalise and hash every tile (in parallel for big images). Resident tiles need a key for every tile, since the
+	// tiles in use may be different next time.
+	stage_timer ExtractTimer = BeginStage(Stage_ExtractTiles);
+	u32 NumSourceTiles = OriginalImage->TileWidth * OriginalImage->TileHeight;
+	// Resident keys outlive the run, so they can't go on the scratch arena
+	tile_key* Keys = Resident ? (tile_key*)TrackedMalloc(sizeof(tile_key) * NumSourceTiles) : PushArray(Scratch, NumSourceTiles, tile_key);
+
+	tile_palette* Palette = nullptr;
+	indexed_tile* IndexedTiles = nullptr;
+	if (UseIndexedTiles)
 	{
-		for (u32 TileX = 0; TileX < OriginalImage->TileWidth; TileX++)
+		Palette = PushStruct(Scratch, tile_palette);
+		if (BuildTilePalette(OriginalImage, Palette))
 		{
-			tile* Tile = TileAt(OriginalImage, TileX, TileY);
-			Tile->EquivalentUniqueTile = nullptr;
-			Tile->EqualAfterTransform = TileTransform_Unchanged;
-			for (u32 PixelY = 0; PixelY < 8; PixelY++)
-			{
-				for (u32 PixelX = 0; PixelX < 8; PixelX++)
-				{
-					u32 PixelIndex = TileY * OriginalImage->TileWidth * 8 * 8 + PixelY * 8 * OriginalImage->TileWidth + TileX * 8 + PixelX;
-					
-					pixel* PixelToRead = Pixels + PixelIndex;
-					pixel* PixelToWrite = PixelAt(Tile, PixelX, PixelY);
-
-					*PixelToWrite = *PixelToRead;
-				}
-			}
+			IndexedTiles = PushArray(Scratch, NumSourceTiles, indexed_tile);
+		}
+		else
+		{
+			LogInfo("WARNING: Tileset '%s' has more than %u colours, so its tiles will be compared in RGBA instead.\n",
+			        TilesetBaseName, MAX_PALETTE_COLOURS);
+			Palette = nullptr;
 		}
 	}
 
-	// Find all unique tiles
-	Result.MinimisedTiles = (unique_tile*)malloc(sizeof(unique_tile) * OriginalImage->TileWidth * OriginalImage->TileHeight);
-	unique_tile* MinimisedTiles = Result.MinimisedTiles;
+	if (Resident)
+	{
+		b32 CanReuseKeys = Resident->Image.Tiles && Resident->Image.TileWidth == OriginalImage->TileWidth &&
+		                   Resident->Image.TileHeight == OriginalImage->TileHeight && !Resident->AreKeysIndexed && !Palette;
+		PrepareTiles(OriginalImage, Keys, nullptr, NumThreads, CanReuseKeys ? Resident : nullptr, Palette, IndexedTiles);
+	}
+	else
+	{
+		PrepareTiles(OriginalImage, Keys, TilesInUse, NumThreads, nullptr, Palette, IndexedTiles);
+	}
+	EndStage(&ExtractTimer);
+
+	// Find all unique tiles. This part stays serial and in tile order, so unique tile indices are the same no matter how
+	// many threads did the prep work.
+	stage_timer DedupTimer = BeginStage(Stage_Dedup);
+	unique_tile_store UniqueTiles = CreateUniqueTileStore(Scratch, NumSourceTiles);
+	Result.Mappings = PushArrayZero(Arena, NumSourceTiles, tile_mapping);
+
+	// Mappings can only point at their unique tiles once they've been packed into the result, so until then each source
+	// tile's unique tile index is kept here
+	u32* UniqueTileIndices = PushArray(Scratch, NumSourceTiles, u32);
 
-	for (u32 TileY = 0; TileY < OriginalImage->TileHeight; TileY++)
+	// With --indexed, the source tile each unique tile came from, whose indexed form it's compared by
+	u32* UniqueSourceTiles = Palette ? PushArray(Scratch, NumSourceTiles, u32) : nullptr;
+
+	tile_hash_table HashTable = {};
+	if (!UseLinearDedup)
 	{
-		for (u32 TileX = 0; TileX < OriginalImage->TileWidth; TileX++)
+		HashTable = CreateTileHashTable(Scratch, NumSourceTiles < 4096 ? NumSourceTiles : 4096);
+	}
+
+	for (u32 TileIndex = 0; TileIndex < NumSourceTiles; TileIndex++)
+	{
+		if (TilesInUse && !TilesInUse[TileIndex])
 		{
-			u32 TileIndex = TileY * OriginalImage->TileWidth + TileX;
-			Assert(TileIndex < OriginalImage->TileWidth * OriginalImage->TileHeight);
-			if (TilesInUse && !TilesInUse[TileIndex])
-			{
-				// If this tile isn't used anywhere in the map, drop it immediately
-				continue;
-			}
+			// If this tile isn't used anywhere in the map, drop it immediately
+			continue;
+		}
+
+		tile* Tile = OriginalImage->Tiles + TileIndex;
+		tile_mapping* Mapping = Result.Mappings + TileIndex;
+		tile_key* Key = Keys + TileIndex;
 
-			tile* Tile = TileAt(OriginalImage, TileX, TileY);
+		// Indexed tiles canonicalise exactly as their pixels would, so their keys give the RGBA unique tile too; its pixels
+		// only need copying if it turns out to be new
+		unique_tile Candidate;
+		if (!Palette)
+		{
+			CopyTransformedTile(Tile, &Candidate.Canonical, Key->CanonicalTransform);
+		}
+		Candidate.CanonicalTransform = Key->CanonicalTransform;
+		Candidate.SymmetryMask = Key->SymmetryMask;
 
-			b32 IsTileUnique = true;
-			for (u32 UniqueTileIndex = 0; UniqueTileIndex < Result.NumUniqueTiles; UniqueTileIndex++)
+		s32 EquivalentIndex = -1;
+		if (Palette)
+		{
+			indexed_tile* IndexedCandidate = IndexedTiles + TileIndex;
+			if (UseLinearDedup)
 			{
-				unique_tile* UnqiueTile = MinimisedTiles + UniqueTileIndex;
-				if (AreTilesEqual(UnqiueTile, Tile))
+				for (u32 UniqueTileIndex = 0; UniqueTileIndex < UniqueTiles.NumUniqueTiles; UniqueTileIndex++)
 				{
-					IsTileUnique = false;
-					break;
+					if (AreIndexedTilesEqual(IndexedTiles + UniqueSourceTiles[UniqueTileIndex], IndexedCandidate,
+					                         Palette->BitsPerPixel))
+					{
+						EquivalentIndex = (s32)UniqueTileIndex;
+						break;
+					}
 				}
 			}
-			if (IsTileUnique)
+			else
 			{
-				unique_tile* NewUniqueTile = MinimisedTiles + Result.NumUniqueTiles;
-				GenerateTileVariants(Tile, NewUniqueTile);
-
-				Tile->EquivalentUniqueTile = NewUniqueTile;
-				Tile->EqualAfterTransform = TileTransform_Unchanged;
+				EquivalentIndex = FindIndexedUniqueTile(&HashTable, IndexedTiles, UniqueSourceTiles, IndexedCandidate, Key->Hash,
+				                                        Palette->BitsPerPixel);
+			}
+		}
+		else if (UseLinearDedup)
+		{
+			// O(n^2) scan - kept around so output can be diffed against the hashed path
+			for (u32 UniqueTileIndex = 0; UniqueTileIndex < UniqueTiles.NumUniqueTiles; UniqueTileIndex++)
+			{
+				unique_tile* UniqueTile = GetUniqueTile(&UniqueTiles, UniqueTileIndex);
+				if (AreTilesEqualNoFlip(&UniqueTile->Canonical, &Candidate.Canonical))
+				{
+					EquivalentIndex = (s32)UniqueTileIndex;
+					break;
+				}
+			}
+		}
+		else
+		{
+			EquivalentIndex = FindUniqueTile(&HashTable, &UniqueTiles, &Candidate, Key->Hash);
+		}
 
-				Result.NumUniqueTiles++;
+		if (EquivalentIndex >= 0)
+		{
+			MarkTileEquivalent(GetUniqueTile(&UniqueTiles, (u32)EquivalentIndex), Mapping, Candidate.CanonicalTransform);
+			UniqueTileIndices[TileIndex] = (u32)EquivalentIndex;
+		}
+		else
+		{
+			UniqueTileIndices[TileIndex] = UniqueTiles.NumUniqueTiles;
+			if (Palette)
+			{
+				UniqueSourceTiles[UniqueTiles.NumUniqueTiles] = TileIndex;
+				CopyTransformedTile(Tile, &Candidate.Canonical, Key->CanonicalTransform);
 			}
+			if (!UseLinearDedup)
+			{
+				InsertUniqueTile(Scratch, &HashTable, Key->Hash, UniqueTiles.NumUniqueTiles);
+			}
+			*AddUniqueTile(&UniqueTiles) = Candidate;
+
+			Mapping->EqualAfterTransform = TileTransform_Unchanged;
 		}
 	}
-	if (Result.NumUniqueTiles == OriginalImage->TileWidth * OriginalImage->TileHeight)
+
+	Result.NumUniqueTiles = UniqueTiles.NumUniqueTiles;
+	if (TileOrder != SMINT_TILE_ORDER_FIRST && Usage)
 	{
-		printf("Tileset '%s' is already minimal; nothing to do.\n\n", TilesetBaseName);
-		Result.IsUnchanged = true;
-		if (CurrentWorkingDir)
+		// Unique tiles are found in tile order, then moved to wherever the usage in the map(s) puts them
+		u32* NewIndices = PushArray(Scratch, Result.NumUniqueTiles, u32);
+		OrderUniqueTiles(Result.NumUniqueTiles, UniqueTileIndices, NumSourceTiles, TilesInUse, Usage, TileOrder, Scratch,
+		                 NewIndices);
+		unique_tile* FoundTiles = PackUniqueTiles(&UniqueTiles, Scratch);
+		Result.MinimisedTiles = PushArray(Arena, Result.NumUniqueTiles, unique_tile);
+		for (u32 UniqueTileIndex = 0; UniqueTileIndex < Result.NumUniqueTiles; UniqueTileIndex++)
+		{
+			Result.MinimisedTiles[NewIndices[UniqueTileIndex]] = FoundTiles[UniqueTileIndex];
+		}
+		for (u32 TileIndex = 0; TileIndex < NumSourceTiles; TileIndex++)
 		{
-			// Change working directory back to where the .tmj file is
-			if (!ChangeWorkingDir(CurrentWorkingDir))
+			if (!TilesInUse || TilesInUse[TileIndex])
 			{
-				Result.Error = true;
-				return Result;
+				UniqueTileIndices[TileIndex] = NewIndices[UniqueTileIndices[TileIndex]];
 			}
 		}
-		return Result;
 	}
-
-	// Work out most square-ish dimensions of output image so width and height both evenly divide NumUniqueTiles (no blank/wasted tiles)
-	u32 OutputTileHeight = (u32)sqrt(Result.NumUniqueTiles);
-	u32 OutputTileWidth = Result.NumUniqueTiles / OutputTileHeight;
-	while (!(Result.NumUniqueTiles % OutputTileWidth == 0 && Result.NumUniqueTiles % OutputTileHeight == 0))
+	else
 	{
-		OutputTileHeight--;
-		OutputTileWidth = Result.NumUniqueTiles / OutputTileHeight;
+		Result.MinimisedTiles = PackUniqueTiles(&UniqueTiles, Arena);
 	}
-
-	// Write back out minimised tileset image
-	s32 OutputImageWidth = (s32)OutputTileWidth * 8;
-	s32 OutputImageHeight = (s32)OutputTileHeight * 8;
-	Assert(OutputImageWidth > 0 && OutputTileHeight > 0);
-
-	pixel* OutputPixels = (pixel*)malloc(sizeof(pixel) * OutputImageWidth * OutputImageHeight);
-	for (u32 TileY = 0; TileY < OutputTileHeight; TileY++)
+	unique_tile* MinimisedTiles = Result.MinimisedTiles;
+	for (u32 TileIndex = 0; TileIndex < NumSourceTiles; TileIndex++)
 	{
-		for (u32 TileX = 0; TileX < OutputTileWidth; TileX++)
+		if (!TilesInUse || TilesInUse[TileIndex])
 		{
-			u32 TileIndex = TileY * OutputTileWidth + TileX;
-			tile* SourceTile = MinimisedTiles[TileIndex].Variants + TileTransform_Unchanged;
+			Result.Mappings[TileIndex].EquivalentUniqueTile = MinimisedTiles + UniqueTileIndices[TileIndex];
+		}
+	}
 
-			for (u32 PixelY = 0; PixelY < 8; PixelY++)
-			{
-				for (u32 PixelX = 0; PixelX < 8; PixelX++)
-				{
-					u32 DestIndex = TileY * OutputImageWidth * 8 + PixelY * OutputImageWidth + TileX * 8 + PixelX;
+	// Unique tiles keep their own copy of their pixels, so the source image isn't needed any more (unless it's being kept
+	// resident for next time)
+	if (Resident)
+	{
+		stbi_image_free(Resident->Image.Tiles);
+		TrackedFree(Resident->Keys);
+		Resident->Image = *OriginalImage;
+		Resident->Keys = Keys;
+		Resident->AreKeysIndexed = Palette != nullptr;
+	}
+	else
+	{
+		stbi_image_free(ImageData);
+	}
+	OriginalImage->Tiles = nullptr;
+	EndStage(&DedupTimer);
 
-					pixel* PixelToWrite = OutputPixels + DestIndex;
-					pixel* PixelToRead = PixelAt(SourceTile, PixelX, PixelY);
+	if (Result.NumUniqueTiles == OriginalImage->TileWidth * OriginalImage->TileHeight)
+	{
+		LogInfo("Tileset '%s' is already minimal; nothing to do.\n\n", TilesetBaseName);
+		Result.IsUnchanged = true;
+		return Result;
+	}
 
-					*PixelToWrite = *PixelToRead;
-				}
-			}
-		}
+	// Write back out minimised tileset image
+	stage_timer WritePngTimer = BeginStage(Stage_WritePng);
+	u32 OutputTileWidth, OutputTileHeight;
+	if (!WriteUniqueTileImage(MinimisedTiles, Result.NumUniqueTiles, Paths.ImageOutFullPath, Scratch, &OutputTileWidth,
+	                          &OutputTileHeight, Png))
+	{
+		LogError("ERROR: Failed to write output image '%s'.\n", Paths.ImageOutPath);
+		Result.Error = true;
+		return Result;
 	}
+	EndStage(&WritePngTimer);
+	s32 OutputImageWidth = (s32)OutputTileWidth * 8;
+	s32 OutputImageHeight = (s32)OutputTileHeight * 8;
 
 	char NewName[MAX_PATH];
 	*NewName = 0;
@@ -305,7 +765,7 @@ minimised_tileset MinimiseTileset(const char* TilesetPath,
 	}
 	else
 	{
-		printf("WARNING: Could not find 'name' field in tileset file %s.\n", TilesetPath);
+		LogInfo("WARNING: Could not find 'name' field in tileset file %s.\n", TilesetPath);
 	}
 
 	if (JsonDoc.HasMember("imagewidth") && JsonDoc["imagewidth"].IsUint() &&
@@ -316,7 +776,7 @@ minimised_tileset MinimiseTileset(const char* TilesetPath,
 	}
 	else
 	{
-		printf("WARNING: Could not find 'imagewidth'/'imageheight' field(s) in tileset file %s\n", TilesetPath);
+		LogInfo("WARNING: Could not find 'imagewidth'/'imageheight' field(s) in tileset file %s\n", TilesetPath);
 	}
 	if (JsonDoc.HasMember("tilecount") && JsonDoc["tilecount"].IsUint())
 	{
@@ -324,7 +784,7 @@ minimised_tileset MinimiseTileset(const char* TilesetPath,
 	}
 	else
 	{
-		printf("WARNING: Could not find 'tilecount' field in tileset file %s\n", TilesetPath);
+		LogInfo("WARNING: Could not find 'tilecount' field in tileset file %s\n", TilesetPath);
 	}
 	if (JsonDoc.HasMember("columns") && JsonDoc["columns"].IsUint())
 	{
@@ -332,48 +792,28 @@ minimised_tileset MinimiseTileset(const char* TilesetPath,
 	}
 	else
 	{
-		printf("WARNING: Could not find 'columns' field in tileset file %s\n", TilesetPath);
+		LogInfo("WARNING: Could not find 'columns' field in tileset file %s\n", TilesetPath);
 	}
 
 
-	char ImageOutPath[MAX_PATH];
-	StripFileExtension(ImagePath, ImageOutPath);
-	strcat(ImageOutPath, "_min.png");
-
-	s32 Stride = OutputImageWidth * sizeof(pixel);
-	if (!stbi_write_png(ImageOutPath, OutputImageWidth, OutputImageHeight, 4, OutputPixels, Stride))
-	{
-		fprintf(stderr, "ERROR: Failed to write output image '%s'.\n", ImageOutPath);
-		Result.Error = true;
-		return Result;
-	}
-
-	JsonDoc["image"].SetString(ImageOutPath, strlen(ImageOutPath), JsonDoc.GetAllocator());
+	JsonDoc["image"].SetString(Paths.ImageOutPath, strlen(Paths.ImageOutPath), JsonDoc.GetAllocator());
 
-	if (CurrentWorkingDir)
-	{
-		// Change working directory back to where the .tmj file is
-		if (!ChangeWorkingDir(CurrentWorkingDir))
-		{
-			Result.Error = true;
-			return Result;
-		}
-	}
-	AppendToFilePath(TilesetPath, "_min", OutNewTilesetPath);
-	if (!WriteJsonToFile(&JsonDoc, OutNewTilesetPath, StringLength))
+	strcpy(OutNewTilesetPath, Paths.NewTilesetPath);
+	stage_timer WriteTilesetTimer = BeginStage(Stage_WriteTileset);
+	if (!WriteJsonToFile(&JsonDoc, Paths.NewTilesetFullPath, StringLength))
 	{
 		Result.Error = true;
 		return Result;
 	}
+	EndStage(&WriteTilesetTimer);
 
 	u32 StartNumTiles = OriginalImage->TileWidth * OriginalImage->TileHeight;
 	f32 Pst = roundf((((f32)StartNumTiles - (f32)Result.NumUniqueTiles) / (f32)StartNumTiles) * 100.0f);
-	printf("Reduced number of tiles in '%s': %u->%u (-%.0f%%)\n", TilesetBaseName, StartNumTiles, Result.NumUniqueTiles, Pst);
+	LogInfo("Reduced number of tiles in '%s': %u->%u (-%.0f%%)\n", TilesetBaseName, StartNumTiles, Result.NumUniqueTiles, Pst);
 
 	char ImageBaseName[MAX_PATH];
-	ExtractBaseFileName(ImageOutPath, ImageBaseName);
-	printf("Wrote minimised tile image to '%s'.\n\n", ImageBaseName);
+	ExtractBaseFileName(Paths.ImageOutPath, ImageBaseName);
+	LogInfo("Wrote minimised tile image to '%s'.\n\n", ImageBaseName);
 
-	//stbi_image_free(ImageData);
 	return Result;
 }
\ No newline at end of file
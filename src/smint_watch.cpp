@@ -0,0 +1,237 @@
+// --watch (and KeepTilesetsResident in the library): keeps running after the first minimisation, and minimises again
+// whenever one of the maps, tilesets or tileset images is saved. Tilesets stay resident between runs (see
+// resident_tileset), so saving a map only costs parsing and remapping the maps, and saving a tileset image only
+// re-canonicalises the tiles that actually changed.
+
+#if __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <cerrno>
+#endif
+
+#define WATCH_POLL_MS 100 // Where there's no way to be notified of changes
+#define WATCH_SETTLE_MS 30 // Editors often save in several steps, so wait for them all to land before starting
+
+// On Linux, inotify wakes us up when anything in a watched directory changes; elsewhere we just poll the file stamps
+struct file_watcher
+{
+	s32 Handle; // -1 if polling
+};
+
+struct watched_map
+{
+	char FullPath[MAX_PATH];
+	file_stamp Stamp; // As of the last run
+	b32 NeedsWrite; // Changed (or one of its tilesets has) since it was last written successfully
+};
+
+struct watch_state
+{
+	resident_tileset** Tilesets;
+	u32 NumTilesets;
+	watched_map** Maps;
+	u32 NumMaps;
+	file_watcher Watcher;
+};
+
+file_watcher CreateFileWatcher()
+{
+	file_watcher Result;
+#if __linux__
+	Result.Handle = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#else
+	Result.Handle = -1;
+#endif
+	return Result;
+}
+
+void CloseFileWatcher(file_watcher* Watcher)
+{
+#if __linux__
+	if (Watcher->Handle >= 0)
+	{
+		close(Watcher->Handle);
+	}
+#endif
+	Watcher->Handle = -1;
+}
+
+watch_state* CreateWatchState()
+{
+	watch_state* Result = (watch_state*)TrackedCalloc(1, sizeof(watch_state));
+	Result->Watcher = CreateFileWatcher();
+	return Result;
+}
+
+void FreeResidentTileset(resident_tileset* Resident)
+{
+	stbi_image_free(Resident->Tiles.Image.Tiles);
+	TrackedFree(Resident->Tiles.Keys);
+	ClearArena(&Resident->Arena);
+	TrackedFree(Resident);
+}
+
+void FreeWatchState(watch_state* Watch)
+{
+	for (u32 TilesetIndex = 0; TilesetIndex < Watch->NumTilesets; TilesetIndex++)
+	{
+		FreeResidentTileset(Watch->Tilesets[TilesetIndex]);
+	}
+	for (u32 MapIndex = 0; MapIndex < Watch->NumMaps; MapIndex++)
+	{
+		TrackedFree(Watch->Maps[MapIndex]);
+	}
+	TrackedFree(Watch->Tilesets);
+	TrackedFree(Watch->Maps);
+	CloseFileWatcher(&Watch->Watcher);
+	TrackedFree(Watch);
+}
+
+// Called just before a map is read, so a save while it's being processed is picked up next time
+watched_map* WatchMap(watch_state* Watch, const char* FullPath)
+{
+	watched_map* Result = nullptr;
+	for (u32 MapIndex = 0; MapIndex < Watch->NumMaps && !Result; MapIndex++)
+	{
+		if (strcmp(Watch->Maps[MapIndex]->FullPath, FullPath) == 0)
+		{
+			Result = Watch->Maps[MapIndex];
+		}
+	}
+	if (!Result)
+	{
+		Result = (watched_map*)TrackedCalloc(1, sizeof(watched_map));
+		strcpy(Result->FullPath, FullPath);
+		Result->NeedsWrite = true;
+		Watch->Maps = (watched_map**)TrackedRealloc(Watch->Maps, sizeof(watched_map*) * (Watch->NumMaps + 1));
+		Watch->Maps[Watch->NumMaps++] = Result;
+	}
+
+	file_stamp Stamp = GetFileStamp(FullPath);
+	if (!AreFileStampsEqual(Stamp, Result->Stamp))
+	{
+		Result->NeedsWrite = true;
+	}
+	Result->Stamp = Stamp;
+	return Result;
+}
+
+// Points every job at its tileset's resident state, creating it the first time a tileset is seen
+void AttachResidentTilesets(watch_state* Watch, tileset_job* Jobs, u32 NumJobs)
+{
+	for (u32 JobIndex = 0; JobIndex < NumJobs; JobIndex++)
+	{
+		tileset_job* Job = Jobs + JobIndex;
+		char JoinedPath[MAX_PATH];
+		char FullPath[MAX_PATH];
+		JoinPath(Job->BaseDir, Job->TilesetPath, JoinedPath);
+		TryGetFullPath(JoinedPath, FullPath);
+
+		resident_tileset* Resident = nullptr;
+		for (u32 TilesetIndex = 0; TilesetIndex < Watch->NumTilesets && !Resident; TilesetIndex++)
+		{
+			if (strcmp(Watch->Tilesets[TilesetIndex]->FullPath, FullPath) == 0)
+			{
+				Resident = Watch->Tilesets[TilesetIndex];
+			}
+		}
+		if (!Resident)
+		{
+			Resident = (resident_tileset*)TrackedCalloc(1, sizeof(resident_tileset));
+			strcpy(Resident->FullPath, FullPath);
+			Watch->Tilesets = (resident_tileset**)TrackedRealloc(Watch->Tilesets, sizeof(resident_tileset*) * (Watch->NumTilesets + 1));
+			Watch->Tilesets[Watch->NumTilesets++] = Resident;
+		}
+		Job->Resident = Resident;
+	}
+}
+
+b32 HaveInputsChanged(watch_state* Watch)
+{
+	for (u32 MapIndex = 0; MapIndex < Watch->NumMaps; MapIndex++)
+	{
+		watched_map* Map = Watch->Maps[MapIndex];
+		if (!AreFileStampsEqual(GetFileStamp(Map->FullPath), Map->Stamp))
+		{
+			return true;
+		}
+	}
+	for (u32 TilesetIndex = 0; TilesetIndex < Watch->NumTilesets; TilesetIndex++)
+	{
+		resident_tileset* Resident = Watch->Tilesets[TilesetIndex];
+		if (!AreFileStampsEqual(GetFileStamp(Resident->FullPath), Resident->TilesetStamp) ||
+		    (*Resident->ImageFullPath && !AreFileStampsEqual(GetFileStamp(Resident->ImageFullPath), Resident->ImageStamp)))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Directories are watched rather than files, since many editors save by writing a new file and renaming it over the old
+void WatchFileDirectory(file_watcher* Watcher, const char* FilePath)
+{
+#if __linux__
+	if (Watcher->Handle < 0)
+	{
+		return;
+	}
+	char Dir[MAX_PATH];
+	StripFileName(FilePath, Dir);
+	if (!*Dir)
+	{
+		strcpy(Dir, ".");
+	}
+	// Watching the same directory again just returns the existing watch
+	inotify_add_watch(Watcher->Handle, Dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_ATTRIB);
+#else
+	(void)Watcher;
+	(void)FilePath;
+#endif
+}
+
+void WatchInputs(watch_state* Watch)
+{
+	for (u32 MapIndex = 0; MapIndex < Watch->NumMaps; MapIndex++)
+	{
+		WatchFileDirectory(&Watch->Watcher, Watch->Maps[MapIndex]->FullPath);
+	}
+	for (u32 TilesetIndex = 0; TilesetIndex < Watch->NumTilesets; TilesetIndex++)
+	{
+		resident_tileset* Resident = Watch->Tilesets[TilesetIndex];
+		WatchFileDirectory(&Watch->Watcher, Resident->FullPath);
+		if (*Resident->ImageFullPath)
+		{
+			WatchFileDirectory(&Watch->Watcher, Resident->ImageFullPath);
+		}
+	}
+}
+
+#if __linux__
+void DrainFileWatcher(file_watcher* Watcher)
+{
+	alignas(inotify_event) char Events[4096];
+	while (read(Watcher->Handle, Events, sizeof(Events)) > 0)
+	{
+	}
+}
+#endif
+
+// Blocks until something may have changed. Our own output files trigger this too, so callers check the file stamps to
+// see whether anything they care about actually did.
+void WaitForFileChanges(file_watcher* Watcher)
+{
+#if __linux__
+	if (Watcher->Handle >= 0)
+	{
+		pollfd PollFd = {Watcher->Handle, POLLIN, 0};
+		while (poll(&PollFd, 1, -1) < 0 && errno == EINTR)
+		{
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(WATCH_SETTLE_MS));
+		DrainFileWatcher(Watcher);
+		return;
+	}
+#endif
+	std::this_thread::sleep_for(std::chrono::milliseconds(WATCH_POLL_MS));
+}
@@ -5,6 +5,8 @@
 typedef uint8_t b8;
 typedef int8_t s8;
 typedef uint8_t u8;
+typedef int16_t s16;
+typedef uint16_t u16;
 typedef float f32;
 typedef double f64;
 typedef uint32_t u32;